@@ -1,3 +1,9 @@
 set(DAWN_FETCH_DEPENDENCIES ON)
 set(DAWN_BUILD_MONOLITHIC_LIBRARY STATIC)
+
+# CPU Vulkan implementation, the adapter of --adapter software on machines without a GPU
+option(ENABLE_SWIFTSHADER "Build Dawn with the SwiftShader fallback adapter" OFF)
+if(ENABLE_SWIFTSHADER)
+    set(DAWN_ENABLE_SWIFTSHADER ON)
+endif()
 add_subdirectory("external/dawn" EXCLUDE_FROM_ALL)
@@ -0,0 +1,25 @@
+# Writes OUTPUT, a header holding every .wgsl file of SHADER_DIR as a string literal, for
+# core::ShaderRegistry. Run as a script by the build (see CMakeLists.txt):
+#   cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P embed_shaders.cmake
+file(GLOB shader_files "${SHADER_DIR}/*.wgsl")
+list(SORT shader_files)
+
+set(content "// Generated by cmake/embed_shaders.cmake, do not edit\n")
+string(APPEND content "#pragma once\n\n#include <string_view>\n#include <utility>\n\n")
+string(APPEND content "namespace core::embedded {\n\n")
+string(APPEND content "inline constexpr std::pair<std::string_view, std::string_view> shaders[] = {\n")
+foreach(file ${shader_files})
+    get_filename_component(name "${file}" NAME)
+    file(READ "${file}" source)
+    string(FIND "${source}" ")wgsl\"" delimiter)
+    if(NOT delimiter EQUAL -1)
+        message(FATAL_ERROR "${name} contains the raw string delimiter )wgsl\"")
+    endif()
+    string(APPEND content "    {\"${name}\", R\"wgsl(${source})wgsl\"},\n")
+endforeach()
+string(APPEND content "};\n\n} // namespace core::embedded\n")
+
+# Only touch the header when a shader changed, so unrelated rebuilds stay incremental
+file(WRITE "${OUTPUT}.tmp" "${content}")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
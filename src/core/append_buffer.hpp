@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+/**
+ * Append-only buffer shared by many producer threads without locks.
+ *
+ * Storage is a list of chunks of doubling size (chunk k holds first_chunk << k slots), so slots
+ * never move and nothing is copied as the buffer grows: a missing chunk is allocated once, by the
+ * first writer reaching it, while other writers reaching it yield until it is published. Each
+ * producer thread takes a Writer, which claims block_size consecutive slots with one fetch_add on
+ * the shared counter and fills them with plain stores, so contention is one atomic per block
+ * rather than per item.
+ *
+ * Slots claimed but not filled (the end of each writer's last block) stay empty and are skipped by
+ * finalize(). finalize() and clear() must only be called once every writer is done, e.g. after
+ * joining the producer threads. finalize() sorts by a caller-given key, so the result does not
+ * depend on thread scheduling as long as keys are unique.
+ */
+template <typename T>
+class AppendBuffer {
+    struct Slot {
+        T value{};
+        bool filled = false;
+    };
+
+public:
+    static constexpr size_t kMaxChunks = 40;
+
+    explicit AppendBuffer(size_t block_size = 64, size_t first_chunk = 1024)
+        : blockSize_(std::max<size_t>(block_size, 1)), firstChunk_(std::max<size_t>(first_chunk, 1)) {
+        for (auto& chunk : chunks_) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~AppendBuffer() {
+        for (auto& chunk : chunks_) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    AppendBuffer(const AppendBuffer&) = delete;
+    AppendBuffer& operator=(const AppendBuffer&) = delete;
+
+    // Per-thread handle, not shareable between threads
+    class Writer {
+    public:
+        explicit Writer(AppendBuffer& buffer) : buffer_(&buffer) {}
+
+        void push_back(T item) {
+            if (next_ == end_) {
+                next_ = buffer_->claimed_.fetch_add(buffer_->blockSize_, std::memory_order_relaxed);
+                end_ = next_ + buffer_->blockSize_;
+            }
+            Slot& slot = buffer_->slot(next_++);
+            slot.value = std::move(item);
+            slot.filled = true;
+        }
+
+    private:
+        AppendBuffer* buffer_;
+        size_t next_ = 0;
+        size_t end_ = 0;
+    };
+
+    Writer writer() {
+        return Writer(*this);
+    }
+
+    // Filled items sorted by key(item), which must be comparable
+    template <typename KeyFn>
+    std::vector<T> finalize(KeyFn key) const {
+        std::vector<T> items;
+        size_t claimed = claimed_.load(std::memory_order_acquire);
+        items.reserve(claimed);
+        forEachSlot(claimed, [&](const Slot& slot) {
+            if (slot.filled) {
+                items.push_back(slot.value);
+            }
+        });
+
+        std::sort(items.begin(), items.end(), [&](const T& a, const T& b) { return key(a) < key(b); });
+        return items;
+    }
+
+    // Empties the buffer and keeps the chunks for reuse
+    void clear() {
+        size_t claimed = claimed_.load(std::memory_order_acquire);
+        forEachSlot(claimed, [](Slot& slot) { slot.filled = false; });
+        claimed_.store(0, std::memory_order_release);
+    }
+
+    // Slots handed out to writers, an upper bound of the item count
+    size_t claimed() const {
+        return claimed_.load(std::memory_order_acquire);
+    }
+
+private:
+    size_t blockSize_;
+    size_t firstChunk_;
+    std::atomic<size_t> claimed_{0};
+    std::array<std::atomic<Slot*>, kMaxChunks> chunks_;
+
+    // Chunk k covers [first * (2^k - 1), first * (2^(k+1) - 1))
+    size_t chunkOf(size_t index) const {
+        return static_cast<size_t>(std::bit_width(index / firstChunk_ + 1)) - 1;
+    }
+
+    size_t chunkStart(size_t chunk) const {
+        return firstChunk_ * ((size_t(1) << chunk) - 1);
+    }
+
+    // Marks a chunk being allocated by another writer
+    static Slot* allocating() {
+        return reinterpret_cast<Slot*>(alignof(Slot));
+    }
+
+    Slot& slot(size_t index) {
+        size_t chunk = chunkOf(index);
+        Slot* slots = chunks_[chunk].load(std::memory_order_acquire);
+        if (!slots && chunks_[chunk].compare_exchange_strong(slots, allocating(), std::memory_order_acq_rel)) {
+            slots = new Slot[firstChunk_ << chunk];
+            chunks_[chunk].store(slots, std::memory_order_release);
+        }
+        // Rather than each allocating a chunk and all but one throwing it away, late writers wait
+        while (slots == allocating() || !slots) {
+            std::this_thread::yield();
+            slots = chunks_[chunk].load(std::memory_order_acquire);
+        }
+        return slots[index - chunkStart(chunk)];
+    }
+
+    template <typename Fn>
+    void forEachSlot(size_t count, Fn fn) const {
+        for (size_t chunk = 0; chunk < kMaxChunks && chunkStart(chunk) < count; ++chunk) {
+            Slot* slots = chunks_[chunk].load(std::memory_order_acquire);
+            if (!slots) continue;  // claimed by a writer that never pushed into it
+            size_t end = std::min(count - chunkStart(chunk), firstChunk_ << chunk);
+            for (size_t i = 0; i < end; ++i) {
+                fn(slots[i]);
+            }
+        }
+    }
+};
+
+} // namespace core
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "core/append_buffer.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+struct AppendBenchmarkResult {
+    int threads = 0;
+    double append_buffer_ms = 0.0;  // all threads pushing through AppendBuffer writers
+    double mutex_vector_ms = 0.0;   // all threads pushing into one std::vector under a mutex
+    double finalize_ms = 0.0;       // AppendBuffer::finalize of everything pushed
+};
+
+/**
+ * Contention microbenchmark: every thread appends items_per_thread integers at once, first through
+ * an AppendBuffer, then into a mutex-guarded std::vector as the baseline.
+ *
+ * Args:
+ * - thread_counts: producer thread counts to compare
+ * - items_per_thread: appends per thread and run
+ */
+std::vector<AppendBenchmarkResult> benchmarkAppendBuffer(
+    const std::vector<int>& thread_counts = {1, 2, 4, 8, 16, 32, 64},
+    size_t items_per_thread = 100000
+) {
+    using Clock = std::chrono::high_resolution_clock;
+    std::vector<AppendBenchmarkResult> results;
+
+    for (int thread_count : thread_counts) {
+        AppendBenchmarkResult result;
+        result.threads = thread_count;
+
+        AppendBuffer<uint64_t> buffer;
+        auto start = Clock::now();
+        {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&buffer, t, items_per_thread] {
+                    auto writer = buffer.writer();
+                    for (size_t i = 0; i < items_per_thread; ++i) {
+                        writer.push_back((static_cast<uint64_t>(t) << 32) | i);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+        auto end = Clock::now();
+        result.append_buffer_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = Clock::now();
+        auto items = buffer.finalize([](uint64_t item) { return item; });
+        end = Clock::now();
+        result.finalize_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        std::vector<uint64_t> shared;
+        std::mutex mutex;
+        start = Clock::now();
+        {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&shared, &mutex, t, items_per_thread] {
+                    for (size_t i = 0; i < items_per_thread; ++i) {
+                        std::lock_guard lock(mutex);
+                        shared.push_back((static_cast<uint64_t>(t) << 32) | i);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+        end = Clock::now();
+        result.mutex_vector_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        if (items.size() != shared.size()) {
+            std::fprintf(stderr, "AppendBuffer lost items: %zu vs %zu\n", items.size(), shared.size());
+        }
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+void printAppendBenchmark(const std::vector<AppendBenchmarkResult>& results) {
+    std::printf("%8s %16s %16s %14s\n", "threads", "append buf ms", "mutex vec ms", "finalize ms");
+    for (const auto& r : results) {
+        std::printf("%8d %16.2f %16.2f %14.2f\n", r.threads, r.append_buffer_ms, r.mutex_vector_ms, r.finalize_ms);
+    }
+}
+
+} // namespace core
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace core {
+
+/**
+ * Dawn's blob cache persisted as one file per entry in a directory, so that a warm start finds
+ * the compiled shaders and pipelines of the previous run instead of compiling WGSL again.
+ *
+ * Dawn hands opaque keys and values to the load and store callbacks of
+ * wgpu::DawnCacheDeviceDescriptor (see chain()). Files are named after a hash of the key and
+ * start with the full key, so a hash collision reads as a miss rather than as the wrong blob.
+ * Stores go through a temporary file and a rename, so a crash never leaves a truncated entry.
+ * Keys already carry the adapter and Dawn version, so one directory can serve several GPUs.
+ */
+class BlobCache {
+public:
+    explicit BlobCache(std::filesystem::path directory) : directory_(std::move(directory)) {
+        std::error_code error;
+        std::filesystem::create_directories(directory_, error);
+        if (error) {
+            std::fprintf(stderr, "Blob cache disabled, cannot create %s: %s\n",
+                         directory_.string().c_str(), error.message().c_str());
+            directory_.clear();
+        }
+    }
+
+    BlobCache(const BlobCache&) = delete;
+    BlobCache& operator=(const BlobCache&) = delete;
+
+    // Chains the cache into desc; the descriptor must stay alive until the device is created
+    void chain(wgpu::DeviceDescriptor& desc, wgpu::DawnCacheDeviceDescriptor& cacheDesc) {
+        if (directory_.empty()) return;
+        cacheDesc.loadDataFunction = &BlobCache::load;
+        cacheDesc.storeDataFunction = &BlobCache::store;
+        cacheDesc.functionUserdata = this;
+        cacheDesc.nextInChain = desc.nextInChain;
+        desc.nextInChain = &cacheDesc;
+    }
+
+    const std::filesystem::path& directory() const { return directory_; }
+    size_t hits() const { return hits_.load(); }
+    size_t misses() const { return misses_.load(); }
+    size_t stores() const { return stores_.load(); }
+
+private:
+    std::filesystem::path directory_;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    std::atomic<size_t> stores_{0};
+
+    std::filesystem::path entryPath(std::string_view key) const {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+        return directory_ / name;
+    }
+
+    // Value of key, empty if missing or written for another key
+    std::vector<char> read(std::string_view key) const {
+        std::ifstream file(entryPath(key), std::ios::binary);
+        if (!file) return {};
+
+        uint64_t keySize = 0;
+        file.read(reinterpret_cast<char*>(&keySize), sizeof(keySize));
+        if (!file || keySize != key.size()) return {};
+
+        std::string storedKey(keySize, '\0');
+        file.read(storedKey.data(), keySize);
+        if (!file || storedKey != key) return {};
+
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // Called twice per lookup by Dawn: without a buffer for the size, then to copy the value
+    static size_t load(const void* key, size_t keySize, void* value, size_t valueSize, void* userdata) {
+        auto* cache = static_cast<BlobCache*>(userdata);
+        std::vector<char> blob = cache->read({static_cast<const char*>(key), keySize});
+        if (blob.empty()) {
+            cache->misses_++;
+            return 0;
+        }
+        if (value == nullptr || valueSize == 0) {
+            return blob.size();
+        }
+        if (valueSize < blob.size()) {
+            return 0;
+        }
+        std::memcpy(value, blob.data(), blob.size());
+        cache->hits_++;
+        return blob.size();
+    }
+
+    static void store(const void* key, size_t keySize, const void* value, size_t valueSize, void* userdata) {
+        auto* cache = static_cast<BlobCache*>(userdata);
+        std::string_view keyView(static_cast<const char*>(key), keySize);
+        std::filesystem::path path = cache->entryPath(keyView);
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            uint64_t size = keySize;
+            file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            file.write(keyView.data(), keySize);
+            file.write(static_cast<const char*>(value), valueSize);
+            if (!file) return;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (!error) {
+            cache->stores_++;
+        }
+    }
+};
+
+} // namespace core
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace core {
+
+// What push does when the queue is full
+enum class OverflowPolicy {
+    Block,      // wait for the consumer (back-pressure)
+    DropOldest  // discard the oldest queued item to make room
+};
+
+/**
+ * Fixed capacity FIFO shared between one producer and one consumer thread.
+ *
+ * Items come out in push order, so a chain of single-threaded stages keeps frame ordering.
+ * close() wakes everyone up: push then fails and pop drains what is left before failing.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity, OverflowPolicy policy = OverflowPolicy::Block)
+        : capacity_(capacity > 0 ? capacity : 1), policy_(policy) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false if the queue was closed
+    bool push(T item) {
+        std::unique_lock lock(mutex_);
+
+        if (policy_ == OverflowPolicy::Block) {
+            notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        }
+        if (closed_) return false;
+
+        if (items_.size() >= capacity_) {
+            items_.pop_front();
+            dropped_++;
+        }
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available. Returns false once closed and drained.
+    bool pop(T& out) {
+        std::unique_lock lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+
+        out = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        std::lock_guard lock(mutex_);
+        if (items_.empty()) return false;
+
+        out = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard lock(mutex_);
+        return items_.size();
+    }
+
+    // Number of items discarded by the DropOldest policy
+    size_t dropped() const {
+        std::lock_guard lock(mutex_);
+        return dropped_;
+    }
+
+private:
+    size_t capacity_;
+    OverflowPolicy policy_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    size_t dropped_ = 0;
+};
+
+} // namespace core
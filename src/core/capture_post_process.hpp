@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <webgpu/webgpu_cpp.h>
+#include "core/context.hpp"
+
+namespace core {
+
+struct PostProcessSettings {
+    float noise = 0.0f;        // blend of the sensor noise, 0 disables it (NoisePass blends 0.5)
+    bool difference = false;   // also output the temporal difference against the previous frame
+};
+
+/**
+ * Downsample, sensor noise and temporal difference of all the layers of a capture in a single
+ * compute dispatch (capture_post_process.wgsl), replacing a Downsampler pass and a NoisePass
+ * pass per camera.
+ *
+ * The output is an RGBA8Unorm storage texture array holding BGRA ordered bytes; with
+ * PostProcessSettings::difference its alpha is the grey level of the absolute difference with
+ * the previous output, so the callers ping-pong two outputs and hand the other one as previous.
+ */
+class CapturePostProcess {
+public:
+    struct Params {
+        float time;
+        float seed;
+        float noise;
+        uint32_t difference;
+    };
+
+    explicit CapturePostProcess(Context* ctx) : ctx_(ctx) {
+        createPipeline();
+
+        wgpu::BufferDescriptor bufferDesc{};
+        bufferDesc.label = "Capture post-process params";
+        bufferDesc.size = sizeof(Params);
+        bufferDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+        paramsBuffer_ = ctx_->device.CreateBuffer(&bufferDesc);
+    }
+
+    /**
+     * Made once per set of textures and reused every frame.
+     * src, dst and previous are 2D array views with the same layer count; dst and previous are
+     * RGBA8Unorm and must be different textures.
+     */
+    wgpu::BindGroup createBindGroup(wgpu::TextureView src, wgpu::TextureView dst, wgpu::TextureView previous) {
+        std::array<wgpu::BindGroupEntry, 4> entries{};
+        entries[0].binding = 0;
+        entries[0].textureView = src;
+        entries[1].binding = 1;
+        entries[1].textureView = dst;
+        entries[2].binding = 2;
+        entries[2].textureView = previous;
+        entries[3].binding = 3;
+        entries[3].buffer = paramsBuffer_;
+        entries[3].size = sizeof(Params);
+
+        wgpu::BindGroupDescriptor bgDesc{};
+        bgDesc.layout = bindGroupLayout_;
+        bgDesc.entryCount = entries.size();
+        bgDesc.entries = entries.data();
+        return ctx_->device.CreateBindGroup(&bgDesc);
+    }
+
+    // Records the pass into encoder; the parameters are written to the queue only when they change
+    void dispatch(wgpu::CommandEncoder& encoder, wgpu::BindGroup bindGroup,
+                  uint32_t dstWidth, uint32_t dstHeight, uint32_t layers,
+                  const PostProcessSettings& settings, float time, float seed)
+    {
+        Params params{time, seed, settings.noise, settings.difference ? 1u : 0u};
+        if (!paramsWritten_ || std::memcmp(&params, &params_, sizeof(Params)) != 0) {
+            ctx_->queue.WriteBuffer(paramsBuffer_, 0, &params, sizeof(Params));
+            params_ = params;
+            paramsWritten_ = true;
+        }
+
+        wgpu::ComputePassEncoder pass = encoder.BeginComputePass();
+        pass.SetPipeline(pipeline_);
+        pass.SetBindGroup(0, bindGroup);
+        pass.DispatchWorkgroups((dstWidth + 7) / 8, (dstHeight + 7) / 8, layers);
+        pass.End();
+    }
+
+private:
+    Context* ctx_;
+    wgpu::ComputePipeline pipeline_;
+    wgpu::BindGroupLayout bindGroupLayout_;
+    wgpu::Buffer paramsBuffer_;
+    Params params_{};
+    bool paramsWritten_ = false;
+
+    void createPipeline() {
+        ShaderRegistry& shaders = *ctx_->shaders;
+
+        bindGroupLayout_ = shaders.bindGroupLayout("capture_post_process", [&] {
+            std::array<wgpu::BindGroupLayoutEntry, 4> layoutEntries{};
+            layoutEntries[0].binding = 0;
+            layoutEntries[0].visibility = wgpu::ShaderStage::Compute;
+            layoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+            layoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+
+            layoutEntries[1].binding = 1;
+            layoutEntries[1].visibility = wgpu::ShaderStage::Compute;
+            layoutEntries[1].storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+            layoutEntries[1].storageTexture.format = wgpu::TextureFormat::RGBA8Unorm;
+            layoutEntries[1].storageTexture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+
+            layoutEntries[2].binding = 2;
+            layoutEntries[2].visibility = wgpu::ShaderStage::Compute;
+            layoutEntries[2].texture.sampleType = wgpu::TextureSampleType::Float;
+            layoutEntries[2].texture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+
+            layoutEntries[3].binding = 3;
+            layoutEntries[3].visibility = wgpu::ShaderStage::Compute;
+            layoutEntries[3].buffer.type = wgpu::BufferBindingType::Uniform;
+            layoutEntries[3].buffer.minBindingSize = sizeof(Params);
+
+            wgpu::BindGroupLayoutDescriptor bglDesc{};
+            bglDesc.entryCount = layoutEntries.size();
+            bglDesc.entries = layoutEntries.data();
+            return ctx_->device.CreateBindGroupLayout(&bglDesc);
+        });
+
+        pipeline_ = shaders.computePipeline("capture_post_process", [&] {
+            wgpu::PipelineLayoutDescriptor plDesc{};
+            plDesc.bindGroupLayoutCount = 1;
+            plDesc.bindGroupLayouts = &bindGroupLayout_;
+            wgpu::PipelineLayout pipelineLayout = ctx_->device.CreatePipelineLayout(&plDesc);
+
+            wgpu::ComputePipelineDescriptor pipelineDesc{};
+            pipelineDesc.layout = pipelineLayout;
+            pipelineDesc.compute.module = shaders.module("capture_post_process.wgsl");
+            pipelineDesc.compute.entryPoint = "main";
+            return ctx_->device.CreateComputePipeline(&pipelineDesc);
+        });
+    }
+};
+
+} // namespace core
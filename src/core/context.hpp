@@ -1,8 +1,13 @@
 #pragma once
 
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string_view>
 #include <webgpu/webgpu_cpp.h>
+#include <webgpu/webgpu_cpp_print.h>
+#include "core/blob_cache.hpp"
+#include "core/shader_registry.hpp"
 
 namespace core {
 
@@ -11,6 +16,15 @@ inline std::string_view toSV(wgpu::StringView sv) {
     return std::string_view(sv.data, sv.length);
 }
 
+// Which adapter Context::initialize asks for
+enum class AdapterPreference {
+    Default,
+    HighPerformance,   // discrete GPU when there is one
+    LowPower,          // integrated GPU when there is one
+    PreferSoftware,    // the CPU fallback adapter (SwiftShader) when available, else the default
+    ForceSoftware,     // the CPU fallback adapter or nothing, for CPU-only machines
+};
+
 class Context {
 public:
     wgpu::Instance instance;
@@ -18,6 +32,17 @@ public:
     wgpu::Device device;
     wgpu::Queue queue;
 
+    // Shader modules and pipelines of the device, see ShaderRegistry
+    std::unique_ptr<ShaderRegistry> shaders;
+
+    // Where Dawn persists compiled shaders and pipelines across runs, set before initialize().
+    // Empty disables the persistent cache.
+    std::filesystem::path cacheDirectory;
+    std::unique_ptr<BlobCache> blobCache;
+
+    // Set before initialize()
+    AdapterPreference adapterPreference = AdapterPreference::Default;
+
     bool initialize() {
         createInstance();
         if (!instance) return false;
@@ -29,6 +54,7 @@ public:
         if (!device) return false;
         
         queue = device.GetQueue();
+        shaders = std::make_unique<ShaderRegistry>(device);
         return true;
     }
 
@@ -45,7 +71,37 @@ private:
     void requestAdapter() {
         wgpu::RequestAdapterOptions options{};
         options.compatibleSurface = nullptr;
+        switch (adapterPreference) {
+            case AdapterPreference::HighPerformance:
+                options.powerPreference = wgpu::PowerPreference::HighPerformance;
+                break;
+            case AdapterPreference::LowPower:
+                options.powerPreference = wgpu::PowerPreference::LowPower;
+                break;
+            case AdapterPreference::PreferSoftware:
+            case AdapterPreference::ForceSoftware:
+                options.forceFallbackAdapter = true;
+                break;
+            default:
+                break;
+        }
 
+        requestAdapter(options);
+        if (!adapter && adapterPreference == AdapterPreference::PreferSoftware) {
+            std::cerr << "No software adapter, using the default one\n";
+            options.forceFallbackAdapter = false;
+            requestAdapter(options);
+        }
+
+        if (adapter) {
+            wgpu::AdapterInfo info{};
+            adapter.GetInfo(&info);
+            std::cout << "Adapter: " << toSV(info.device) << " (" << toSV(info.description) << "), "
+                      << info.backendType << ", " << info.adapterType << '\n';
+        }
+    }
+
+    void requestAdapter(const wgpu::RequestAdapterOptions& options) {
         bool adapterReady = false;
         wgpu::StringView errorMessage{};
 
@@ -92,6 +148,14 @@ private:
             std::cerr << "Device lost: " << toSV(message) << '\n';
         });
 
+#ifndef __EMSCRIPTEN__  // the browser keeps its own cache
+        wgpu::DawnCacheDeviceDescriptor cacheDesc{};
+        if (!cacheDirectory.empty()) {
+            blobCache = std::make_unique<BlobCache>(cacheDirectory);
+            blobCache->chain(desc, cacheDesc);
+        }
+#endif
+
         bool deviceReady = false;
         wgpu::StringView errorMessage{};
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <string>
 #include <webgpu/webgpu_cpp.h>
 #include "core/context.hpp"
 
@@ -14,10 +16,8 @@ public:
         createPipeline();
     }
 
-    void downsample(wgpu::TextureView src, wgpu::TextureView dst,
-                    uint32_t dstWidth, uint32_t dstHeight)
-    {
-        // Create bind group for this source texture
+    // Bind group sampling src, to be made once per source texture and reused every frame
+    wgpu::BindGroup createBindGroup(wgpu::TextureView src) {
         std::array<wgpu::BindGroupEntry, 2> entries{};
         entries[0].binding = 0;
         entries[0].textureView = src;
@@ -28,8 +28,23 @@ public:
         bgDesc.layout = bindGroupLayout_;
         bgDesc.entryCount = entries.size();
         bgDesc.entries = entries.data();
-        wgpu::BindGroup bindGroup = ctx_->device.CreateBindGroup(&bgDesc);
+        return ctx_->device.CreateBindGroup(&bgDesc);
+    }
 
+    void downsample(wgpu::TextureView src, wgpu::TextureView dst,
+                    uint32_t dstWidth, uint32_t dstHeight)
+    {
+        wgpu::CommandEncoder encoder = ctx_->device.CreateCommandEncoder();
+        downsample(encoder, createBindGroup(src), dst, dstWidth, dstHeight);
+
+        wgpu::CommandBuffer commands = encoder.Finish();
+        ctx_->queue.Submit(1, &commands);
+    }
+
+    // Records the downsample of the source of srcBindGroup (see createBindGroup) into encoder
+    void downsample(wgpu::CommandEncoder& encoder, wgpu::BindGroup srcBindGroup, wgpu::TextureView dst,
+                    uint32_t dstWidth, uint32_t dstHeight)
+    {
         // Render pass targeting dst
         wgpu::RenderPassColorAttachment colorAttachment{};
         colorAttachment.view = dst;
@@ -41,17 +56,13 @@ public:
         passDesc.colorAttachmentCount = 1;
         passDesc.colorAttachments = &colorAttachment;
 
-        wgpu::CommandEncoder encoder = ctx_->device.CreateCommandEncoder();
         wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&passDesc);
 
         pass.SetPipeline(pipeline_);
-        pass.SetBindGroup(0, bindGroup);
+        pass.SetBindGroup(0, srcBindGroup);
         pass.SetViewport(0, 0, dstWidth, dstHeight, 0, 1);
         pass.Draw(3);  // Fullscreen triangle, no vertex buffer
         pass.End();
-
-        wgpu::CommandBuffer commands = encoder.Finish();
-        ctx_->queue.Submit(1, &commands);
     }
 
 private:
@@ -71,70 +82,62 @@ private:
     }
 
     void createPipeline() {
-        // Load shader
-        std::string shaderCode = readShader("src/shaders/downsample.wgsl");
-        wgpu::ShaderSourceWGSL wgsl{};
-        wgsl.code = shaderCode.c_str();
-        wgpu::ShaderModuleDescriptor shaderDesc{};
-        shaderDesc.nextInChain = &wgsl;
-        wgpu::ShaderModule shaderModule = ctx_->device.CreateShaderModule(&shaderDesc);
+        ShaderRegistry& shaders = *ctx_->shaders;
 
         // Bind group layout
-        std::array<wgpu::BindGroupLayoutEntry, 2> layoutEntries{};
-        layoutEntries[0].binding = 0;
-        layoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
-        layoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
-        layoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
-
-        layoutEntries[1].binding = 1;
-        layoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
-        layoutEntries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
-
-        wgpu::BindGroupLayoutDescriptor bglDesc{};
-        bglDesc.entryCount = layoutEntries.size();
-        bglDesc.entries = layoutEntries.data();
-        bindGroupLayout_ = ctx_->device.CreateBindGroupLayout(&bglDesc);
-
-        // Pipeline layout
-        wgpu::PipelineLayoutDescriptor plDesc{};
-        plDesc.bindGroupLayoutCount = 1;
-        plDesc.bindGroupLayouts = &bindGroupLayout_;
-        wgpu::PipelineLayout pipelineLayout = ctx_->device.CreatePipelineLayout(&plDesc);
-
-        // Vertex state (no buffers)
-        wgpu::VertexState vertexState{};
-        vertexState.module = shaderModule;
-        vertexState.entryPoint = "vertexMain";
-        vertexState.bufferCount = 0;
-
-        // Fragment state
-        wgpu::ColorTargetState colorTarget{};
-        colorTarget.format = format_;
-
-        wgpu::FragmentState fragmentState{};
-        fragmentState.module = shaderModule;
-        fragmentState.entryPoint = "fragmentMain";
-        fragmentState.targetCount = 1;
-        fragmentState.targets = &colorTarget;
-
-        // Pipeline
-        wgpu::RenderPipelineDescriptor pipelineDesc{};
-        pipelineDesc.layout = pipelineLayout;
-        pipelineDesc.vertex = vertexState;
-        pipelineDesc.fragment = &fragmentState;
-        pipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
-
-        pipeline_ = ctx_->device.CreateRenderPipeline(&pipelineDesc);
-    }
-
-    std::string readShader(const std::string& path) {
-        std::ifstream f(path);
-        if (!f.is_open()) {
-            throw std::runtime_error("Cannot open shader: " + path);
-        }
-        std::stringstream ss;
-        ss << f.rdbuf();
-        return ss.str();
+        bindGroupLayout_ = shaders.bindGroupLayout("downsample", [&] {
+            std::array<wgpu::BindGroupLayoutEntry, 2> layoutEntries{};
+            layoutEntries[0].binding = 0;
+            layoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
+            layoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+            layoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+
+            layoutEntries[1].binding = 1;
+            layoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
+            layoutEntries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+            wgpu::BindGroupLayoutDescriptor bglDesc{};
+            bglDesc.entryCount = layoutEntries.size();
+            bglDesc.entries = layoutEntries.data();
+            return ctx_->device.CreateBindGroupLayout(&bglDesc);
+        });
+
+        // One pipeline per output format, shared by every Downsampler
+        std::string key = "downsample/" + std::to_string(static_cast<uint32_t>(format_));
+        pipeline_ = shaders.renderPipeline(key, [&] {
+            wgpu::ShaderModule shaderModule = shaders.module("downsample.wgsl");
+
+            // Pipeline layout
+            wgpu::PipelineLayoutDescriptor plDesc{};
+            plDesc.bindGroupLayoutCount = 1;
+            plDesc.bindGroupLayouts = &bindGroupLayout_;
+            wgpu::PipelineLayout pipelineLayout = ctx_->device.CreatePipelineLayout(&plDesc);
+
+            // Vertex state (no buffers)
+            wgpu::VertexState vertexState{};
+            vertexState.module = shaderModule;
+            vertexState.entryPoint = "vertexMain";
+            vertexState.bufferCount = 0;
+
+            // Fragment state
+            wgpu::ColorTargetState colorTarget{};
+            colorTarget.format = format_;
+
+            wgpu::FragmentState fragmentState{};
+            fragmentState.module = shaderModule;
+            fragmentState.entryPoint = "fragmentMain";
+            fragmentState.targetCount = 1;
+            fragmentState.targets = &colorTarget;
+
+            // Pipeline
+            wgpu::RenderPipelineDescriptor pipelineDesc{};
+            pipelineDesc.layout = pipelineLayout;
+            pipelineDesc.vertex = vertexState;
+            pipelineDesc.fragment = &fragmentState;
+            pipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+
+            return ctx_->device.CreateRenderPipeline(&pipelineDesc);
+        });
     }
 };
 
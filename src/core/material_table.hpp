@@ -0,0 +1,241 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+#include <Eigen/Dense>
+#include "core/context.hpp"
+#include "scene/material.hpp"
+#include "scene/texture_cache.hpp"
+
+namespace core {
+
+/**
+ * Every material of the scene in one bind group, so that drawing switches no bind group
+ * between objects: draws only carry the id of their Material (see Renderer::DrawData).
+ *
+ * Textures are the layers of one texture array with a full mip chain, images being resampled to
+ * Config::layerSize; the mask of a material goes into the alpha of its layer. Colors and flags
+ * are in a storage buffer indexed by Material::id. Colored materials have no layer, so they cost
+ * an entry of that buffer instead of a texture each.
+ *
+ * Materials are added first, then upload() creates the GPU resources once: the array cannot
+ * grow, materials added later need another upload().
+ */
+class MaterialTable {
+public:
+    struct Config {
+        uint32_t layerSize = 1024;  // texels per side of the texture array layers
+    };
+
+    // One material of the storage buffer, see unlit.wgsl
+    struct Params {
+        float color[4];
+        uint32_t layer;      // in the texture array, noLayer when untextured
+        uint32_t alphaTest;  // discard where the alpha of the layer (the mask) is below 0.5
+        uint32_t padding[2];
+    };
+    static_assert(sizeof(Params) == 32, "matches the WGSL layout of Material");
+
+    static constexpr uint32_t noLayer = 0xFFFFFFFFu;
+
+    MaterialTable() = default;
+    explicit MaterialTable(Config config) : config_(config) {}
+
+    std::shared_ptr<Material> addColored(const Eigen::Vector3f& color) {
+        auto material = std::make_shared<Material>();
+        material->id = static_cast<uint32_t>(materials_.size());
+        material->color = color;
+        materials_.push_back(material);
+        layerOf_.push_back(noLayer);
+        return material;
+    }
+
+    // White, for meshes colored by their vertices
+    std::shared_ptr<Material> addUntextured() {
+        return addColored(Eigen::Vector3f::Ones());
+    }
+
+    /**
+     * Textured material, decoded now and uploaded by upload().
+     * Throws std::runtime_error when an image cannot be decoded.
+     *
+     * Args:
+     * - texturePath: diffuse image
+     * - maskPath: optional alpha-test mask, texels below 0.5 are discarded
+     * - cache: decoded images with their mips from a previous run, nullptr decodes and filters them
+     */
+    std::shared_ptr<Material> addTextured(const std::string& texturePath, const std::string& maskPath = "",
+                                          scene::TextureCache* cache = nullptr) {
+        scene::TextureCache uncached;
+        scene::TextureCache& textures = cache ? *cache : uncached;
+
+        scene::MipChain layer = textures.load(texturePath, 4, config_.layerSize);
+        if (!maskPath.empty()) {
+            layer = withMask(layer, textures.load(maskPath, 1, config_.layerSize));
+        }
+
+        auto material = addColored(Eigen::Vector3f::Ones());
+        material->texturePath = texturePath;
+        material->hasTexture = true;
+        material->maskPath = maskPath;
+        material->hasMask = !maskPath.empty();
+        layerOf_.back() = static_cast<uint32_t>(layers_.size());
+        layers_.push_back(std::move(layer));
+        return material;
+    }
+
+    // Creates the texture array, the parameter buffer and the bind group of all materials
+    void upload(Context* ctx) {
+        uint32_t layerCount = std::max<uint32_t>(static_cast<uint32_t>(layers_.size()), 1);
+        uint32_t size = layers_.empty() ? 1 : config_.layerSize;
+        uint32_t levelCount = scene::MipChain::levelCount(size, size);
+
+        wgpu::TextureDescriptor texDesc{};
+        texDesc.label = "Material texture array";
+        texDesc.size = {size, size, layerCount};
+        texDesc.format = wgpu::TextureFormat::RGBA8Unorm;
+        texDesc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+        texDesc.mipLevelCount = levelCount;
+        textures_ = ctx->device.CreateTexture(&texDesc);
+
+        if (layers_.empty()) {
+            uint32_t white = 0xFFFFFFFF;
+            writeLevel(ctx, 0, 0, {1, 1, reinterpret_cast<const uint8_t*>(&white), 4});
+        }
+        for (uint32_t layer = 0; layer < layers_.size(); ++layer) {
+            for (uint32_t level = 0; level < levelCount; ++level) {
+                writeLevel(ctx, layer, level, layers_[layer].levels[level]);
+            }
+        }
+        layers_.clear();
+
+        wgpu::TextureViewDescriptor viewDesc{};
+        viewDesc.dimension = wgpu::TextureViewDimension::e2DArray;
+        textureView_ = textures_.CreateView(&viewDesc);
+
+        wgpu::SamplerDescriptor samplerDesc{};
+        samplerDesc.addressModeU = wgpu::AddressMode::Repeat;
+        samplerDesc.addressModeV = wgpu::AddressMode::Repeat;
+        samplerDesc.magFilter = wgpu::FilterMode::Linear;
+        samplerDesc.minFilter = wgpu::FilterMode::Linear;
+        samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
+        sampler_ = ctx->device.CreateSampler(&samplerDesc);
+
+        std::vector<Params> params(std::max<size_t>(materials_.size(), 1), Params{{1, 1, 1, 1}, noLayer, 0, {0, 0}});
+        for (size_t i = 0; i < materials_.size(); ++i) {
+            const Material& material = *materials_[i];
+            params[i] = Params{{material.color.x(), material.color.y(), material.color.z(), 1.0f},
+                               layerOf_[i], material.hasMask ? 1u : 0u, {0, 0}};
+        }
+
+        wgpu::BufferDescriptor bufferDesc{};
+        bufferDesc.label = "Material parameter buffer";
+        bufferDesc.size = params.size() * sizeof(Params);
+        bufferDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+        paramsBuffer_ = ctx->device.CreateBuffer(&bufferDesc);
+        ctx->queue.WriteBuffer(paramsBuffer_, 0, params.data(), bufferDesc.size);
+
+        std::array<wgpu::BindGroupEntry, 3> entries{};
+        entries[0].binding = 0;
+        entries[0].textureView = textureView_;
+        entries[1].binding = 1;
+        entries[1].sampler = sampler_;
+        entries[2].binding = 2;
+        entries[2].buffer = paramsBuffer_;
+        entries[2].size = paramsBuffer_.GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.label = "Material table bind group";
+        bindGroupDesc.layout = bindGroupLayout(ctx);
+        bindGroupDesc.entryCount = entries.size();
+        bindGroupDesc.entries = entries.data();
+        bindGroup_ = ctx->device.CreateBindGroup(&bindGroupDesc);
+    }
+
+    // Group 0 of the scene pipelines, shared through the shader registry
+    static wgpu::BindGroupLayout bindGroupLayout(Context* ctx) {
+        return ctx->shaders->bindGroupLayout("material_table", [&] {
+            std::array<wgpu::BindGroupLayoutEntry, 3> layoutEntries{};
+
+            // Binding 0: texture array
+            layoutEntries[0].binding = 0;
+            layoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
+            layoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+            layoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+
+            // Binding 1: sampler
+            layoutEntries[1].binding = 1;
+            layoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
+            layoutEntries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+            // Binding 2: material parameters
+            layoutEntries[2].binding = 2;
+            layoutEntries[2].visibility = wgpu::ShaderStage::Fragment;
+            layoutEntries[2].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+
+            wgpu::BindGroupLayoutDescriptor layoutDesc{};
+            layoutDesc.label = "Material table bind group layout";
+            layoutDesc.entryCount = layoutEntries.size();
+            layoutDesc.entries = layoutEntries.data();
+            return ctx->device.CreateBindGroupLayout(&layoutDesc);
+        });
+    }
+
+    wgpu::BindGroup bindGroup() const { return bindGroup_; }
+    size_t size() const { return materials_.size(); }
+
+private:
+    Config config_;
+    std::vector<std::shared_ptr<Material>> materials_;
+    std::vector<uint32_t> layerOf_;           // per material
+    std::vector<scene::MipChain> layers_;     // until upload
+
+    wgpu::Texture textures_;
+    wgpu::TextureView textureView_;
+    wgpu::Sampler sampler_;
+    wgpu::Buffer paramsBuffer_;
+    wgpu::BindGroup bindGroup_;
+
+    // RGBA chain whose alpha is replaced by the single channel chain mask, same sizes
+    static scene::MipChain withMask(const scene::MipChain& color, const scene::MipChain& mask) {
+        scene::MipChain result;
+        result.channels = 4;
+        size_t total = 0;
+        for (const auto& level : color.levels) {
+            total += level.size;
+        }
+        result.pixels = std::make_shared<std::vector<uint8_t>>(total);
+
+        uint8_t* out = result.pixels->data();
+        for (size_t level = 0; level < color.levels.size(); ++level) {
+            const auto& src = color.levels[level];
+            std::memcpy(out, src.data, src.size);
+            size_t texels = size_t(src.width) * src.height;
+            for (size_t i = 0; i < texels; ++i) {
+                out[i * 4 + 3] = mask.levels[level].data[i];
+            }
+            result.levels.push_back({src.width, src.height, out, src.size});
+            out += src.size;
+        }
+        return result;
+    }
+
+    void writeLevel(Context* ctx, uint32_t layer, uint32_t level, const scene::MipChain::Level& mip) {
+        wgpu::TexelCopyBufferLayout dataLayout{};
+        dataLayout.bytesPerRow = mip.width * 4;
+        dataLayout.rowsPerImage = mip.height;
+
+        wgpu::TexelCopyTextureInfo destination{};
+        destination.texture = textures_;
+        destination.mipLevel = level;
+        destination.origin = {0, 0, layer};
+        wgpu::Extent3D writeSize{mip.width, mip.height, 1};
+        ctx->queue.WriteTexture(&destination, mip.data, mip.size, &dataLayout, &writeSize);
+    }
+};
+
+} // namespace core
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <algorithm>
 #include <cassert>
@@ -8,14 +9,17 @@
 #include "core/context.hpp"
 #include "core/renderer.hpp"
 #include "core/downsampler.hpp"
+#include "core/capture_post_process.hpp"
 #include "scene/scene_object.hpp"
+#include "scene/scene_bvh.hpp"
 #include "scene/camera.hpp"
 #include "core/noise_pass.hpp"
 
 namespace core {
 
 struct CaptureTarget {
-    // High-res (supersample factor applied)
+    // High-res (supersample factor applied). With MSAA the depth texture is the shared
+    // multisampled one and renderTexture only exists as the resolve target when supersampling
     wgpu::Texture renderTexture;
     wgpu::TextureView renderView;
     wgpu::Texture depthTexture;
@@ -25,6 +29,18 @@ struct CaptureTarget {
     wgpu::Texture outputTexture;
     wgpu::TextureView outputView;
 
+    wgpu::BindGroup downsampleBindGroup;  // samples renderTexture
+
+    // Static part of the scene at render resolution (see MultiCameraCapture::setStaticCache),
+    // copied into renderTexture and depthTexture before the moving objects are drawn
+    wgpu::Texture staticColorTexture;
+    wgpu::TextureView staticColorView;
+    wgpu::Texture staticDepthTexture;
+    wgpu::TextureView staticDepthView;
+    bool staticValid = false;
+    Eigen::Matrix4f staticViewProjection;  // of the camera it was rendered from
+    uint64_t staticKey = 0;                // MultiCameraCapture::staticKey of the objects
+
     wgpu::Buffer stagingBuffer;
 
     uint32_t width;          // output width
@@ -35,47 +51,319 @@ struct CaptureTarget {
     uint32_t bufferSize;
 };
 
+// Every camera as one layer of shared texture arrays (see MultiCameraCapture::setLayered)
+struct LayeredCaptureTarget {
+    // High-res, one 2D view per layer to render into. With MSAA every layer view is the shared
+    // multisampled texture, resolved into the layers of renderTexture
+    wgpu::Texture renderTexture;
+    std::vector<wgpu::TextureView> renderLayerViews;
+    wgpu::Texture depthTexture;
+    std::vector<wgpu::TextureView> depthLayerViews;
+    std::vector<wgpu::TextureView> resolveLayerViews;
+
+    // Output resolution, RGBA8 storage textures holding BGRA ordered bytes (see
+    // CapturePostProcess). Frames alternate between the two so that the previous one can be
+    // differenced against; postProcessBindGroups[i] writes outputTextures[i]
+    std::array<wgpu::Texture, 2> outputTextures;
+    std::array<wgpu::BindGroup, 2> postProcessBindGroups;
+    size_t current = 0;         // written by the next post-processing pass
+    bool hasPrevious = false;   // outputTextures[1 - current] holds the previous frame
+    bool differenced = false;   // alpha of the frame being captured is the temporal difference
+
+    // Renderer::renderLayers inputs
+    wgpu::Buffer viewProjectionBuffer;  // one mat4 per camera
+    wgpu::Buffer drawBuffer;            // one Renderer::DrawData per object, grown when the scene grows
+    wgpu::Buffer frameBuffer;           // object count
+    wgpu::BindGroup viewBindGroup;
+    size_t drawCapacity = 0;
+
+    wgpu::Buffer stagingBuffer;         // every layer, one after the other
+    uint32_t layerSize;                 // bytes per layer in stagingBuffer
+    std::vector<cv::Mat> differences;   // of the last readAll, see MultiCameraCapture::differences
+};
+
+// One camera of the ID buffer mode (see MultiCameraCapture::setIdCapture), at output resolution
+struct IdCaptureTarget {
+    wgpu::Texture idTexture;     // Renderer::idFormat
+    wgpu::TextureView idView;
+    wgpu::Texture depthTexture;
+    wgpu::TextureView depthView;
+
+    wgpu::Buffer stagingBuffer;
+    uint32_t paddedBytesPerRow;
+    uint32_t bufferSize;
+
+    cv::Mat ids;                 // CV_32SC1 of the last readAll
+};
+
 class MultiCameraCapture {
 public:
+    /**
+     * Anti-aliasing is supersampling (render at supersample times the output size, then
+     * Downsampler), MSAA (sampleCount = Renderer::msaaSampleCount, resolved at render time) or
+     * both. MSAA alone (supersample = 1) shades each output pixel once instead of
+     * supersample^2 times and, per camera, needs no downsample pass; its multisampled color and
+     * depth textures are shared by all cameras since they are only needed while a camera is
+     * being drawn.
+     */
     MultiCameraCapture(Context* ctx, uint32_t cameraCount,
-                       uint32_t width, uint32_t height, uint32_t supersample = 2)
-        : ctx_(ctx), width_(width), height_(height), supersample_(supersample),
-          downsampler_(ctx, wgpu::TextureFormat::BGRA8Unorm)
+                       uint32_t width, uint32_t height, uint32_t supersample = 2,
+                       uint32_t sampleCount = 1, bool layered = false)
+        : ctx_(ctx), cameraCount_(cameraCount), width_(width), height_(height), supersample_(supersample),
+          sampleCount_(sampleCount), downsampler_(ctx, wgpu::TextureFormat::BGRA8Unorm), postProcess_(ctx)
     {
-        targets_.resize(cameraCount);
-        for (auto& target : targets_) {
-            initializeTarget(target);
+        setCulling(false);  // LODs are picked for this output height once enabled
+        setLayered(layered);
+    }
+
+    // Reallocates the targets for another anti-aliasing mode (see the constructor)
+    void setAntiAliasing(uint32_t supersample, uint32_t sampleCount) {
+        if (supersample == supersample_ && sampleCount == sampleCount_) return;
+
+        supersample_ = supersample;
+        sampleCount_ = sampleCount;
+        targets_.clear();
+        layeredTarget_ = LayeredCaptureTarget{};
+        msaaColorView_ = nullptr;
+        msaaDepthView_ = nullptr;
+        setLayered(layered_);
+    }
+
+    /**
+     * Layered mode renders all cameras into the layers of one texture array: renderAll records a
+     * render pass per layer into a single command encoder, downsampleAll adds one compute dispatch
+     * for all layers (CapturePostProcess: downsample, noise, temporal difference) and copyAll one
+     * CopyTextureToBuffer for all layers before submitting it. Camera and model matrices come
+     * from storage buffers, so there is one queue write and submit per frame instead of one per
+     * camera as in the per-camera mode.
+     *
+     * Needs Renderer::createLayeredPipeline. noiseAll only applies to the per-camera mode, the
+     * layered mode adds noise with setPostProcess. Targets of a mode are allocated the first time
+     * it is used.
+     */
+    void setLayered(bool enabled) {
+        layered_ = enabled;
+        if (sampleCount_ > 1 && !msaaColorView_) {
+            initializeMsaa();
+        }
+        if (layered_ && !layeredTarget_.renderTexture) {
+            initializeLayeredTarget();
+        }
+        if (!layered_ && targets_.empty()) {
+            targets_.resize(cameraCount_);
+            for (auto& target : targets_) {
+                initializeTarget(target);
+            }
         }
     }
 
+    bool layered() const { return layered_; }
+
+    /**
+     * ID buffer mode (Renderer::renderIds): each camera renders, at output resolution and
+     * without anti-aliasing, the ID of the moving object seen by each pixel (0 for static
+     * geometry and background), then readAll differences it against the previous frame on the
+     * CPU. No texture is sampled except static alpha-test masks, and the motion it gives is
+     * exact: a pixel changed exactly when a moving object entered or left it.
+     *
+     * Takes precedence over the layered mode and the anti-aliasing settings while enabled.
+     * Needs Renderer::createIdPipelines.
+     */
+    void setIdCapture(bool enabled) {
+        idCapture_ = enabled;
+        if (idCapture_ && idTargets_.empty()) {
+            idTargets_.resize(cameraCount_);
+            for (auto& target : idTargets_) {
+                initializeIdTarget(target);
+            }
+        }
+        for (auto& target : idTargets_) {
+            target.ids = cv::Mat();  // not differenced against a capture from before the switch
+        }
+        idDifferences_.clear();
+    }
+
+    bool idCapture() const { return idCapture_; }
+
+    /**
+     * Static scene cache of the per-camera mode: each camera keeps a render of the objects that
+     * are not SceneObject::moving, and renderAll only copies it into the camera's targets and
+     * draws the moving objects over it, depth-tested against the static depth. The render of a
+     * camera is redone when its view-projection changes, or for every camera when a static
+     * object is added, removed, moved or given another mesh or material (see staticKey), or
+     * when setCulling changes the LODs.
+     *
+     * Only applies to the per-camera mode without MSAA; the layered and ID buffer modes and
+     * MSAA capture render everything each frame.
+     */
+    void setStaticCache(bool enabled) {
+        staticCache_ = enabled;
+        if (staticCache_) {
+            for (auto& target : targets_) {
+                initializeStaticCache(target);
+            }
+        }
+        invalidateStaticCache();
+    }
+
+    bool staticCache() const { return staticCache_; }
+
+    // Cameras of the last renderAll that reused their static render, and that had to redo it
+    struct StaticCacheStats {
+        size_t reused = 0;
+        size_t rendered = 0;
+    };
+
+    const StaticCacheStats& staticCacheStats() const { return staticCacheStats_; }
+
+    /**
+     * ID buffer mode: IDs (CV_32SC1) of the last readAll per camera, object index + 1 of the
+     * visible moving object or 0. ids == index + 1 is the exact mask of one object.
+     */
+    std::vector<cv::Mat> ids() const {
+        std::vector<cv::Mat> result;
+        for (const auto& target : idTargets_) {
+            result.push_back(target.ids);
+        }
+        return result;
+    }
+
+    // Noise and temporal difference of the layered mode's post-processing pass
+    void setPostProcess(const PostProcessSettings& settings) {
+        postProcessSettings_ = settings;
+    }
+
+    /**
+     * Layered mode with PostProcessSettings::difference: grey level (CV_8UC1) of the absolute
+     * difference between the last two captures of each camera, computed in the post-processing
+     * pass. ID buffer mode: 255 where the ID changed since the previous capture, 0 elsewhere.
+     * Use as CameraFrame{camera, difference, zeros} to skip the CPU differencing of
+     * computeMotionMask. Empty until two frames were captured.
+     */
+    const std::vector<cv::Mat>& differences() const {
+        return idCapture_ ? idDifferences_ : layeredTarget_.differences;
+    }
+
+    /**
+     * Frustum culling and LOD selection (scene::SceneBVH) per camera: renderAll builds the
+     * hierarchy over the objects once and each camera only draws what it sees, with the LOD
+     * whose error stays under maxPixelError output pixels.
+     */
+    void setCulling(bool enabled, float maxPixelError = 1.0f) {
+        culling_ = enabled;
+        scene::SceneBVH::Config config = bvh_.config();
+        config.maxPixelError = maxPixelError;
+        config.viewportHeight = height_;
+        bvh_.setConfig(config);
+        invalidateStaticCache();  // other LODs, and without culling, every object
+    }
+
+    // Draws and indices of the last renderAll, over all cameras, against what drawing every object would cost
+    struct CullingStats {
+        size_t drawnObjects = 0;
+        size_t totalObjects = 0;
+        uint64_t drawnIndices = 0;
+        uint64_t totalIndices = 0;
+    };
+
+    const CullingStats& cullingStats() const { return cullingStats_; }
+
     void renderAll(
         const std::vector<scene::Camera>& cameras,
         const std::vector<scene::SceneObject>& objects,
         Renderer& renderer
     ) {
-        assert(cameras.size() == targets_.size());
+        assert(cameras.size() == cameraCount_);
+
+        if (culling_) {
+            collectDrawLists(cameras, objects);
+        }
+
+        if (idCapture_) {
+            for (size_t i = 0; i < cameras.size(); ++i) {
+                renderer.renderIds(objects, culling_ ? &drawLists_[i] : nullptr, cameras[i],
+                                   idTargets_[i].depthView, idTargets_[i].idView);
+            }
+            return;
+        }
+
+        if (layered_) {
+            renderLayered(cameras, objects, renderer);
+            return;
+        }
+
+        if (staticCache_ && sampleCount_ == 1) {
+            renderWithStaticCache(cameras, objects, renderer);
+            return;
+        }
 
         for (size_t i = 0; i < cameras.size(); ++i) {
+            if (culling_) {
+                bool msaa = sampleCount_ > 1;
+                wgpu::TextureView resolveView = supersample_ > 1 ? targets_[i].renderView : targets_[i].outputView;
+                renderer.renderScene(objects, drawLists_[i], cameras[i],
+                                     msaa ? msaaDepthView_ : targets_[i].depthView,
+                                     msaa ? msaaColorView_ : targets_[i].renderView,
+                                     msaa ? resolveView : nullptr);
+                continue;
+            }
+            if (sampleCount_ > 1) {
+                renderer.renderScene(objects, cameras[i],
+                                    msaaDepthView_,
+                                    msaaColorView_, false,
+                                    supersample_ > 1 ? targets_[i].renderView : targets_[i].outputView);
+                continue;
+            }
             renderer.renderScene(objects, cameras[i],
                                 targets_[i].depthView,
                                 targets_[i].renderView);
         }
     }
 
-    void downsampleAll() {
+    // time and seed drive the noise of the layered mode (see setPostProcess)
+    void downsampleAll(float time = 0.0f, float seed = 0.0f) {
+        if (idCapture_) return;  // rendered at output resolution
+
+        if (layered_) {
+            LayeredCaptureTarget& target = layeredTarget_;
+            PostProcessSettings settings = postProcessSettings_;
+            settings.difference = settings.difference && target.hasPrevious;
+            target.differenced = settings.difference;
+            postProcess_.dispatch(layeredEncoder_, target.postProcessBindGroups[target.current],
+                                  width_, height_, cameraCount_, settings, time, seed);
+            return;
+        }
+
+        if (!downsampled()) return;  // MSAA resolved straight into the output
+
+        // Bind groups were made with the targets, every camera goes in one submit
+        wgpu::CommandEncoder encoder = ctx_->device.CreateCommandEncoder();
         for (auto& target : targets_) {
-            downsampler_.downsample(target.renderView, target.outputView,
+            downsampler_.downsample(encoder, target.downsampleBindGroup, target.outputView,
                                     target.width, target.height);
         }
+        wgpu::CommandBuffer commands = encoder.Finish();
+        ctx_->queue.Submit(1, &commands);
     }
 
     void noiseAll(wgpu::CommandEncoder& enc, NoisePass& noisepass, float time, float seed) {
+        if (layered_ || idCapture_) return;  // the noise pass renders into BGRA8 attachments, see setLayered
+
         for (auto& target : targets_) {
             noisepass.render(enc, target.outputView, target.width, target.height, time, seed);
         }
     }
 
     void copyAll() {
+        if (idCapture_) {
+            copyIds();
+            return;
+        }
+        if (layered_) {
+            copyLayered();
+            return;
+        }
+
         wgpu::CommandEncoder encoder = ctx_->device.CreateCommandEncoder();
 
         for (auto& target : targets_) {
@@ -115,7 +403,18 @@ public:
         }
     }
 
+    /**
+     * BGR capture of each camera. In ID buffer mode, moving objects are white on black and the
+     * IDs and their differences are kept for ids() and differences().
+     */
     std::vector<cv::Mat> readAll() {
+        if (idCapture_) {
+            return readIds();
+        }
+        if (layered_) {
+            return readLayered();
+        }
+
         std::vector<cv::Mat> results;
         results.reserve(targets_.size());
 
@@ -148,18 +447,63 @@ public:
         return results;
     }
 
-    size_t cameraCount() const { return targets_.size(); }
+    size_t cameraCount() const { return cameraCount_; }
     const CaptureTarget& getTarget(size_t index) const { return targets_[index]; }
     uint32_t renderWidth() const { return width_ * supersample_; }
     uint32_t renderHeight() const { return height_ * supersample_; }
+    uint32_t sampleCount() const { return sampleCount_; }
 
 private:
     Context* ctx_;
+    uint32_t cameraCount_;
     std::vector<CaptureTarget> targets_;
     Downsampler downsampler_;
+    bool layered_ = false;
+    LayeredCaptureTarget layeredTarget_;
+    wgpu::CommandEncoder layeredEncoder_;  // from renderAll to copyAll in layered mode
+    CapturePostProcess postProcess_;
+    PostProcessSettings postProcessSettings_;
+
+    bool idCapture_ = false;
+    std::vector<IdCaptureTarget> idTargets_;
+    std::vector<cv::Mat> idDifferences_;
+
+    bool staticCache_ = false;
+    StaticCacheStats staticCacheStats_;
+
+    bool culling_ = false;
+    scene::SceneBVH bvh_;
+    std::vector<std::vector<scene::DrawItem>> drawLists_;  // per camera, when culling
+    CullingStats cullingStats_;
     uint32_t width_;
     uint32_t height_;
     uint32_t supersample_;
+    uint32_t sampleCount_;
+
+    // MSAA attachments at render resolution, shared by every camera
+    wgpu::TextureView msaaColorView_;
+    wgpu::TextureView msaaDepthView_;
+
+    bool downsampled() const {
+        return supersample_ > 1 || sampleCount_ == 1;
+    }
+
+    void initializeMsaa() {
+        wgpu::TextureDescriptor colorDesc{};
+        colorDesc.label = "Capture MSAA color texture";
+        colorDesc.dimension = wgpu::TextureDimension::e2D;
+        colorDesc.size = {width_ * supersample_, height_ * supersample_, 1};
+        colorDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+        colorDesc.mipLevelCount = 1;
+        colorDesc.sampleCount = sampleCount_;
+        colorDesc.usage = wgpu::TextureUsage::RenderAttachment;
+        msaaColorView_ = ctx_->device.CreateTexture(&colorDesc).CreateView();
+
+        wgpu::TextureDescriptor depthDesc = colorDesc;
+        depthDesc.label = "Capture MSAA depth texture";
+        depthDesc.format = wgpu::TextureFormat::Depth24Plus;
+        msaaDepthView_ = ctx_->device.CreateTexture(&depthDesc).CreateView();
+    }
 
     void initializeTarget(CaptureTarget& target) {
         target.width = width_;
@@ -171,30 +515,40 @@ private:
         target.paddedBytesPerRow = (bytesPerRow + 255) & ~255;
         target.bufferSize = target.paddedBytesPerRow * height_;
 
-        // High-res render texture
-        wgpu::TextureDescriptor renderDesc{};
-        renderDesc.label = "Capture render texture (high-res)";
-        renderDesc.dimension = wgpu::TextureDimension::e2D;
-        renderDesc.size = {target.renderWidth, target.renderHeight, 1};
-        renderDesc.format = wgpu::TextureFormat::BGRA8Unorm;
-        renderDesc.mipLevelCount = 1;
-        renderDesc.sampleCount = 1;
-        renderDesc.usage = wgpu::TextureUsage::RenderAttachment |
-                          wgpu::TextureUsage::TextureBinding;  // Changed for sampling
-        target.renderTexture = ctx_->device.CreateTexture(&renderDesc);
-        target.renderView = target.renderTexture.CreateView();
+        // High-res render texture, the MSAA resolve target when supersampling as well
+        if (downsampled()) {
+            wgpu::TextureDescriptor renderDesc{};
+            renderDesc.label = "Capture render texture (high-res)";
+            renderDesc.dimension = wgpu::TextureDimension::e2D;
+            renderDesc.size = {target.renderWidth, target.renderHeight, 1};
+            renderDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+            renderDesc.mipLevelCount = 1;
+            renderDesc.sampleCount = 1;
+            renderDesc.usage = wgpu::TextureUsage::RenderAttachment |
+                              wgpu::TextureUsage::TextureBinding |  // Changed for sampling
+                              wgpu::TextureUsage::CopyDst;          // static cache
+            target.renderTexture = ctx_->device.CreateTexture(&renderDesc);
+            target.renderView = target.renderTexture.CreateView();
+            target.downsampleBindGroup = downsampler_.createBindGroup(target.renderView);
+        }
 
-        // High-res depth texture
-        wgpu::TextureDescriptor depthDesc{};
-        depthDesc.label = "Capture depth texture (high-res)";
-        depthDesc.dimension = wgpu::TextureDimension::e2D;
-        depthDesc.size = {target.renderWidth, target.renderHeight, 1};
-        depthDesc.format = wgpu::TextureFormat::Depth24Plus;
-        depthDesc.mipLevelCount = 1;
-        depthDesc.sampleCount = 1;
-        depthDesc.usage = wgpu::TextureUsage::RenderAttachment;
-        target.depthTexture = ctx_->device.CreateTexture(&depthDesc);
-        target.depthView = target.depthTexture.CreateView();
+        // High-res depth texture, MSAA uses the shared one
+        if (sampleCount_ == 1) {
+            wgpu::TextureDescriptor depthDesc{};
+            depthDesc.label = "Capture depth texture (high-res)";
+            depthDesc.dimension = wgpu::TextureDimension::e2D;
+            depthDesc.size = {target.renderWidth, target.renderHeight, 1};
+            depthDesc.format = wgpu::TextureFormat::Depth24Plus;
+            depthDesc.mipLevelCount = 1;
+            depthDesc.sampleCount = 1;
+            depthDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopyDst;
+            target.depthTexture = ctx_->device.CreateTexture(&depthDesc);
+            target.depthView = target.depthTexture.CreateView();
+        }
+
+        if (staticCache_) {
+            initializeStaticCache(target);
+        }
 
         // Output texture (final resolution)
         wgpu::TextureDescriptor outputDesc{};
@@ -217,19 +571,490 @@ private:
         target.stagingBuffer = ctx_->device.CreateBuffer(&bufferDesc);
     }
 
+    void initializeLayeredTarget() {
+        LayeredCaptureTarget& target = layeredTarget_;
+        uint32_t renderWidth = width_ * supersample_;
+        uint32_t renderHeight = height_ * supersample_;
+
+        uint32_t bytesPerRow = width_ * 4;
+        uint32_t paddedBytesPerRow = (bytesPerRow + 255) & ~255;
+        target.layerSize = paddedBytesPerRow * height_;
+
+        auto layerViews = [this](wgpu::Texture texture) {
+            std::vector<wgpu::TextureView> views(cameraCount_);
+            for (uint32_t layer = 0; layer < cameraCount_; ++layer) {
+                wgpu::TextureViewDescriptor viewDesc{};
+                viewDesc.dimension = wgpu::TextureViewDimension::e2D;
+                viewDesc.baseArrayLayer = layer;
+                viewDesc.arrayLayerCount = 1;
+                views[layer] = texture.CreateView(&viewDesc);
+            }
+            return views;
+        };
+
+        wgpu::TextureViewDescriptor arrayViewDesc{};
+        arrayViewDesc.dimension = wgpu::TextureViewDimension::e2DArray;
+
+        // High-res render texture array, the MSAA resolve target when sampling. Always allocated,
+        // even at output resolution, since the post-processing pass reads it
+        wgpu::TextureDescriptor renderDesc{};
+        renderDesc.label = "Capture render texture array (high-res)";
+        renderDesc.dimension = wgpu::TextureDimension::e2D;
+        renderDesc.size = {renderWidth, renderHeight, cameraCount_};
+        renderDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+        renderDesc.mipLevelCount = 1;
+        renderDesc.sampleCount = 1;
+        renderDesc.usage = wgpu::TextureUsage::RenderAttachment |
+                          wgpu::TextureUsage::TextureBinding;
+        target.renderTexture = ctx_->device.CreateTexture(&renderDesc);
+        target.renderLayerViews = layerViews(target.renderTexture);
+
+        // High-res depth texture array
+        if (sampleCount_ == 1) {
+            wgpu::TextureDescriptor depthDesc{};
+            depthDesc.label = "Capture depth texture array (high-res)";
+            depthDesc.dimension = wgpu::TextureDimension::e2D;
+            depthDesc.size = {renderWidth, renderHeight, cameraCount_};
+            depthDesc.format = wgpu::TextureFormat::Depth24Plus;
+            depthDesc.mipLevelCount = 1;
+            depthDesc.sampleCount = 1;
+            depthDesc.usage = wgpu::TextureUsage::RenderAttachment;
+            target.depthTexture = ctx_->device.CreateTexture(&depthDesc);
+            target.depthLayerViews = layerViews(target.depthTexture);
+        }
+
+        // Output texture arrays (final resolution), written by the post-processing pass in turns
+        wgpu::TextureDescriptor outputDesc{};
+        outputDesc.label = "Capture output texture array";
+        outputDesc.dimension = wgpu::TextureDimension::e2D;
+        outputDesc.size = {width_, height_, cameraCount_};
+        outputDesc.format = wgpu::TextureFormat::RGBA8Unorm;
+        outputDesc.mipLevelCount = 1;
+        outputDesc.sampleCount = 1;
+        outputDesc.usage = wgpu::TextureUsage::StorageBinding |
+                          wgpu::TextureUsage::TextureBinding |
+                          wgpu::TextureUsage::CopySrc;
+        for (auto& output : target.outputTextures) {
+            output = ctx_->device.CreateTexture(&outputDesc);
+        }
+
+        wgpu::TextureView renderArrayView = target.renderTexture.CreateView(&arrayViewDesc);
+        for (size_t i = 0; i < target.outputTextures.size(); ++i) {
+            target.postProcessBindGroups[i] = postProcess_.createBindGroup(
+                renderArrayView,
+                target.outputTextures[i].CreateView(&arrayViewDesc),
+                target.outputTextures[1 - i].CreateView(&arrayViewDesc));
+        }
+        target.current = 0;
+        target.hasPrevious = false;
+        target.differences.clear();
+
+        // Multisampled textures cannot have layers, the shared pair is drawn into for every layer
+        if (sampleCount_ > 1) {
+            target.resolveLayerViews = target.renderLayerViews;
+            target.renderLayerViews.assign(cameraCount_, msaaColorView_);
+            target.depthLayerViews.assign(cameraCount_, msaaDepthView_);
+        }
+
+        wgpu::BufferDescriptor viewDesc{};
+        viewDesc.label = "Capture view-projection buffer";
+        viewDesc.size = sizeof(float) * 16 * cameraCount_;
+        viewDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+        target.viewProjectionBuffer = ctx_->device.CreateBuffer(&viewDesc);
+
+        wgpu::BufferDescriptor frameDesc{};
+        frameDesc.label = "Capture frame uniform buffer";
+        frameDesc.size = 16;  // u32 padded to the uniform struct alignment
+        frameDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+        target.frameBuffer = ctx_->device.CreateBuffer(&frameDesc);
+
+        // Staging buffer (output resolution, all layers)
+        wgpu::BufferDescriptor bufferDesc{};
+        bufferDesc.label = "Capture staging buffer (all layers)";
+        bufferDesc.size = uint64_t(target.layerSize) * cameraCount_;
+        bufferDesc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
+        target.stagingBuffer = ctx_->device.CreateBuffer(&bufferDesc);
+    }
+
+    // Static color and depth of one camera, with the format and size of its render targets
+    void initializeStaticCache(CaptureTarget& target) {
+        if (sampleCount_ > 1 || target.staticColorTexture) return;
+
+        wgpu::TextureDescriptor colorDesc{};
+        colorDesc.label = "Capture static color texture (high-res)";
+        colorDesc.dimension = wgpu::TextureDimension::e2D;
+        colorDesc.size = {target.renderWidth, target.renderHeight, 1};
+        colorDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+        colorDesc.mipLevelCount = 1;
+        colorDesc.sampleCount = 1;
+        colorDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+        target.staticColorTexture = ctx_->device.CreateTexture(&colorDesc);
+        target.staticColorView = target.staticColorTexture.CreateView();
+
+        wgpu::TextureDescriptor depthDesc = colorDesc;
+        depthDesc.label = "Capture static depth texture (high-res)";
+        depthDesc.format = wgpu::TextureFormat::Depth24Plus;
+        target.staticDepthTexture = ctx_->device.CreateTexture(&depthDesc);
+        target.staticDepthView = target.staticDepthTexture.CreateView();
+        target.staticValid = false;
+    }
+
+    void invalidateStaticCache() {
+        for (auto& target : targets_) {
+            target.staticValid = false;
+        }
+    }
+
+    /**
+     * Identifies the static objects: their meshes, materials and model matrices, in order.
+     * FNV-1a, so that comparing it costs one pass over the objects instead of a copy of them.
+     */
+    static uint64_t staticKey(const std::vector<scene::SceneObject>& objects) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto mix = [&hash](const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+        };
+        for (const auto& obj : objects) {
+            if (obj.moving) continue;
+            const scene::Mesh* mesh = obj.mesh.get();
+            Eigen::Matrix4f model = obj.transform.getMatrix();
+            mix(&mesh, sizeof(mesh));
+            mix(&obj.material->id, sizeof(obj.material->id));
+            mix(model.data(), sizeof(float) * 16);
+        }
+        return hash;
+    }
+
+    /**
+     * renderAll of the per-camera mode with the static cache: stale static renders are redone
+     * first, then one submit restores every camera's targets from them and the moving objects
+     * are drawn over.
+     */
+    void renderWithStaticCache(
+        const std::vector<scene::Camera>& cameras,
+        const std::vector<scene::SceneObject>& objects,
+        Renderer& renderer
+    ) {
+        uint64_t key = staticKey(objects);
+        staticCacheStats_ = StaticCacheStats{};
+        std::vector<std::vector<scene::DrawItem>> movingLists(cameras.size());
+
+        wgpu::CommandEncoder encoder = ctx_->device.CreateCommandEncoder();
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            CaptureTarget& target = targets_[i];
+            Eigen::Matrix4f viewProjection = cameras[i].getViewProjectionMatrix();
+            bool valid = target.staticValid && target.staticKey == key && target.staticViewProjection == viewProjection;
+
+            std::vector<scene::DrawItem> staticList;
+            auto add = [&](const scene::DrawItem& item) {
+                if (objects[item.object].moving) {
+                    movingLists[i].push_back(item);
+                } else if (!valid) {
+                    staticList.push_back(item);
+                }
+            };
+            if (culling_) {
+                for (const auto& item : drawLists_[i]) {
+                    add(item);
+                }
+            } else {
+                for (size_t k = 0; k < objects.size(); ++k) {
+                    add({static_cast<uint32_t>(k), objects[k].mesh.get()});
+                }
+            }
+
+            if (valid) {
+                staticCacheStats_.reused++;
+            } else {
+                renderer.renderScene(objects, staticList, cameras[i], target.staticDepthView, target.staticColorView);
+                target.staticValid = true;
+                target.staticKey = key;
+                target.staticViewProjection = viewProjection;
+                staticCacheStats_.rendered++;
+            }
+
+            wgpu::Extent3D size = {target.renderWidth, target.renderHeight, 1};
+            wgpu::TexelCopyTextureInfo source{};
+            wgpu::TexelCopyTextureInfo destination{};
+            source.texture = target.staticColorTexture;
+            destination.texture = target.renderTexture;
+            encoder.CopyTextureToTexture(&source, &destination, &size);
+            source.texture = target.staticDepthTexture;
+            destination.texture = target.depthTexture;
+            encoder.CopyTextureToTexture(&source, &destination, &size);
+        }
+        wgpu::CommandBuffer commands = encoder.Finish();
+        ctx_->queue.Submit(1, &commands);
+
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            renderer.renderOver(objects, movingLists[i], cameras[i], targets_[i].depthView, targets_[i].renderView);
+        }
+    }
+
+    void initializeIdTarget(IdCaptureTarget& target) {
+        uint32_t bytesPerRow = width_ * 4;
+        target.paddedBytesPerRow = (bytesPerRow + 255) & ~255;
+        target.bufferSize = target.paddedBytesPerRow * height_;
+
+        wgpu::TextureDescriptor idDesc{};
+        idDesc.label = "Capture ID texture";
+        idDesc.dimension = wgpu::TextureDimension::e2D;
+        idDesc.size = {width_, height_, 1};
+        idDesc.format = Renderer::idFormat;
+        idDesc.mipLevelCount = 1;
+        idDesc.sampleCount = 1;
+        idDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+        target.idTexture = ctx_->device.CreateTexture(&idDesc);
+        target.idView = target.idTexture.CreateView();
+
+        wgpu::TextureDescriptor depthDesc = idDesc;
+        depthDesc.label = "Capture ID depth texture";
+        depthDesc.format = wgpu::TextureFormat::Depth24Plus;
+        depthDesc.usage = wgpu::TextureUsage::RenderAttachment;
+        target.depthTexture = ctx_->device.CreateTexture(&depthDesc);
+        target.depthView = target.depthTexture.CreateView();
+
+        wgpu::BufferDescriptor bufferDesc{};
+        bufferDesc.label = "Capture ID staging buffer";
+        bufferDesc.size = target.bufferSize;
+        bufferDesc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
+        target.stagingBuffer = ctx_->device.CreateBuffer(&bufferDesc);
+        target.ids = cv::Mat();
+    }
+
+    // Draw storage for at least objectCount objects, the bind group follows the buffer
+    void reserveDraws(size_t objectCount, Renderer& renderer) {
+        LayeredCaptureTarget& target = layeredTarget_;
+        if (objectCount <= target.drawCapacity && target.viewBindGroup) return;
+
+        target.drawCapacity = std::max<size_t>({objectCount, target.drawCapacity * 2, 64});
+
+        wgpu::BufferDescriptor drawDesc{};
+        drawDesc.label = "Capture draw buffer";
+        drawDesc.size = sizeof(Renderer::DrawData) * target.drawCapacity;
+        drawDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+        target.drawBuffer = ctx_->device.CreateBuffer(&drawDesc);
+
+        std::array<wgpu::BindGroupEntry, 3> entries{};
+        entries[0].binding = 0;
+        entries[0].buffer = target.viewProjectionBuffer;
+        entries[0].size = target.viewProjectionBuffer.GetSize();
+        entries[1].binding = 1;
+        entries[1].buffer = target.drawBuffer;
+        entries[1].size = target.drawBuffer.GetSize();
+        entries[2].binding = 2;
+        entries[2].buffer = target.frameBuffer;
+        entries[2].size = target.frameBuffer.GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.label = "Capture multi-view bind group";
+        bindGroupDesc.layout = renderer.viewBindGroupLayout;
+        bindGroupDesc.entryCount = entries.size();
+        bindGroupDesc.entries = entries.data();
+        target.viewBindGroup = ctx_->device.CreateBindGroup(&bindGroupDesc);
+    }
+
+    void renderLayered(
+        const std::vector<scene::Camera>& cameras,
+        const std::vector<scene::SceneObject>& objects,
+        Renderer& renderer
+    ) {
+        LayeredCaptureTarget& target = layeredTarget_;
+        reserveDraws(objects.size(), renderer);
+
+        std::vector<Eigen::Matrix4f> viewProjections;
+        viewProjections.reserve(cameras.size());
+        for (const auto& camera : cameras) {
+            viewProjections.push_back(camera.getViewProjectionMatrix());
+        }
+
+        std::vector<Renderer::DrawData> draws(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            draws[i].model = objects[i].transform.getMatrix();
+            draws[i].material = objects[i].material->id;
+        }
+
+        std::array<uint32_t, 4> frame = {static_cast<uint32_t>(objects.size()), 0, 0, 0};
+
+        ctx_->queue.WriteBuffer(target.viewProjectionBuffer, 0, viewProjections.data(),
+                                viewProjections.size() * sizeof(Eigen::Matrix4f));
+        ctx_->queue.WriteBuffer(target.drawBuffer, 0, draws.data(), draws.size() * sizeof(Renderer::DrawData));
+        ctx_->queue.WriteBuffer(target.frameBuffer, 0, frame.data(), sizeof(frame));
+
+        layeredEncoder_ = ctx_->device.CreateCommandEncoder();
+        renderer.renderLayers(layeredEncoder_, objects, target.renderLayerViews,
+                              target.depthLayerViews, target.viewBindGroup, target.resolveLayerViews,
+                              culling_ ? &drawLists_ : nullptr);
+    }
+
+    void collectDrawLists(const std::vector<scene::Camera>& cameras,
+                          const std::vector<scene::SceneObject>& objects) {
+        bvh_.build(objects);
+        drawLists_.resize(cameras.size());
+
+        uint64_t sceneIndices = 0;
+        for (const auto& obj : objects) {
+            sceneIndices += obj.mesh->indexCount;
+        }
+
+        cullingStats_ = CullingStats{};
+        cullingStats_.totalObjects = objects.size() * cameras.size();
+        cullingStats_.totalIndices = sceneIndices * cameras.size();
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            bvh_.collect(cameras[i], objects, drawLists_[i]);
+            cullingStats_.drawnObjects += drawLists_[i].size();
+            for (const auto& item : drawLists_[i]) {
+                cullingStats_.drawnIndices += item.mesh->indexCount;
+            }
+        }
+    }
+
+    void copyLayered() {
+        LayeredCaptureTarget& target = layeredTarget_;
+
+        wgpu::TexelCopyTextureInfo source{};
+        source.texture = target.outputTextures[target.current];
+        source.mipLevel = 0;
+        source.origin = {0, 0, 0};
+        source.aspect = wgpu::TextureAspect::All;
+
+        wgpu::TexelCopyBufferLayout layout{};
+        layout.offset = 0;
+        layout.bytesPerRow = target.layerSize / height_;
+        layout.rowsPerImage = height_;
+
+        wgpu::TexelCopyBufferInfo destination{};
+        destination.buffer = target.stagingBuffer;
+        destination.layout = layout;
+
+        wgpu::Extent3D copySize = {width_, height_, cameraCount_};
+        layeredEncoder_.CopyTextureToBuffer(&source, &destination, &copySize);
+
+        wgpu::CommandBuffer commands = layeredEncoder_.Finish();
+        ctx_->queue.Submit(1, &commands);
+        layeredEncoder_ = nullptr;
+
+        target.current = 1 - target.current;
+        target.hasPrevious = true;
+    }
+
+    void copyIds() {
+        wgpu::CommandEncoder encoder = ctx_->device.CreateCommandEncoder();
+        for (auto& target : idTargets_) {
+            wgpu::TexelCopyTextureInfo source{};
+            source.texture = target.idTexture;
+            source.aspect = wgpu::TextureAspect::All;
+
+            wgpu::TexelCopyBufferInfo destination{};
+            destination.buffer = target.stagingBuffer;
+            destination.layout.bytesPerRow = target.paddedBytesPerRow;
+            destination.layout.rowsPerImage = height_;
+
+            wgpu::Extent3D copySize = {width_, height_, 1};
+            encoder.CopyTextureToBuffer(&source, &destination, &copySize);
+        }
+        wgpu::CommandBuffer commands = encoder.Finish();
+        ctx_->queue.Submit(1, &commands);
+    }
+
+    std::vector<cv::Mat> readIds() {
+        std::vector<bool> mapped(idTargets_.size(), false);
+        for (size_t i = 0; i < idTargets_.size(); ++i) {
+            idTargets_[i].stagingBuffer.MapAsync(
+                wgpu::MapMode::Read, 0, idTargets_[i].bufferSize, wgpu::CallbackMode::AllowProcessEvents,
+                [&mapped, i](wgpu::MapAsyncStatus status, wgpu::StringView) {
+                    mapped[i] = (status == wgpu::MapAsyncStatus::Success);
+                });
+        }
+        while (!std::all_of(mapped.begin(), mapped.end(), [](bool b) { return b; })) {
+            ctx_->instance.ProcessEvents();
+        }
+
+        bool hasPrevious = std::all_of(idTargets_.begin(), idTargets_.end(),
+                                       [](const IdCaptureTarget& target) { return !target.ids.empty(); });
+        std::vector<cv::Mat> results;
+        results.reserve(idTargets_.size());
+        idDifferences_.clear();
+        for (auto& target : idTargets_) {
+            const uint8_t* data = static_cast<const uint8_t*>(
+                target.stagingBuffer.GetConstMappedRange(0, target.bufferSize));
+            cv::Mat ids = cv::Mat(height_, width_, CV_32SC1, const_cast<uint8_t*>(data),
+                                  target.paddedBytesPerRow).clone();
+            target.stagingBuffer.Unmap();
+
+            if (hasPrevious) {
+                cv::Mat changed;
+                cv::compare(ids, target.ids, changed, cv::CMP_NE);
+                idDifferences_.push_back(changed);
+            }
+            target.ids = ids;
+
+            cv::Mat moving, bgr;
+            cv::compare(ids, cv::Scalar(Renderer::noId), moving, cv::CMP_NE);
+            cv::cvtColor(moving, bgr, cv::COLOR_GRAY2BGR);
+            results.push_back(bgr);
+        }
+        return results;
+    }
+
+    std::vector<cv::Mat> readLayered() {
+        LayeredCaptureTarget& target = layeredTarget_;
+        uint64_t size = uint64_t(target.layerSize) * cameraCount_;
+
+        bool mapped = false;
+        target.stagingBuffer.MapAsync(
+            wgpu::MapMode::Read,
+            0,
+            size,
+            wgpu::CallbackMode::AllowProcessEvents,
+            [&mapped](wgpu::MapAsyncStatus status, wgpu::StringView) {
+                mapped = (status == wgpu::MapAsyncStatus::Success);
+            }
+        );
+        while (!mapped) {
+            ctx_->instance.ProcessEvents();
+        }
+
+        const uint8_t* data = static_cast<const uint8_t*>(target.stagingBuffer.GetConstMappedRange(0, size));
+        uint32_t bytesPerRow = target.layerSize / height_;
+        std::vector<cv::Mat> results;
+        results.reserve(cameraCount_);
+        target.differences.clear();
+        for (uint32_t layer = 0; layer < cameraCount_; ++layer) {
+            const uint8_t* layerData = data + uint64_t(layer) * target.layerSize;
+            results.push_back(toImage(layerData, bytesPerRow));
+            if (target.differenced) {
+                cv::Mat bgra(height_, width_, CV_8UC4, const_cast<uint8_t*>(layerData), bytesPerRow);
+                cv::Mat difference;
+                cv::extractChannel(bgra, difference, 3);
+                target.differences.push_back(difference);
+            }
+        }
+        target.stagingBuffer.Unmap();
+        return results;
+    }
+
     cv::Mat readTarget(CaptureTarget& target) {
         const uint8_t* data = static_cast<const uint8_t*>(
             target.stagingBuffer.GetConstMappedRange(0, target.bufferSize));
 
-        cv::Mat image(target.height, target.width, CV_8UC4);
-        uint32_t bytesPerRow = target.width * 4;
+        cv::Mat bgr = toImage(data, target.paddedBytesPerRow);
+        target.stagingBuffer.Unmap();
+        return bgr;
+    }
+
+    // BGRA rows of width_ pixels, paddedBytesPerRow apart, to a BGR image
+    cv::Mat toImage(const uint8_t* data, uint32_t paddedBytesPerRow) {
+        cv::Mat image(height_, width_, CV_8UC4);
+        uint32_t bytesPerRow = width_ * 4;
 
-        for (uint32_t y = 0; y < target.height; ++y) {
-            memcpy(image.ptr(y), data + y * target.paddedBytesPerRow, bytesPerRow);
+        for (uint32_t y = 0; y < height_; ++y) {
+            memcpy(image.ptr(y), data + y * paddedBytesPerRow, bytesPerRow);
         }
 
-        target.stagingBuffer.Unmap();
-
         cv::Mat bgr;
         cv::cvtColor(image, bgr, cv::COLOR_BGRA2BGR);
         return bgr;
@@ -1,41 +1,22 @@
 #include "core/noise_pass.hpp"
 
-std::string NoisePass::readFile(const std::string& path) {
-    std::ifstream f(path);
-    if (!f.is_open()) {
-        throw std::runtime_error("Cannot open file: " + path);
-    }
-    std::stringstream ss;
-    ss << f.rdbuf();
-    return ss.str();
-}
-
-void NoisePass::init(wgpu::Device dev, wgpu::Queue q, wgpu::TextureFormat colorFmt, wgpu::TextureFormat depthFormat) {
-    std::string shaderCode = readFile(SHADERS_DIR "/noise_pass.wgsl");
-    wgpu::ShaderSourceWGSL wgsl{};
-    wgsl.code = shaderCode.c_str();
-    wgpu::ShaderModuleDescriptor shaderDesc{};
-    shaderDesc.nextInChain = &wgsl;
-    wgpu::ShaderModule shaderModule = dev.CreateShaderModule(&shaderDesc);
-
+void NoisePass::init(wgpu::Device dev, wgpu::Queue q, core::ShaderRegistry& shaders,
+                     wgpu::TextureFormat colorFmt, wgpu::TextureFormat depthFormat) {
     device = dev;
     queue = q;
 
-    wgpu::BindGroupLayoutEntry e{};
-    e.binding = 0;
-    e.visibility = wgpu::ShaderStage::Fragment;
-    e.buffer.type = wgpu::BufferBindingType::Uniform;
-    e.buffer.minBindingSize = sizeof(ParamsCPU);
-
-    wgpu::BindGroupLayoutDescriptor bglDesc{};
-    bglDesc.entryCount = 1;
-    bglDesc.entries = &e;
-    bgl = device.CreateBindGroupLayout(&bglDesc);
+    bgl = shaders.bindGroupLayout("noise_pass", [&] {
+        wgpu::BindGroupLayoutEntry e{};
+        e.binding = 0;
+        e.visibility = wgpu::ShaderStage::Fragment;
+        e.buffer.type = wgpu::BufferBindingType::Uniform;
+        e.buffer.minBindingSize = sizeof(ParamsCPU);
 
-    wgpu::PipelineLayoutDescriptor plDesc{};
-    plDesc.bindGroupLayoutCount = 1;
-    plDesc.bindGroupLayouts = &bgl;
-    auto pl = device.CreatePipelineLayout(&plDesc);
+        wgpu::BindGroupLayoutDescriptor bglDesc{};
+        bglDesc.entryCount = 1;
+        bglDesc.entries = &e;
+        return device.CreateBindGroupLayout(&bglDesc);
+    });
 
     wgpu::BufferDescriptor bd{};
     bd.size = sizeof(ParamsCPU);
@@ -54,32 +35,44 @@ void NoisePass::init(wgpu::Device dev, wgpu::Queue q, wgpu::TextureFormat colorF
     bgDesc.entries = &bge;
     bg = device.CreateBindGroup(&bgDesc);
 
-    wgpu::BlendState blend{};
-    blend.color.srcFactor = wgpu::BlendFactor::SrcAlpha;
-    blend.color.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
-    blend.color.operation = wgpu::BlendOperation::Add;
-    blend.alpha.srcFactor = wgpu::BlendFactor::Zero;
-    blend.alpha.dstFactor = wgpu::BlendFactor::One;
-    blend.alpha.operation = wgpu::BlendOperation::Add;
-
-    wgpu::ColorTargetState cts{};
-    cts.format = colorFmt;
-    cts.blend = &blend;
-
-    wgpu::FragmentState fs{};
-    fs.module = shaderModule;
-    fs.entryPoint = "fs_main";
-    fs.targetCount = 1;
-    fs.targets = &cts;
-
-    wgpu::RenderPipelineDescriptor rp{};
-    rp.layout = pl;
-    rp.vertex.module = shaderModule;
-    rp.vertex.entryPoint = "vs_main";
-    rp.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
-    rp.fragment = &fs;
-
-    pipeline = device.CreateRenderPipeline(&rp);
+    // One pipeline per target format: shader, entry point, format, sample count, write mask
+    std::string key = "noise_pass/fs_main/" + std::to_string(static_cast<uint32_t>(colorFmt)) + "/1/"
+                    + std::to_string(static_cast<uint32_t>(wgpu::ColorWriteMask::All));
+    pipeline = shaders.renderPipeline(key, [&] {
+        wgpu::ShaderModule shaderModule = shaders.module("noise_pass.wgsl");
+
+        wgpu::PipelineLayoutDescriptor plDesc{};
+        plDesc.bindGroupLayoutCount = 1;
+        plDesc.bindGroupLayouts = &bgl;
+        auto pl = device.CreatePipelineLayout(&plDesc);
+
+        wgpu::BlendState blend{};
+        blend.color.srcFactor = wgpu::BlendFactor::SrcAlpha;
+        blend.color.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+        blend.color.operation = wgpu::BlendOperation::Add;
+        blend.alpha.srcFactor = wgpu::BlendFactor::Zero;
+        blend.alpha.dstFactor = wgpu::BlendFactor::One;
+        blend.alpha.operation = wgpu::BlendOperation::Add;
+
+        wgpu::ColorTargetState cts{};
+        cts.format = colorFmt;
+        cts.blend = &blend;
+
+        wgpu::FragmentState fs{};
+        fs.module = shaderModule;
+        fs.entryPoint = "fs_main";
+        fs.targetCount = 1;
+        fs.targets = &cts;
+
+        wgpu::RenderPipelineDescriptor rp{};
+        rp.layout = pl;
+        rp.vertex.module = shaderModule;
+        rp.vertex.entryPoint = "vs_main";
+        rp.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+        rp.fragment = &fs;
+
+        return device.CreateRenderPipeline(&rp);
+    });
 }
 
 void NoisePass::render(wgpu::CommandEncoder enc, wgpu::TextureView outView, uint32_t w, uint32_t h, float time, float seed) {
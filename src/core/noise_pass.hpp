@@ -4,10 +4,8 @@
 #include <webgpu/webgpu_cpp.h>
 #include <cstdint>
 #include <cstring>
-#include <sstream>
-#include <fstream>
-#include <stdexcept>
 #include <string>
+#include "core/shader_registry.hpp"
 
 struct ParamsCPU {
     float resolution[2];
@@ -23,7 +21,7 @@ struct NoisePass {
     wgpu::BindGroup bg;
     wgpu::Buffer paramsBuf;
 
-    std::string readFile(const std::string& path);
-    void init(wgpu::Device dev, wgpu::Queue q, wgpu::TextureFormat colorFmt, wgpu::TextureFormat depthFormat);
+    void init(wgpu::Device dev, wgpu::Queue q, core::ShaderRegistry& shaders,
+              wgpu::TextureFormat colorFmt, wgpu::TextureFormat depthFormat);
     void render(wgpu::CommandEncoder enc, wgpu::TextureView outView, uint32_t w, uint32_t h, float time, float seed);
 };
@@ -1,11 +1,14 @@
 #pragma once
 
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <numeric>
 #include <vector>
 #include <dawn/webgpu_cpp.h>
 #include <opencv2/opencv.hpp>
 #include "scene/scene_object.hpp"
+#include "scene/scene_bvh.hpp"
 #include "scene/camera.hpp"
 
 #include "imgui.h"
@@ -13,6 +16,7 @@
 #include "imgui_impl_wgpu.h"
 
 #include "core/context.hpp"
+#include "core/material_table.hpp"
 
 namespace core {
 
@@ -26,12 +30,42 @@ public:
     wgpu::TextureView targetTextureView;
     wgpu::TextureFormat format = wgpu::TextureFormat::BGRA8Unorm;
 
+    // Model matrix and material of one draw, indexed by the instance index in the shaders
+    struct DrawData {
+        Eigen::Matrix4f model;
+        uint32_t material;  // Material::id
+        uint32_t id;        // written by renderIds: object index + 1 when moving, else noId
+        uint32_t padding[2];
+    };
+    static_assert(sizeof(DrawData) == 80, "matches the WGSL layout of Draw");
+
+    // Group 0 of every pipeline: all materials (see MaterialTable, setMaterialTable)
+    wgpu::BindGroup materialBindGroup;
+
+    // renderScene path: group 1 holds the view-projection and the draws of the scene
     wgpu::RenderPipeline pipeline;
-    wgpu::BindGroupLayout bindGroupLayout;
+    wgpu::BindGroupLayout sceneBindGroupLayout;
 
-    // Uniform buffer for MVP matrix
+    // Uniform buffer for the view-projection matrix
     wgpu::Buffer uniformBuffer;
 
+    // Multi-view path (see renderLayers): group 1 holds the per-camera view-projection and the
+    // per-object draws
+    wgpu::RenderPipeline layeredPipeline;
+    wgpu::BindGroupLayout viewBindGroupLayout;
+
+    // Same pipelines for multisampled targets, used when a resolve target is given
+    static constexpr uint32_t msaaSampleCount = 4;
+    wgpu::RenderPipeline msaaPipeline;
+    wgpu::RenderPipeline layeredMsaaPipeline;
+
+    // ID buffer path (see renderIds): group 1 is the one of renderScene
+    static constexpr wgpu::TextureFormat idFormat = wgpu::TextureFormat::R32Uint;
+    static constexpr uint32_t noId = 0;  // static geometry and background
+    wgpu::RenderPipeline idDepthPipeline;        // static opaque objects, depth only
+    wgpu::RenderPipeline idDepthMaskedPipeline;  // static alpha-tested objects, depth only
+    wgpu::RenderPipeline idPipeline;             // moving objects, depth and ID
+
     bool wireframeMode = false;
 
     Renderer(Context* ctx, uint32_t width, uint32_t height)
@@ -66,114 +100,148 @@ public:
         ctx->queue.WriteBuffer(uniformBuffer, 0, data, size);
     }
 
-    void createPipeline(const std::string& shaderPath) {
-        // Load shader
-        std::string shaderCode = readFile(shaderPath);
-        wgpu::ShaderSourceWGSL wgsl{};
-        wgsl.code = shaderCode.c_str();
-        wgpu::ShaderModuleDescriptor shaderDesc{};
-        shaderDesc.nextInChain = &wgsl;
-        wgpu::ShaderModule shaderModule = ctx->device.CreateShaderModule(&shaderDesc);
-
-
-        std::array<wgpu::BindGroupLayoutEntry, 4> layoutEntries{};
-
-        // Binding 0: MVP uniform
-        layoutEntries[0].binding = 0;
-        layoutEntries[0].visibility = wgpu::ShaderStage::Vertex;
-        layoutEntries[0].buffer.type = wgpu::BufferBindingType::Uniform;
-
-        // Binding 1: Texture
-        layoutEntries[1].binding = 1;
-        layoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
-        layoutEntries[1].texture.sampleType = wgpu::TextureSampleType::Float;
-        layoutEntries[1].texture.viewDimension = wgpu::TextureViewDimension::e2D;
-
-        // Binding 2: Sampler
-        layoutEntries[2].binding = 2;
-        layoutEntries[2].visibility = wgpu::ShaderStage::Fragment;
-        layoutEntries[2].sampler.type = wgpu::SamplerBindingType::Filtering;
-
-        // Binding 3: Mask texture (NEW)
-        layoutEntries[3].binding = 3;
-        layoutEntries[3].visibility = wgpu::ShaderStage::Fragment;
-        layoutEntries[3].texture.sampleType = wgpu::TextureSampleType::Float;
-        layoutEntries[3].texture.viewDimension = wgpu::TextureViewDimension::e2D;
-
-        wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc{};
-        bindGroupLayoutDesc.label = "Uniform + Texture bind group layout";
-        bindGroupLayoutDesc.entryCount = layoutEntries.size();
-        bindGroupLayoutDesc.entries = layoutEntries.data();
-        bindGroupLayout = ctx->device.CreateBindGroupLayout(&bindGroupLayoutDesc);
-
-        // Pipeline layout
-        wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
-        pipelineLayoutDesc.label = "Pipeline layout";
-        pipelineLayoutDesc.bindGroupLayoutCount = 1;
-        pipelineLayoutDesc.bindGroupLayouts = &bindGroupLayout;
-        auto pipelineLayout = ctx->device.CreatePipelineLayout(&pipelineLayoutDesc);
-
-        // Vertex attributes: position (vec3f) + color (vec3f)
-        std::array<wgpu::VertexAttribute, 3> attributes{};  // Changed from 2 to 3
-        attributes[0].format = wgpu::VertexFormat::Float32x3;
-        attributes[0].offset = 0;
-        attributes[0].shaderLocation = 0; // position
-
-        attributes[1].format = wgpu::VertexFormat::Float32x3;
-        attributes[1].offset = 3 * sizeof(float);
-        attributes[1].shaderLocation = 1; // color
-
-        attributes[2].format = wgpu::VertexFormat::Float32x2;  // NEW: UV is 2 floats
-        attributes[2].offset = 6 * sizeof(float);              // NEW: after pos + color
-        attributes[2].shaderLocation = 2;                      // NEW: location 2
-
-        wgpu::VertexBufferLayout vertexBufferLayout{};
-        vertexBufferLayout.arrayStride = 8 * sizeof(float); // pos + color + uv (was 6)
-        vertexBufferLayout.stepMode = wgpu::VertexStepMode::Vertex;
-        vertexBufferLayout.attributeCount = attributes.size();
-        vertexBufferLayout.attributes = attributes.data();
-
-        // Vertex state
-        wgpu::VertexState vertexState{};
-        vertexState.module = shaderModule;
-        vertexState.entryPoint = "vertexMain";
-        vertexState.bufferCount = 1;
-        vertexState.buffers = &vertexBufferLayout;
+    // Materials drawn from now on, after MaterialTable::upload
+    void setMaterialTable(const MaterialTable& table) {
+        materialBindGroup = table.bindGroup();
+    }
 
-        // Fragment state
-        wgpu::ColorTargetState colorTarget{};
-        colorTarget.format = format;
+    void createPipeline(const std::string& shaderPath) {
+        sceneBindGroupLayout = ctx->shaders->bindGroupLayout("scene", [&] {
+            std::array<wgpu::BindGroupLayoutEntry, 2> layoutEntries{};
+
+            // Binding 0: view-projection uniform
+            layoutEntries[0].binding = 0;
+            layoutEntries[0].visibility = wgpu::ShaderStage::Vertex;
+            layoutEntries[0].buffer.type = wgpu::BufferBindingType::Uniform;
+
+            // Binding 1: draws
+            layoutEntries[1].binding = 1;
+            layoutEntries[1].visibility = wgpu::ShaderStage::Vertex;
+            layoutEntries[1].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+
+            wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+            bindGroupLayoutDesc.label = "Scene bind group layout";
+            bindGroupLayoutDesc.entryCount = layoutEntries.size();
+            bindGroupLayoutDesc.entries = layoutEntries.data();
+            return ctx->device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+        });
+
+        wgpu::BindGroupLayout materialLayout = MaterialTable::bindGroupLayout(ctx);
+        pipeline = buildPipeline(shaderPath, {materialLayout, sceneBindGroupLayout}, "Render pipeline");
+        msaaPipeline = buildPipeline(shaderPath, {materialLayout, sceneBindGroupLayout}, "MSAA render pipeline",
+                                     msaaSampleCount);
+    }
 
-        wgpu::FragmentState fragmentState{};
-        fragmentState.module = shaderModule;
-        fragmentState.entryPoint = "fragmentMain";
-        fragmentState.targetCount = 1;
-        fragmentState.targets = &colorTarget;
+    /**
+     * Pipeline of renderLayers. The shader reads the view-projection of the layer and the draw
+     * of the object (DrawData) from group 1, indexed by the instance index.
+     */
+    void createLayeredPipeline(const std::string& shaderPath) {
+        viewBindGroupLayout = ctx->shaders->bindGroupLayout("multi-view", [&] {
+            std::array<wgpu::BindGroupLayoutEntry, 3> layoutEntries{};
+
+            // Binding 0: view-projection per camera
+            layoutEntries[0].binding = 0;
+            layoutEntries[0].visibility = wgpu::ShaderStage::Vertex;
+            layoutEntries[0].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+
+            // Binding 1: DrawData per object
+            layoutEntries[1].binding = 1;
+            layoutEntries[1].visibility = wgpu::ShaderStage::Vertex;
+            layoutEntries[1].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+
+            // Binding 2: object count, to split the instance index
+            layoutEntries[2].binding = 2;
+            layoutEntries[2].visibility = wgpu::ShaderStage::Vertex;
+            layoutEntries[2].buffer.type = wgpu::BufferBindingType::Uniform;
+
+            wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+            bindGroupLayoutDesc.label = "Multi-view bind group layout";
+            bindGroupLayoutDesc.entryCount = layoutEntries.size();
+            bindGroupLayoutDesc.entries = layoutEntries.data();
+            return ctx->device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+        });
+
+        wgpu::BindGroupLayout materialLayout = MaterialTable::bindGroupLayout(ctx);
+        layeredPipeline = buildPipeline(shaderPath, {materialLayout, viewBindGroupLayout}, "Multi-view render pipeline");
+        layeredMsaaPipeline = buildPipeline(shaderPath, {materialLayout, viewBindGroupLayout},
+                                            "Multi-view MSAA render pipeline", msaaSampleCount);
+    }
 
-        // Depth stencil state
-        wgpu::DepthStencilState depthStencil{};
-        depthStencil.format = wgpu::TextureFormat::Depth24Plus;
-        depthStencil.depthWriteEnabled = true;
-        depthStencil.depthCompare = wgpu::CompareFunction::Less;
+    /**
+     * Pipelines of renderIds, after createPipeline whose scene bind group layout they share.
+     * Only alpha-tested materials sample a texture (their mask), and only moving objects write a
+     * color at all.
+     */
+    void createIdPipelines(const std::string& shaderPath) {
+        std::vector<wgpu::BindGroupLayout> layouts = {MaterialTable::bindGroupLayout(ctx), sceneBindGroupLayout};
+
+        idDepthPipeline = buildPipeline(shaderPath, layouts, "ID depth pre-pass pipeline", 1,
+                                        idFormat, "fragmentOpaque", wgpu::ColorWriteMask::None);
+        idDepthMaskedPipeline = buildPipeline(shaderPath, layouts, "ID masked depth pre-pass pipeline", 1,
+                                              idFormat, "fragmentMasked", wgpu::ColorWriteMask::None);
+        idPipeline = buildPipeline(shaderPath, layouts, "ID pipeline", 1, idFormat, "fragmentOpaque");
+    }
 
-        // Primitive state
-        wgpu::PrimitiveState primitive{};
-        if (wireframeMode) {
-            primitive.topology = wgpu::PrimitiveTopology::LineList;
-        } else {
-            primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    /**
+     * Records one render pass per layer into encoder, drawing every object with the
+     * view-projection of that layer. Instance index layer * objects.size() + object tells the
+     * shader which matrices to use, so all layers share viewBindGroup and nothing is written to
+     * the queue between draws. Consecutive objects of the same mesh are one instanced draw.
+     *
+     * With resolveLayers, colorLayers and depthLayers are multisampled (msaaSampleCount) and each
+     * pass resolves into its resolve layer; the multisampled contents are not kept, so the same
+     * views can be given for every layer.
+     *
+     * With layerDrawLists, a layer only draws the items of its list (see scene::SceneBVH::collect),
+     * still indexing the matrices by the position of the object in objects.
+     */
+    void renderLayers(wgpu::CommandEncoder& encoder,
+                      const std::vector<scene::SceneObject>& objects,
+                      const std::vector<wgpu::TextureView>& colorLayers,
+                      const std::vector<wgpu::TextureView>& depthLayers,
+                      wgpu::BindGroup viewBindGroup,
+                      const std::vector<wgpu::TextureView>& resolveLayers = {},
+                      const std::vector<std::vector<scene::DrawItem>>* layerDrawLists = nullptr) {
+        uint32_t objectCount = static_cast<uint32_t>(objects.size());
+        bool multisampled = !resolveLayers.empty();
+
+        for (uint32_t layer = 0; layer < colorLayers.size(); ++layer) {
+            wgpu::RenderPassColorAttachment colorAttachment{};
+            colorAttachment.view = colorLayers[layer];
+            colorAttachment.resolveTarget = multisampled ? resolveLayers[layer] : nullptr;
+            colorAttachment.loadOp = wgpu::LoadOp::Clear;
+            colorAttachment.storeOp = multisampled ? wgpu::StoreOp::Discard : wgpu::StoreOp::Store;
+            colorAttachment.clearValue = {0.1, 0.1, 0.1, 1.0};
+
+            wgpu::RenderPassDepthStencilAttachment depthAttachment{};
+            depthAttachment.view = depthLayers[layer];
+            depthAttachment.depthLoadOp = wgpu::LoadOp::Clear;
+            depthAttachment.depthStoreOp = wgpu::StoreOp::Discard;
+            depthAttachment.depthClearValue = 1.0f;
+
+            wgpu::RenderPassDescriptor renderPassDesc{};
+            renderPassDesc.colorAttachmentCount = 1;
+            renderPassDesc.colorAttachments = &colorAttachment;
+            renderPassDesc.depthStencilAttachment = &depthAttachment;
+
+            wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPassDesc);
+            pass.SetPipeline(multisampled ? layeredMsaaPipeline : layeredPipeline);
+            pass.SetBindGroup(0, materialBindGroup);
+            pass.SetBindGroup(1, viewBindGroup);
+
+            if (layerDrawLists) {
+                const auto& items = (*layerDrawLists)[layer];
+                drawInstanced(pass, items.size(),
+                              [&](size_t k) { return items[k].mesh; },
+                              [&](size_t k) { return layer * objectCount + items[k].object; });
+            } else {
+                drawInstanced(pass, objectCount,
+                              [&](size_t k) { return objects[k].mesh.get(); },
+                              [&](size_t k) { return layer * objectCount + static_cast<uint32_t>(k); });
+            }
+            pass.End();
         }
-        primitive.cullMode = wgpu::CullMode::Back;
-
-        // Render pipeline
-        wgpu::RenderPipelineDescriptor pipelineDesc{};
-        pipelineDesc.label = "Render pipeline";
-        pipelineDesc.layout = pipelineLayout;
-        pipelineDesc.vertex = vertexState;
-        pipelineDesc.primitive = primitive;
-        pipelineDesc.depthStencil = &depthStencil;
-        pipelineDesc.fragment = &fragmentState;
-        pipeline = ctx->device.CreateRenderPipeline(&pipelineDesc);
     }
 
     wgpu::Texture createDepthTexture() {
@@ -185,25 +253,140 @@ public:
         return ctx->device.CreateTexture(&desc);
     }
 
+    /**
+     * Draws objects from camera in one render pass (see drawScene).
+     * With resolveView, targetView and depthView are multisampled (msaaSampleCount) and the pass
+     * resolves into resolveView.
+     */
     void renderScene(const std::vector<scene::SceneObject>& objects,
                      const scene::Camera& camera,
-                     wgpu::TextureView depthView, wgpu::TextureView targetView = nullptr, bool imgui = false) {
-
+                     wgpu::TextureView depthView, wgpu::TextureView targetView = nullptr, bool imgui = false,
+                     wgpu::TextureView resolveView = nullptr) {
+        std::vector<scene::DrawItem> drawList;
+        drawList.reserve(objects.size());
         for (size_t i = 0; i < objects.size(); ++i) {
-            const auto& obj = objects[i];
+            drawList.push_back({static_cast<uint32_t>(i), objects[i].mesh.get()});
+        }
+        drawScene(objects, drawList, camera, depthView, targetView, imgui, resolveView);
+    }
 
-            // Compute MVP for this object
-            Eigen::Matrix4f mvp = camera.getViewProjectionMatrix() * obj.transform.getMatrix();
-            updateUniformBuffer(mvp.data(), sizeof(float) * 16);
+    // renderScene of the items of a culled draw list (see scene::SceneBVH::collect) only
+    void renderScene(const std::vector<scene::SceneObject>& objects,
+                     const std::vector<scene::DrawItem>& drawList,
+                     const scene::Camera& camera,
+                     wgpu::TextureView depthView, wgpu::TextureView targetView = nullptr,
+                     wgpu::TextureView resolveView = nullptr) {
+        drawScene(objects, drawList, camera, depthView, targetView, false, resolveView);
+    }
 
-            // Draw (pass material's bind group)
-            render(obj.mesh->vertexBuffer, obj.mesh->indexBuffer,
-                   obj.mesh->indexCount, depthView, i == 0,
-                   obj.material->bindGroup,  // ADD THIS
-                   targetView, imgui);
-        }
+    /**
+     * renderScene of drawList over what targetView and depthView already hold, such as a
+     * restored render of the static part of the scene: nothing is cleared and the items are
+     * depth-tested against the existing depth.
+     */
+    void renderOver(const std::vector<scene::SceneObject>& objects,
+                    const std::vector<scene::DrawItem>& drawList,
+                    const scene::Camera& camera,
+                    wgpu::TextureView depthView, wgpu::TextureView targetView) {
+        drawScene(objects, drawList, camera, depthView, targetView, false, nullptr, wgpu::LoadOp::Load);
     }
 
+    /**
+     * Renders the ID buffer of camera into idView (idFormat), cleared to noId: static objects
+     * (SceneObject::moving false) are drawn first into depthView only, opaque ones before
+     * alpha-tested ones, then moving objects write object index + 1 where they are visible.
+     * One render pass with a pipeline switch between the groups, submitted before returning
+     * like renderScene since the view-projection and draws go through the shared uniformBuffer
+     * and drawBuffer; no texture is sampled except the masks of static alpha-tested materials.
+     *
+     * Comparing two ID buffers gives the pixels where a moving object appeared or left, and
+     * id == index + 1 is the exact mask of one object.
+     *
+     * Args:
+     * - drawList: items to draw (see scene::SceneBVH::collect), nullptr draws every object
+     */
+    void renderIds(const std::vector<scene::SceneObject>& objects,
+                   const std::vector<scene::DrawItem>* drawList,
+                   const scene::Camera& camera,
+                   wgpu::TextureView depthView, wgpu::TextureView idView) {
+        std::vector<scene::DrawItem> items;
+        if (drawList) {
+            items = *drawList;
+        } else {
+            items.reserve(objects.size());
+            for (size_t i = 0; i < objects.size(); ++i) {
+                items.push_back({static_cast<uint32_t>(i), objects[i].mesh.get()});
+            }
+        }
+
+        // Static opaque, static masked, moving: the pipeline of each group, in drawing order
+        auto groupOf = [&](const scene::DrawItem& item) {
+            const auto& obj = objects[item.object];
+            if (obj.moving) return 2;
+            return obj.material->hasMask ? 1 : 0;
+        };
+        std::stable_sort(items.begin(), items.end(), [&](const scene::DrawItem& a, const scene::DrawItem& b) {
+            int groupA = groupOf(a), groupB = groupOf(b);
+            if (groupA != groupB) return groupA < groupB;
+            return std::less<const scene::Mesh*>()(a.mesh, b.mesh);
+        });
+
+        std::vector<DrawData> draws(items.size());
+        for (size_t k = 0; k < items.size(); ++k) {
+            const auto& obj = objects[items[k].object];
+            draws[k].model = obj.transform.getMatrix();
+            draws[k].material = obj.material->id;
+            draws[k].id = obj.moving ? items[k].object + 1 : noId;
+        }
+
+        reserveDraws(draws.size());
+        Eigen::Matrix4f viewProjection = camera.getViewProjectionMatrix();
+        updateUniformBuffer(viewProjection.data(), sizeof(float) * 16);
+        if (!draws.empty()) {
+            ctx->queue.WriteBuffer(drawBuffer, 0, draws.data(), draws.size() * sizeof(DrawData));
+        }
+
+        wgpu::RenderPassColorAttachment idAttachment{};
+        idAttachment.view = idView;
+        idAttachment.loadOp = wgpu::LoadOp::Clear;
+        idAttachment.storeOp = wgpu::StoreOp::Store;
+        idAttachment.clearValue = {noId, 0, 0, 0};
+
+        wgpu::RenderPassDepthStencilAttachment depthAttachment{};
+        depthAttachment.view = depthView;
+        depthAttachment.depthLoadOp = wgpu::LoadOp::Clear;
+        depthAttachment.depthStoreOp = wgpu::StoreOp::Discard;
+        depthAttachment.depthClearValue = 1.0f;
+
+        wgpu::RenderPassDescriptor renderPassDesc{};
+        renderPassDesc.colorAttachmentCount = 1;
+        renderPassDesc.colorAttachments = &idAttachment;
+        renderPassDesc.depthStencilAttachment = &depthAttachment;
+
+        wgpu::CommandEncoder encoder = ctx->device.CreateCommandEncoder();
+        wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPassDesc);
+        pass.SetBindGroup(0, materialBindGroup);
+        pass.SetBindGroup(1, sceneBindGroup);
+
+        const wgpu::RenderPipeline* pipelines[] = {&idDepthPipeline, &idDepthMaskedPipeline, &idPipeline};
+        size_t begin = 0;
+        while (begin < items.size()) {
+            int group = groupOf(items[begin]);
+            size_t end = begin;
+            while (end < items.size() && groupOf(items[end]) == group) {
+                end++;
+            }
+            pass.SetPipeline(*pipelines[group]);
+            drawInstanced(pass, end - begin,
+                          [&](size_t k) { return items[begin + k].mesh; },
+                          [&](size_t k) { return static_cast<uint32_t>(begin + k); });
+            begin = end;
+        }
+        pass.End();
+
+        wgpu::CommandBuffer commands = encoder.Finish();
+        ctx->queue.Submit(1, &commands);
+    }
 
     void clear(wgpu::TextureView targetView) {
         auto commandEncoder = ctx->device.CreateCommandEncoder();
@@ -258,21 +441,53 @@ public:
     
 
 private:
+    // renderScene draws, grown when the scene grows; sceneBindGroup follows the buffer
+    wgpu::Buffer drawBuffer;
+    wgpu::BindGroup sceneBindGroup;
+    size_t drawCapacity = 0;
+
+    /**
+     * Draws the items sorted by mesh: their DrawData go to drawBuffer in that order, so the
+     * draws of one mesh have consecutive instances and are a single instanced draw. The pass
+     * binds the material table once and only switches vertex and index buffers between meshes.
+     * loadOp applies to the color and depth attachments.
+     */
+    void drawScene(const std::vector<scene::SceneObject>& objects,
+                   const std::vector<scene::DrawItem>& drawList,
+                   const scene::Camera& camera,
+                   wgpu::TextureView depthView, wgpu::TextureView targetView, bool imgui,
+                   wgpu::TextureView resolveView, wgpu::LoadOp loadOp = wgpu::LoadOp::Clear) {
+        std::vector<uint32_t> order(drawList.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return std::less<const scene::Mesh*>()(drawList[a].mesh, drawList[b].mesh);
+        });
+
+        std::vector<DrawData> draws(order.size());
+        for (size_t k = 0; k < order.size(); ++k) {
+            const auto& obj = objects[drawList[order[k]].object];
+            draws[k].model = obj.transform.getMatrix();
+            draws[k].material = obj.material->id;
+            draws[k].id = noId;
+        }
 
-    void render(wgpu::Buffer vertexBuffer, wgpu::Buffer indexBuffer,
-                uint32_t indexCount, wgpu::TextureView depthView, bool clear, wgpu::BindGroup materialBindGroup, wgpu::TextureView targetView = nullptr, bool imgui = false) {
-
-        wgpu::TextureView colorView = targetView != nullptr ? targetView : targetTextureView;
+        reserveDraws(draws.size());
+        Eigen::Matrix4f viewProjection = camera.getViewProjectionMatrix();
+        updateUniformBuffer(viewProjection.data(), sizeof(float) * 16);
+        if (!draws.empty()) {
+            ctx->queue.WriteBuffer(drawBuffer, 0, draws.data(), draws.size() * sizeof(DrawData));
+        }
 
         wgpu::RenderPassColorAttachment colorAttachment{};
-        colorAttachment.view = colorView;
-        colorAttachment.loadOp = clear ? wgpu::LoadOp::Clear : wgpu::LoadOp::Load;
+        colorAttachment.view = targetView != nullptr ? targetView : targetTextureView;
+        colorAttachment.resolveTarget = resolveView;
+        colorAttachment.loadOp = loadOp;
         colorAttachment.storeOp = wgpu::StoreOp::Store;
         colorAttachment.clearValue = {0.1, 0.1, 0.1, 1.0};
 
         wgpu::RenderPassDepthStencilAttachment depthAttachment{};
         depthAttachment.view = depthView;
-        depthAttachment.depthLoadOp = clear ? wgpu::LoadOp::Clear : wgpu::LoadOp::Load;
+        depthAttachment.depthLoadOp = loadOp;
         depthAttachment.depthStoreOp = wgpu::StoreOp::Store;
         depthAttachment.depthClearValue = 1.0f;
 
@@ -284,11 +499,12 @@ private:
         wgpu::CommandEncoder encoder = ctx->device.CreateCommandEncoder();
         wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPassDesc);
 
-        pass.SetPipeline(pipeline);
+        pass.SetPipeline(resolveView != nullptr ? msaaPipeline : pipeline);
         pass.SetBindGroup(0, materialBindGroup);
-        pass.SetVertexBuffer(0, vertexBuffer);
-        pass.SetIndexBuffer(indexBuffer, wgpu::IndexFormat::Uint16);
-        pass.DrawIndexed(indexCount);
+        pass.SetBindGroup(1, sceneBindGroup);
+        drawInstanced(pass, order.size(),
+                      [&](size_t k) { return drawList[order[k]].mesh; },
+                      [](size_t k) { return static_cast<uint32_t>(k); });
 
         if (imgui) {
             ImGui::Render();
@@ -301,14 +517,170 @@ private:
         ctx->queue.Submit(1, &commands);
     }
 
-    std::string readFile(const std::string& path) {
-        std::ifstream f(path);
-        if (!f.is_open()) {
-            throw std::runtime_error("Cannot open file: " + path);
+    void reserveDraws(size_t drawCount) {
+        if (drawCount <= drawCapacity && sceneBindGroup) return;
+
+        drawCapacity = std::max<size_t>({drawCount, drawCapacity * 2, 64});
+
+        wgpu::BufferDescriptor drawDesc{};
+        drawDesc.label = "Draw buffer";
+        drawDesc.size = sizeof(DrawData) * drawCapacity;
+        drawDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+        drawBuffer = ctx->device.CreateBuffer(&drawDesc);
+
+        std::array<wgpu::BindGroupEntry, 2> entries{};
+        entries[0].binding = 0;
+        entries[0].buffer = uniformBuffer;
+        entries[0].size = uniformBuffer.GetSize();
+        entries[1].binding = 1;
+        entries[1].buffer = drawBuffer;
+        entries[1].size = drawBuffer.GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.label = "Scene bind group";
+        bindGroupDesc.layout = sceneBindGroupLayout;
+        bindGroupDesc.entryCount = entries.size();
+        bindGroupDesc.entries = entries.data();
+        sceneBindGroup = ctx->device.CreateBindGroup(&bindGroupDesc);
+    }
+
+    /**
+     * Draws count items, each group of consecutive items with the same mesh and consecutive
+     * instances as one instanced draw; vertex and index buffers are only set when the mesh
+     * changes.
+     *
+     * Args:
+     * - meshOf(k): mesh of item k
+     * - instanceOf(k): instance index of item k, where the shader finds its DrawData
+     */
+    template <typename MeshOf, typename InstanceOf>
+    static void drawInstanced(wgpu::RenderPassEncoder& pass, size_t count,
+                              const MeshOf& meshOf, const InstanceOf& instanceOf) {
+        const scene::Mesh* bound = nullptr;
+        size_t k = 0;
+        while (k < count) {
+            const scene::Mesh* mesh = meshOf(k);
+            uint32_t first = instanceOf(k);
+            size_t end = k + 1;
+            while (end < count && meshOf(end) == mesh && instanceOf(end) == first + (end - k)) {
+                end++;
+            }
+
+            if (mesh != bound) {
+                pass.SetVertexBuffer(0, mesh->vertexBuffer);
+                pass.SetIndexBuffer(mesh->indexBuffer, wgpu::IndexFormat::Uint16);
+                bound = mesh;
+            }
+            pass.DrawIndexed(mesh->indexCount, static_cast<uint32_t>(end - k), 0, 0, first);
+            k = end;
+        }
+    }
+
+    /**
+     * Scene pipeline from the shader registry, created on the first request of its key: shader,
+     * fragment entry point, color format, sample count, write mask and topology. The group layouts
+     * follow from the shader, and are shared through the registry as well.
+     *
+     * Args:
+     * - colorFormat: of the color target, Undefined for format
+     * - fragmentEntry: fragment entry point of the shader
+     * - writeMask: None for depth-only pipelines
+     */
+    wgpu::RenderPipeline buildPipeline(const std::string& shaderPath,
+                                       std::vector<wgpu::BindGroupLayout> layouts,
+                                       const char* label, uint32_t sampleCount = 1,
+                                       wgpu::TextureFormat colorFormat = wgpu::TextureFormat::Undefined,
+                                       const char* fragmentEntry = "fragmentMain",
+                                       wgpu::ColorWriteMask writeMask = wgpu::ColorWriteMask::All) {
+        wgpu::TextureFormat targetFormat = colorFormat != wgpu::TextureFormat::Undefined ? colorFormat : format;
+        std::string key = "scene/" + std::filesystem::path(shaderPath).filename().string() + "/" + fragmentEntry
+                        + "/" + std::to_string(static_cast<uint32_t>(targetFormat)) + "/" + std::to_string(sampleCount)
+                        + "/" + std::to_string(static_cast<uint32_t>(writeMask)) + (wireframeMode ? "/lines" : "");
+        return ctx->shaders->renderPipeline(key, [&] {
+            return createScenePipeline(loadShader(shaderPath), layouts, label, sampleCount, targetFormat,
+                                       fragmentEntry, writeMask);
+        });
+    }
+
+    wgpu::RenderPipeline createScenePipeline(wgpu::ShaderModule shaderModule,
+                                             const std::vector<wgpu::BindGroupLayout>& layouts,
+                                             const char* label, uint32_t sampleCount,
+                                             wgpu::TextureFormat colorFormat, const char* fragmentEntry,
+                                             wgpu::ColorWriteMask writeMask) {
+        // Pipeline layout
+        wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+        pipelineLayoutDesc.label = "Pipeline layout";
+        pipelineLayoutDesc.bindGroupLayoutCount = layouts.size();
+        pipelineLayoutDesc.bindGroupLayouts = layouts.data();
+        auto pipelineLayout = ctx->device.CreatePipelineLayout(&pipelineLayoutDesc);
+
+        // Vertex attributes: position (vec3f) + color (vec3f)
+        std::array<wgpu::VertexAttribute, 3> attributes{};  // Changed from 2 to 3
+        attributes[0].format = wgpu::VertexFormat::Float32x3;
+        attributes[0].offset = 0;
+        attributes[0].shaderLocation = 0; // position
+
+        attributes[1].format = wgpu::VertexFormat::Float32x3;
+        attributes[1].offset = 3 * sizeof(float);
+        attributes[1].shaderLocation = 1; // color
+
+        attributes[2].format = wgpu::VertexFormat::Float32x2;  // NEW: UV is 2 floats
+        attributes[2].offset = 6 * sizeof(float);              // NEW: after pos + color
+        attributes[2].shaderLocation = 2;                      // NEW: location 2
+
+        wgpu::VertexBufferLayout vertexBufferLayout{};
+        vertexBufferLayout.arrayStride = 8 * sizeof(float); // pos + color + uv (was 6)
+        vertexBufferLayout.stepMode = wgpu::VertexStepMode::Vertex;
+        vertexBufferLayout.attributeCount = attributes.size();
+        vertexBufferLayout.attributes = attributes.data();
+
+        // Vertex state
+        wgpu::VertexState vertexState{};
+        vertexState.module = shaderModule;
+        vertexState.entryPoint = "vertexMain";
+        vertexState.bufferCount = 1;
+        vertexState.buffers = &vertexBufferLayout;
+
+        // Fragment state
+        wgpu::ColorTargetState colorTarget{};
+        colorTarget.format = colorFormat;
+        colorTarget.writeMask = writeMask;
+
+        wgpu::FragmentState fragmentState{};
+        fragmentState.module = shaderModule;
+        fragmentState.entryPoint = fragmentEntry;
+        fragmentState.targetCount = 1;
+        fragmentState.targets = &colorTarget;
+
+        // Depth stencil state
+        wgpu::DepthStencilState depthStencil{};
+        depthStencil.format = wgpu::TextureFormat::Depth24Plus;
+        depthStencil.depthWriteEnabled = true;
+        depthStencil.depthCompare = wgpu::CompareFunction::Less;
+
+        // Primitive state
+        wgpu::PrimitiveState primitive{};
+        if (wireframeMode) {
+            primitive.topology = wgpu::PrimitiveTopology::LineList;
+        } else {
+            primitive.topology = wgpu::PrimitiveTopology::TriangleList;
         }
-        std::stringstream ss;
-        ss << f.rdbuf();
-        return ss.str();
+        primitive.cullMode = wgpu::CullMode::Back;
+
+        // Render pipeline
+        wgpu::RenderPipelineDescriptor pipelineDesc{};
+        pipelineDesc.label = label;
+        pipelineDesc.layout = pipelineLayout;
+        pipelineDesc.vertex = vertexState;
+        pipelineDesc.primitive = primitive;
+        pipelineDesc.depthStencil = &depthStencil;
+        pipelineDesc.fragment = &fragmentState;
+        pipelineDesc.multisample.count = sampleCount;
+        return ctx->device.CreateRenderPipeline(&pipelineDesc);
+    }
+
+    wgpu::ShaderModule loadShader(const std::string& path) {
+        return ctx->shaders->module(path);
     }
 };
 
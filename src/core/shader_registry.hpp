@@ -0,0 +1,113 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <webgpu/webgpu_cpp.h>
+
+#ifdef EMBED_SHADERS
+#include "embedded_shaders.hpp"  // generated by cmake/embed_shaders.cmake
+#endif
+
+#ifndef SHADERS_DIR
+#define SHADERS_DIR "src/shaders/"
+#endif
+
+namespace core {
+
+/**
+ * Shader modules and pipelines shared by everything drawing on a device.
+ *
+ * WGSL comes from the executable when built with EMBED_SHADERS (the default, see CMakeLists.txt),
+ * otherwise from SHADERS_DIR at run time, so shaders can still be edited without rebuilding.
+ * Shaders are looked up by file name; a path is reduced to its file name.
+ *
+ * Modules are created once per shader. Pipelines and bind group layouts are created once per
+ * key: the key names everything the pipeline depends on (shader, formats, sample count), and a
+ * second Downsampler or capture asking for the same key gets the existing objects. Bind groups
+ * made with a cached layout work with the cached pipeline, whoever created them first.
+ */
+class ShaderRegistry {
+public:
+    explicit ShaderRegistry(wgpu::Device device) : device_(std::move(device)) {}
+
+    // WGSL of a shader, from the embedded copies or from SHADERS_DIR
+    static std::string source(const std::string& nameOrPath) {
+        std::string name = std::filesystem::path(nameOrPath).filename().string();
+#ifdef EMBED_SHADERS
+        for (const auto& [embeddedName, code] : embedded::shaders) {
+            if (embeddedName == name) {
+                return std::string(code);
+            }
+        }
+#endif
+        std::string path = std::filesystem::path(nameOrPath).has_parent_path() ? nameOrPath : SHADERS_DIR + name;
+        std::ifstream f(path);
+        if (!f.is_open()) {
+            throw std::runtime_error("Cannot open shader: " + path);
+        }
+        std::stringstream ss;
+        ss << f.rdbuf();
+        return ss.str();
+    }
+
+    wgpu::ShaderModule module(const std::string& nameOrPath) {
+        std::string name = std::filesystem::path(nameOrPath).filename().string();
+        auto it = modules_.find(name);
+        if (it != modules_.end()) {
+            return it->second;
+        }
+
+        std::string code = source(nameOrPath);
+        wgpu::ShaderSourceWGSL wgsl{};
+        wgsl.code = code.c_str();
+        wgpu::ShaderModuleDescriptor shaderDesc{};
+        shaderDesc.nextInChain = &wgsl;
+        shaderDesc.label = name.c_str();
+        wgpu::ShaderModule shaderModule = device_.CreateShaderModule(&shaderDesc);
+        modules_.emplace(name, shaderModule);
+        return shaderModule;
+    }
+
+    wgpu::BindGroupLayout bindGroupLayout(const std::string& key, const std::function<wgpu::BindGroupLayout()>& create) {
+        return cached(bindGroupLayouts_, key, create);
+    }
+
+    wgpu::RenderPipeline renderPipeline(const std::string& key, const std::function<wgpu::RenderPipeline()>& create) {
+        return cached(renderPipelines_, key, create);
+    }
+
+    wgpu::ComputePipeline computePipeline(const std::string& key, const std::function<wgpu::ComputePipeline()>& create) {
+        return cached(computePipelines_, key, create);
+    }
+
+    size_t moduleCount() const { return modules_.size(); }
+    size_t pipelineCount() const { return renderPipelines_.size() + computePipelines_.size(); }
+    size_t reusedCount() const { return reused_; }
+
+private:
+    wgpu::Device device_;
+    std::unordered_map<std::string, wgpu::ShaderModule> modules_;
+    std::unordered_map<std::string, wgpu::BindGroupLayout> bindGroupLayouts_;
+    std::unordered_map<std::string, wgpu::RenderPipeline> renderPipelines_;
+    std::unordered_map<std::string, wgpu::ComputePipeline> computePipelines_;
+    size_t reused_ = 0;
+
+    template <typename T>
+    T cached(std::unordered_map<std::string, T>& map, const std::string& key, const std::function<T()>& create) {
+        auto it = map.find(key);
+        if (it != map.end()) {
+            reused_++;
+            return it->second;
+        }
+        T object = create();
+        map.emplace(key, object);
+        return object;
+    }
+};
+
+} // namespace core
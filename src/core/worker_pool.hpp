@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+/**
+ * Threads kept alive between runs, so that work split per frame does not pay for thread creation.
+ *
+ * run(count, fn) calls fn(worker) once for each worker in [0, count) and returns when all calls
+ * are done. Worker 0 is the calling thread, the others are pool threads, started on the first run
+ * that needs them and joined by the destructor. Work is usually shared out inside fn, e.g. through
+ * an atomic counter, so the result does not depend on which worker gets what.
+ *
+ * Runs from different threads on the same pool are not supported: use localWorkerPool() to get
+ * one pool per calling thread, e.g. one per DetectionPipeline stage.
+ */
+class WorkerPool {
+public:
+    WorkerPool() = default;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    template <typename Fn>
+    void run(size_t count, Fn fn) {
+        if (count <= 1) {
+            if (count == 1) fn(size_t(0));
+            return;
+        }
+        while (threads_.size() < count - 1) {
+            size_t worker = threads_.size() + 1;
+            threads_.emplace_back([this, worker] { loop(worker); });
+        }
+
+        {
+            std::lock_guard lock(mutex_);
+            job_ = [&fn](size_t worker) { fn(worker); };
+            active_ = count;
+            pending_ = count - 1;
+            generation_++;
+        }
+        wake_.notify_all();
+
+        fn(size_t(0));
+
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+    // Pool threads started so far, the calling thread not included
+    size_t size() const {
+        return threads_.size();
+    }
+
+private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::function<void(size_t)> job_;
+    size_t active_ = 0;      // workers taking part in the current run
+    size_t pending_ = 0;     // pool workers of the current run not done yet
+    size_t generation_ = 0;  // incremented by each run
+    bool stopping_ = false;
+
+    void loop(size_t worker) {
+        size_t seen = 0;
+        std::unique_lock lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) return;
+            seen = generation_;
+            if (worker >= active_) continue;
+
+            lock.unlock();
+            job_(worker);
+            lock.lock();
+            if (--pending_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+};
+
+// Pool of the calling thread, created on first use
+inline WorkerPool& localWorkerPool() {
+    thread_local WorkerPool pool;
+    return pool;
+}
+
+} // namespace core
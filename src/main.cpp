@@ -1,6 +1,9 @@
 
+#include <chrono>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <string>
 #include <vector>
 #include <GLFW/glfw3.h>
 
@@ -11,15 +14,18 @@
 #include <opencv2/opencv.hpp>
 
 #include "utils.hpp"
+#include "run_options.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_wgpu.h"
 
 #include "core/context.hpp"
 #include "core/renderer.hpp"
+#include "core/material_table.hpp"
 #include "core/multi_camera_capture.hpp"
 #include "core/window.hpp"
 #include "core/noise_pass.hpp"
+#include "core/append_buffer_benchmark.hpp"
 
 #include "scene/scene_object.hpp"
 #include "scene/observation_camera.hpp"
@@ -27,103 +33,132 @@
 #include "vision/detect_object.hpp"
 #include "vision/cluster_detections.hpp"
 #include "vision/track_clusters.hpp"
+#include "vision/detection_benchmark.hpp"
+#include "vision/capture_benchmark.hpp"
+#include "vision/detection_pipeline.hpp"
+#include "vision/occupancy_map.hpp"
+#include "vision/clutter_map.hpp"
 
 
-int main() {
+int main(int argc, char** argv) {
+    auto startupBegin = std::chrono::high_resolution_clock::now();
+
+    RunOptions options;
+    if (!parseRunOptions(argc, argv, options)) {
+        return options.help ? 0 : 1;
+    }
+
     core::Context ctx;
+    ctx.adapterPreference = options.adapter;
+    if (options.shader_cache) {
+        ctx.cacheDirectory = ".cache/dawn";
+    }
     if (!ctx.initialize()) {
         std::cerr << "Failed to initialize WebGPU context\n";
         return 1;
     }
 
-    core::Window debugWindow(1920, 1080, "Debug");
-    debugWindow.create();
-    debugWindow.createSurface(ctx.instance, ctx.adapter, ctx.device);
-
-    // Create dummy mask texture (1x1 white)
-    wgpu::TextureDescriptor dummyMaskDesc{};
-    dummyMaskDesc.size = {1, 1, 1};
-    dummyMaskDesc.format = wgpu::TextureFormat::R8Unorm;
-    dummyMaskDesc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
-    wgpu::Texture dummyMaskTexture = ctx.device.CreateTexture(&dummyMaskDesc);
-
-    uint8_t whitePixel = 255;
-    wgpu::TexelCopyBufferLayout dummyLayout{};
-    dummyLayout.bytesPerRow = 1;
-    wgpu::TexelCopyTextureInfo destination{};
-    destination.texture = dummyMaskTexture;
-    wgpu::Extent3D writeSize{1, 1, 1};
-    ctx.queue.WriteTexture(&destination, &whitePixel, 1, &dummyLayout, &writeSize);
-    wgpu::TextureView dummyMaskView = dummyMaskTexture.CreateView();
-
-    int fbWidth, fbHeight;
-    glfwGetFramebufferSize(debugWindow.handle, &fbWidth, &fbHeight);
+    // Headless runs have no window, surface or ImGui, and no debug view
+    std::optional<core::Window> debugWindow;
+    if (!options.headless) {
+        debugWindow.emplace(1920, 1080, "Debug");
+        if (!debugWindow->create()) {
+            std::cerr << "Failed to create the window, --headless runs without one\n";
+            return 1;
+        }
+        debugWindow->createSurface(ctx.instance, ctx.adapter, ctx.device);
+    }
+
+    int fbWidth = static_cast<int>(options.width);
+    int fbHeight = static_cast<int>(options.height);
+    if (debugWindow) {
+        glfwGetFramebufferSize(debugWindow->handle, &fbWidth, &fbHeight);
+    }
     auto surfaceWidth = static_cast<uint32_t>(fbWidth);
     auto surfaceHeight = static_cast<uint32_t>(fbHeight);
 
     core::Renderer renderer(&ctx, surfaceWidth, surfaceHeight);
     renderer.createUniformBuffer(sizeof(float) * 16);
-    renderer.createPipeline(SHADERS_DIR "unlit.wgsl");
-
-    wgpu::Texture depthTexture = renderer.createDepthTexture();
-    wgpu::TextureView depthView = depthTexture.CreateView();
-
-    // High-res textures for debug camera AA
-    // this is a quick fix and kinda ugly..
-    constexpr uint32_t debugSupersample = 2;
-    uint32_t debugRenderWidth = surfaceWidth * debugSupersample;
-    uint32_t debugRenderHeight = surfaceHeight * debugSupersample;
-
-    wgpu::TextureDescriptor debugRenderDesc{};
-    debugRenderDesc.label = "Debug high-res render texture";
-    debugRenderDesc.size = {debugRenderWidth, debugRenderHeight, 1};
-    debugRenderDesc.format = wgpu::TextureFormat::BGRA8Unorm;
-    debugRenderDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    wgpu::Texture debugRenderTexture = ctx.device.CreateTexture(&debugRenderDesc);
-    wgpu::TextureView debugRenderView = debugRenderTexture.CreateView();
-
-    wgpu::TextureDescriptor debugDepthDesc{};
-    debugDepthDesc.label = "Debug high-res depth texture";
-    debugDepthDesc.size = {debugRenderWidth, debugRenderHeight, 1};
-    debugDepthDesc.format = wgpu::TextureFormat::Depth24Plus;
-    debugDepthDesc.usage = wgpu::TextureUsage::RenderAttachment;
-    wgpu::Texture debugDepthTexture = ctx.device.CreateTexture(&debugDepthDesc);
-    wgpu::TextureView debugDepthView = debugDepthTexture.CreateView();
-
-    core::Downsampler debugDownsampler(&ctx, wgpu::TextureFormat::BGRA8Unorm);
+    renderer.createPipeline("unlit.wgsl");
+    renderer.createLayeredPipeline("unlit_layered.wgsl");
+    renderer.createIdPipelines("id.wgsl");
+
+    // Targets of the debug view, only with a window: headless runs never draw it
+    wgpu::TextureView depthView;
+    wgpu::TextureView debugRenderView;
+    wgpu::TextureView debugDepthView;
+    wgpu::TextureView debugMsaaView;
+    wgpu::TextureView debugMsaaDepthView;
+    std::optional<core::Downsampler> debugDownsampler;
+    wgpu::BindGroup debugDownsampleBindGroup;
+    if (debugWindow) {
+        depthView = renderer.createDepthTexture().CreateView();
+
+        // High-res textures for debug camera AA
+        // this is a quick fix and kinda ugly..
+        constexpr uint32_t debugSupersample = 2;
+        uint32_t debugRenderWidth = surfaceWidth * debugSupersample;
+        uint32_t debugRenderHeight = surfaceHeight * debugSupersample;
+
+        wgpu::TextureDescriptor debugRenderDesc{};
+        debugRenderDesc.label = "Debug high-res render texture";
+        debugRenderDesc.size = {debugRenderWidth, debugRenderHeight, 1};
+        debugRenderDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+        debugRenderDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
+        debugRenderView = ctx.device.CreateTexture(&debugRenderDesc).CreateView();
+
+        wgpu::TextureDescriptor debugDepthDesc{};
+        debugDepthDesc.label = "Debug high-res depth texture";
+        debugDepthDesc.size = {debugRenderWidth, debugRenderHeight, 1};
+        debugDepthDesc.format = wgpu::TextureFormat::Depth24Plus;
+        debugDepthDesc.usage = wgpu::TextureUsage::RenderAttachment;
+        debugDepthView = ctx.device.CreateTexture(&debugDepthDesc).CreateView();
+
+        debugDownsampler.emplace(&ctx, wgpu::TextureFormat::BGRA8Unorm);
+        debugDownsampleBindGroup = debugDownsampler->createBindGroup(debugRenderView);
+
+        // MSAA alternative: multisampled at surface size, resolved straight into the surface
+        wgpu::TextureDescriptor debugMsaaDesc{};
+        debugMsaaDesc.label = "Debug MSAA render texture";
+        debugMsaaDesc.size = {surfaceWidth, surfaceHeight, 1};
+        debugMsaaDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+        debugMsaaDesc.sampleCount = core::Renderer::msaaSampleCount;
+        debugMsaaDesc.usage = wgpu::TextureUsage::RenderAttachment;
+        debugMsaaView = ctx.device.CreateTexture(&debugMsaaDesc).CreateView();
+
+        wgpu::TextureDescriptor debugMsaaDepthDesc = debugMsaaDesc;
+        debugMsaaDepthDesc.label = "Debug MSAA depth texture";
+        debugMsaaDepthDesc.format = wgpu::TextureFormat::Depth24Plus;
+        debugMsaaDepthView = ctx.device.CreateTexture(&debugMsaaDepthDesc).CreateView();
+    }
 
-    auto defaultMaterial = std::make_shared<Material>(
-        Material::createUntextured(ctx.device, ctx.queue));
-    defaultMaterial->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                                    renderer.uniformBuffer, dummyMaskView);
+    // Decoded textures and their mips, kept between runs like the shader cache
+    scene::TextureCache textureCache(options.shader_cache ? ".cache/textures" : "");
 
+    // Every material of the scene, uploaded once they are all added (see MaterialTable)
+    core::MaterialTable materials;
+    auto defaultMaterial = materials.addUntextured();
 
     // Terrain - 500m x 500m
     auto terrainMesh = std::make_shared<scene::Mesh>(
         scene::Mesh::createGridPlane(ctx.device, ctx.queue, 500.0f, 50));
 
-    // Meshes
+    // Meshes, with simplified versions for the captures of distant cameras (see setCulling)
+    const int lodLevels = 3;
     auto houseMesh = std::make_shared<scene::Mesh>(
-        scene::Mesh::createMesh("models/house.obj", ctx.device, ctx.queue));
+        scene::Mesh::createMesh("models/house.obj", ctx.device, ctx.queue, lodLevels));
 
     // Tree stem (bark)
     auto treeStemMesh = std::make_shared<scene::Mesh>(
-        scene::Mesh::createMesh("models/MapleTreeStem.obj", ctx.device, ctx.queue));
-    auto barkMaterial = std::make_shared<Material>(
-        Material::create(ctx.device, ctx.queue, "models/maple_bark.png"));
-    barkMaterial->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                             renderer.uniformBuffer, dummyMaskView);
+        scene::Mesh::createMesh("models/MapleTreeStem.obj", ctx.device, ctx.queue, lodLevels));
+    auto barkMaterial = materials.addTextured("models/maple_bark.png", "", &textureCache);
 
     // Tree leaves
     auto treeLeavesMesh = std::make_shared<scene::Mesh>(
-        scene::Mesh::createMesh("models/MapleTreeLeaves.obj", ctx.device, ctx.queue));
+        scene::Mesh::createMesh("models/MapleTreeLeaves.obj", ctx.device, ctx.queue, lodLevels));
 
-    auto leafMaterial = std::make_shared<Material>(
-    Material::create(ctx.device, ctx.queue,
-                        "models/maple_leaf.png",
-                        "models/maple_leaf_Mask.png"));
-    leafMaterial->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                                 renderer.uniformBuffer, dummyMaskView);
+    auto leafMaterial = materials.addTextured("models/maple_leaf.png", "models/maple_leaf_Mask.png",
+                                              &textureCache);
 
     std::vector<scene::SceneObject> objects;
 
@@ -138,7 +173,7 @@ int main() {
 
     scene::Transform droneTransform;
         droneTransform.scale = Eigen::Vector3f(0.2f, 0.2f, 0.2f);
-        objects.push_back({droneMesh, droneTransform, defaultMaterial});
+        objects.push_back({droneMesh, droneTransform, defaultMaterial, true});
 
     size_t droneIndex = objects.size() - 1;  // remember index for animation
 
@@ -147,15 +182,8 @@ int main() {
         scene::Mesh::createWireframeCube(ctx.device, ctx.queue, 0.02f));
 
     // Voxel debug materials
-    auto visitedVoxelMaterial = std::make_shared<Material>(
-        Material::createColored(ctx.device, ctx.queue, Eigen::Vector3f(0.5f, 0.5f, 0.5f)));  // Gray
-    visitedVoxelMaterial->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                                          renderer.uniformBuffer, dummyMaskView);
-
-    auto detectionVoxelMaterial = std::make_shared<Material>(
-        Material::createColored(ctx.device, ctx.queue, Eigen::Vector3f(0.0f, 1.0f, 0.0f)));  // Green
-    detectionVoxelMaterial->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                                            renderer.uniformBuffer, dummyMaskView);
+    auto visitedVoxelMaterial = materials.addColored(Eigen::Vector3f(0.5f, 0.5f, 0.5f));  // Gray
+    auto detectionVoxelMaterial = materials.addColored(Eigen::Vector3f(0.0f, 1.0f, 0.0f));  // Green
 
     // Debug ray visualization mesh (thin stretched cube)
     auto rayLineMesh = std::make_shared<scene::Mesh>(
@@ -172,18 +200,14 @@ int main() {
     };
 
     for (const auto& color : cameraColors) {
-        auto mat = std::make_shared<Material>(
-            Material::createColored(ctx.device, ctx.queue, color));
-        mat->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                            renderer.uniformBuffer, dummyMaskView);
-        cameraRayMaterials.push_back(mat);
+        cameraRayMaterials.push_back(materials.addColored(color));
     }
 
     // Bright red for detection rays
-    auto detectionRayMaterial = std::make_shared<Material>(
-        Material::createColored(ctx.device, ctx.queue, Eigen::Vector3f(1.0f, 0.0f, 0.0f)));
-    detectionRayMaterial->createBindGroup(ctx.device, renderer.bindGroupLayout,
-                                         renderer.uniformBuffer, dummyMaskView);
+    auto detectionRayMaterial = materials.addColored(Eigen::Vector3f(1.0f, 0.0f, 0.0f));
+
+    materials.upload(&ctx);
+    renderer.setMaterialTable(materials);
 
     // House - left side
     scene::Transform houseTransform;
@@ -231,7 +255,7 @@ int main() {
     };
 
     auto makeObserver = [&](Eigen::Vector3f pos, Eigen::Vector3f target) {
-        scene::Camera cam(800.0f / 600.0f);
+        scene::Camera cam(static_cast<float>(options.width) / options.height);
         cam.position = pos;
         cam.target = target;
         cam.farPlane = 1000.0f;
@@ -240,21 +264,64 @@ int main() {
 
     std::vector<scene::ObservationCamera> observers;
 
-    // Cameras arranged in pentagon, ~180m from center, looking at drone altitude
-    observers.push_back(makeObserver({0.0f, 2.0f, 180.0f}, {0.0f, 30.0f, 0.0f}));       // Front
-    observers.push_back(makeObserver({171.0f, 5.0f, 56.0f}, {0.0f, 30.0f, 0.0f}));      // Front-right
-    observers.push_back(makeObserver({106.0f, 2.0f, -146.0f}, {0.0f, 30.0f, 0.0f}));    // Back-right
-    observers.push_back(makeObserver({-106.0f, 8.0f, -146.0f}, {0.0f, 30.0f, 0.0f}));   // Back-left
-    observers.push_back(makeObserver({-171.0f, 3.0f, 56.0f}, {0.0f, 30.0f, 0.0f}));     // Front-left
+    // Cameras on a circle 180m from center, looking at drone altitude; the default 5 make a
+    // pentagon starting at the front. Heights vary between 2m and 8m.
+    const float cameraHeights[] = {2.0f, 5.0f, 2.0f, 8.0f, 3.0f};
+    for (int i = 0; i < options.cameras; ++i) {
+        float angle = 2.0f * float(M_PI) * i / options.cameras;
+        Eigen::Vector3f position(180.0f * std::sin(angle), cameraHeights[i % 5], 180.0f * std::cos(angle));
+        observers.push_back(makeObserver(position, {0.0f, 30.0f, 0.0f}));
+    }
 
     // Optional: Add trees for some occlusion on this side
     addTree(0.0f, 180.0f);
     addTree(-40.0f, 175.0f);
     addTree(40.0f, 175.0f);
 
-    core::MultiCameraCapture capture(&ctx, observers.size(), 800, 600);
+    core::MultiCameraCapture capture(&ctx, observers.size(), options.width, options.height);
+    bool layered_capture = options.layered;  // all cameras as layers of one texture array, one submit per frame
+    bool id_capture = options.ids;           // motion from an ID buffer of moving objects instead of colors
+    bool msaa = options.msaa;                // 4x MSAA instead of 2x supersampling, captures and debug view
+    core::PostProcessSettings capture_post_process;  // layered capture only
+    bool capture_culling = options.culling;  // frustum culling and LOD per camera
+    bool static_cache = options.static_cache;  // static objects rendered once per camera (per-camera capture)
+    float lod_pixel_error = 1.0f;
+    capture.setLayered(layered_capture);
+    if (msaa) {
+        capture.setAntiAliasing(1, core::Renderer::msaaSampleCount);
+    }
+    capture.setCulling(capture_culling, lod_pixel_error);
+    capture.setIdCapture(id_capture);
+    capture.setStaticCache(static_cache);
+
+    // The anti-aliasing benchmark needs two consecutive frames, the first one is kept here
+    bool run_capture_benchmark = false;
+    std::vector<scene::SceneObject> captureBenchmarkObjects;
     std::vector<cv::Mat> previousFrames(observers.size());
 
+    // CameraFrame per camera. With a difference from the capture (ID buffer, or layered capture
+    // differenced on the GPU), it is differenced against black instead of the previous frame
+    auto buildFrames = [&](const std::vector<scene::Camera>& cameras, const std::vector<cv::Mat>& currentFrames) {
+        const std::vector<cv::Mat>& gpuDifferences = capture.differences();
+        bool gpuDifference = (id_capture || (layered_capture && capture_post_process.difference))
+                             && !gpuDifferences.empty();
+        std::vector<CameraFrame> frames;
+        frames.reserve(observers.size());
+        for (size_t i = 0; i < observers.size(); ++i) {
+            if (gpuDifference) {
+                frames.push_back({cameras[i], gpuDifferences[i], cv::Mat::zeros(gpuDifferences[i].size(), CV_8UC1)});
+            } else {
+                frames.push_back({
+                    cameras[i],
+                    currentFrames[i],
+                    previousFrames[i].empty() ? currentFrames[i] : previousFrames[i]
+                });
+            }
+            previousFrames[i] = currentFrames[i].clone();
+        }
+        return frames;
+    };
+
 
     bool show_debug_viz = false;
     static int minVoxelDepth = 3;
@@ -262,37 +329,84 @@ int main() {
 
     ClusterTracker tracker;
 
+    // Only cluster detections confirmed over several frames (see OccupancyMap)
+    bool occupancy_filtering = false;
+    OccupancyMap occupancyMap(Voxel{{0.f, 0.f, 0.f}, 250.f});
+
+    // Learned suppression of persistent motion (insects, foliage), see PixelClutterMask and ClutterMap
+    bool clutter_suppression = false;
+    std::vector<PixelClutterMask> pixelClutter;
+    ClutterMap clutterMap(Voxel{{0.f, 0.f, 0.f}, 250.f});
+
+    // Camera frustum overlap over the zone, rebuilt only when the cameras move (see CoverageVolume)
+    bool coverage_culling = options.coverage;
+    std::shared_ptr<const CoverageVolume> coverage;
+    auto applyCoverage = [&](const std::vector<scene::Camera>& cameras, const Voxel& zone, DetectionConfig& config) {
+        if (!coverage_culling) return;
+        if (!coverage || !coverage->builtFor(cameras)) {
+            coverage = std::make_shared<CoverageVolume>(CoverageVolume::build(cameras, zone));
+        }
+        config.coverage = coverage;
+    };
 
-    float curr_simulation_time = 0.0f;
-    double avg_detection_time = 0.0;
-    double total_error = 0.0;
-    int frame_count = 0;
+    // Octree subdivision schedule (see SubdivisionSchedule)
+    const char* scheduleNames[] = {"Fixed 8", "Coarse to fine (8,4,2)", "Adaptive"};
+    std::vector<SubdivisionSchedule> schedules = {
+        SubdivisionSchedule::fixed(8),
+        SubdivisionSchedule::perDepth({8, 4, 2}),
+        SubdivisionSchedule::adaptive(),
+    };
+    static int scheduleIndex = 0;
+    bool run_schedule_benchmark = false;
 
-    // Initialize ImGui
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGui_ImplGlfw_InitForOther(debugWindow.handle, true);
-    ImGui_ImplWGPU_InitInfo info;
-    info.Device = ctx.device.Get();
-    info.NumFramesInFlight = 3;
-    info.RenderTargetFormat = static_cast<WGPUTextureFormat>(debugWindow.format);
-    info.DepthStencilFormat = static_cast<WGPUTextureFormat>(wgpu::TextureFormat::Depth24Plus);
-    ImGui_ImplWGPU_Init(&info);
+    // Wide rays: split into sub-rays or traversed as cones (see RayFootprintMode)
+    const char* footprintNames[] = {"Subdivide rays", "Cone traversal"};
+    static int footprintIndex = 0;
+    bool run_footprint_benchmark = false;
 
-    NoisePass noisepass;
-    noisepass.init(ctx.device, ctx.queue, renderer.format, wgpu::TextureFormat::Depth24Plus);
+    // One ray per moving pixel or per blob of moving pixels (see RayGrouping)
+    const char* groupingNames[] = {"Ray per pixel", "Ray per blob"};
+    static int groupingIndex = 0;
+    bool run_grouping_benchmark = false;
 
-    while (!debugWindow.shouldClose()) {
-    //while(time <= 0.02) {
-        glfwPollEvents();
-        if (show_debug_viz) {
-            debug_viz.rays.clear();
-            debug_viz.voxels.clear();
-        }
+    // Cast rays from a coarse motion pyramid level and refine them per node (see MotionPyramid)
+    static int motionPyramidLevels = 0;
+    bool run_pyramid_benchmark = false;
 
-        double curr_real_time = glfwGetTime();
-        frame_count++;
+    // Cast rays through moving pixels or project voxels into the motion masks (see DetectionMode)
+    const char* detectionModeNames[] = {"Ray casting", "Voxel projection"};
+    static int detectionModeIndex = 0;
+    bool run_mode_benchmark = false;
+
+    // Threads descending the octree below the root, detections gathered in a core::AppendBuffer;
+    // clustering and tracking use as many
+    static int descentThreads = options.descent_threads;
+    bool run_append_benchmark = false;
+
+    // Cluster on the Morton keyed linear octree instead of comparing all voxel pairs
+    bool linear_octree_clustering = false;
+
+    // Least-squares triangulation of the cluster centroids from their rays (see refineClusterCentroids)
+    bool refine_centroids = false;
+    bool run_refinement_benchmark = false;
+
+    // Staged detection: frame N is detected while frame N+1 is rendered, results lag a few frames
+    bool pipelined_detection = options.pipelined;
+    bool pipeline_drop_frames = false;
+    std::unique_ptr<DetectionPipeline> detectionPipeline;
+    PipelineFrame lastPipelineResult;
+
+    // Ground truth per frame, to score results that come back late from the pipeline
+    std::vector<Eigen::Vector3f> droneHistory(64, Eigen::Vector3f::Zero());
 
+
+    float curr_simulation_time = 0.0f;
+    double avg_detection_time = 0.0;
+    double total_error = 0.0;
+    int frame_count = 0;
+
+    // Moves the drone and the insects one frame forward
+    auto advanceScene = [&]() {
         curr_simulation_time += 0.016f;
 
         // Drone flies in circle
@@ -306,30 +420,190 @@ int main() {
             radius * std::sin(curr_simulation_time * speed)
         );
         objects[droneIndex].transform.setEulerAngles(0.0f, -curr_simulation_time * speed, 0.0f);
+        droneHistory[frame_count % droneHistory.size()] = objects[droneIndex].transform.position;
 
         for (auto& observer : observers) {
             observer.update();
         }
+    };
 
-        // Collect cameras
+    auto collectCameras = [&]() {
         std::vector<scene::Camera> cameras;
         cameras.reserve(observers.size());
         for (auto& observer : observers) {
             cameras.push_back(observer.getCamera());
         }
+        return cameras;
+    };
 
-        // Gather all objects including insects from all observers
+    // All objects including insects from all observers
+    auto gatherObjects = [&]() {
         std::vector<scene::SceneObject> allObjects = objects;
         for (auto& observer : observers) {
             const auto& insects = observer.getInsects();
             allObjects.insert(allObjects.end(), insects.begin(), insects.end());
         }
+        return allObjects;
+    };
+
+    // Initialize ImGui
+    if (debugWindow) {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGui_ImplGlfw_InitForOther(debugWindow->handle, true);
+        ImGui_ImplWGPU_InitInfo info;
+        info.Device = ctx.device.Get();
+        info.NumFramesInFlight = 3;
+        info.RenderTargetFormat = static_cast<WGPUTextureFormat>(debugWindow->format);
+        info.DepthStencilFormat = static_cast<WGPUTextureFormat>(wgpu::TextureFormat::Depth24Plus);
+        ImGui_ImplWGPU_Init(&info);
+    }
+
+    NoisePass noisepass;
+    noisepass.init(ctx.device, ctx.queue, *ctx.shaders, renderer.format, wgpu::TextureFormat::Depth24Plus);
+
+    auto startupEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Startup: " << std::chrono::duration<double, std::milli>(startupEnd - startupBegin).count() << " ms, "
+              << ctx.shaders->moduleCount() << " shader modules, " << ctx.shaders->pipelineCount() << " pipelines ("
+              << ctx.shaders->reusedCount() << " reused)";
+    if (ctx.blobCache) {
+        std::cout << ", shader cache " << ctx.blobCache->directory().string() << ": " << ctx.blobCache->hits()
+                  << " hits, " << ctx.blobCache->misses() << " misses, " << ctx.blobCache->stores() << " stored\n";
+    } else {
+        std::cout << ", shader cache off\n";
+    }
+    std::cout << "Materials: " << materials.size() << ", textures " << textureCache.hits() << " from cache, "
+              << textureCache.misses() << " decoded\n";
+
+    // Headless: capture and detect options.frames frames as fast as possible with the options of
+    // the command line, then print the throughput. No debug view, benchmarks or ImGui.
+    if (options.headless) {
+        Voxel target_zone = Voxel{{0.f, 0.f, 0.f}, 250.f};
+        DetectionConfig detection_config;
+        detection_config.min_voxel_size = 0.1f;
+        detection_config.min_ray_threshold = 3;
+        detection_config.descent_threads = descentThreads;
+
+        if (pipelined_detection) {
+            DetectionPipeline::Config pipelineConfig;
+            pipelineConfig.target_zone = target_zone;
+            pipelineConfig.detection = detection_config;
+            detectionPipeline = std::make_unique<DetectionPipeline>(pipelineConfig);
+        }
+
+        double capture_ms = 0.0;
+        double detection_ms = 0.0;
+        int scored_frames = 0;
+        auto score = [&](const std::vector<TimestampedPosition>& tracked_positions) {
+            if (tracked_positions.empty()) return;
+            const auto& tracked = tracked_positions[0];
+            total_error += (tracked.position - droneHistory[tracked.frame % droneHistory.size()]).norm();
+            scored_frames++;
+        };
+
+        auto runBegin = std::chrono::high_resolution_clock::now();
+        while (frame_count < options.frames) {
+            frame_count++;
+            advanceScene();
+            std::vector<scene::Camera> cameras = collectCameras();
+            std::vector<scene::SceneObject> allObjects = gatherObjects();
+            if (coverage_culling) {
+                applyCoverage(cameras, target_zone, detection_config);
+                if (detectionPipeline) {
+                    detectionPipeline->setDetectionConfig(detection_config);
+                }
+            }
+
+            auto captureBegin = std::chrono::high_resolution_clock::now();
+            capture.renderAll(cameras, allObjects, renderer);
+            capture.downsampleAll(curr_simulation_time, 0);
+            capture.copyAll();
+            capture.sync();
+            std::vector<cv::Mat> currentFrames = capture.readAll();
+            auto captureEnd = std::chrono::high_resolution_clock::now();
+            capture_ms += std::chrono::duration<double, std::milli>(captureEnd - captureBegin).count();
+
+            std::vector<CameraFrame> frames = buildFrames(cameras, currentFrames);
+
+            if (detectionPipeline) {
+                detectionPipeline->submit(frame_count, std::move(frames));
+                if (detectionPipeline->pollLatest(lastPipelineResult)) {
+                    score(lastPipelineResult.confirmed_positions);
+                }
+            } else {
+                auto start = std::chrono::high_resolution_clock::now();
+                std::vector<Voxel> detections = detect_objects(target_zone, frames, detection_config);
+                tracker.update(clusterDetections(detections, detection_config.min_voxel_size, 2.5f, 3, descentThreads),
+                               frame_count, descentThreads);
+                auto end = std::chrono::high_resolution_clock::now();
+                detection_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+                std::vector<TimestampedPosition> tracked_positions;
+                for (const Track* track : tracker.getConfirmedTracks()) {
+                    tracked_positions.push_back(track->positions.back());
+                }
+                score(tracked_positions);
+            }
+            ctx.processEvents();
+        }
+
+        // The pipeline lags a few frames behind the captures
+        while (detectionPipeline && lastPipelineResult.frame < static_cast<size_t>(options.frames)
+               && detectionPipeline->waitNext(lastPipelineResult)) {
+            score(lastPipelineResult.confirmed_positions);
+        }
+        auto runEnd = std::chrono::high_resolution_clock::now();
+        double run_s = std::chrono::duration<double>(runEnd - runBegin).count();
+
+        std::printf("Headless: %d frames, %zu cameras at %ux%u, %.1f fps\n",
+                    frame_count, observers.size(), options.width, options.height, frame_count / run_s);
+        std::printf("  capture %.2f ms/frame", capture_ms / frame_count);
+        if (detectionPipeline) {
+            std::printf(", detection stages: motion %.2f ms, voting %.2f ms, tracking %.2f ms\n",
+                        detectionPipeline->stageMs(DetectionPipeline::MotionExtraction),
+                        detectionPipeline->stageMs(DetectionPipeline::VoxelVoting),
+                        detectionPipeline->stageMs(DetectionPipeline::ClusteringTracking));
+        } else {
+            std::printf(", detection %.2f ms/frame\n", detection_ms / frame_count);
+        }
+        if (scored_frames > 0) {
+            std::printf("  mean error %.3f m over %d tracked frames\n", total_error / scored_frames, scored_frames);
+        } else {
+            std::printf("  no track\n");
+        }
+        return 0;
+    }
+
+    while (!debugWindow->shouldClose() && (options.frames == 0 || frame_count < options.frames)) {
+    //while(time <= 0.02) {
+        glfwPollEvents();
+        if (show_debug_viz && !pipelined_detection) {
+            debug_viz.clear();
+        }
+        debug_viz.min_voxel_depth = minVoxelDepth;
+
+        double curr_real_time = glfwGetTime();
+        frame_count++;
+
+        advanceScene();
+        std::vector<scene::Camera> cameras = collectCameras();
+        std::vector<scene::SceneObject> allObjects = gatherObjects();
+
+        if (run_capture_benchmark && captureBenchmarkObjects.empty()) {
+            captureBenchmarkObjects = allObjects;
+        } else if (run_capture_benchmark) {
+            run_capture_benchmark = false;
+            std::cout << "Capture anti-aliasing, frame " << frame_count << ":\n";
+            printCaptureBenchmark(benchmarkCaptureAntiAliasing(&ctx, renderer, cameras, captureBenchmarkObjects,
+                                                               allObjects, options.width, options.height));
+            captureBenchmarkObjects.clear();
+        }
 
         // Render all frames in parallel
         capture.renderAll(cameras, allObjects, renderer);
-        capture.downsampleAll();
+        capture.downsampleAll(curr_real_time, 0);
 
-        // Uncomment this for noise
+        // Uncomment this for noise (per-camera capture, layered capture has it in setPostProcess)
         // auto enc = ctx.device.CreateCommandEncoder();
         // capture.noiseAll(enc, noisepass, curr_real_time, 0);
         // auto command = enc.Finish();
@@ -339,38 +613,160 @@ int main() {
         capture.sync();
         std::vector<cv::Mat> currentFrames = capture.readAll();
 
-        // Build CameraFrame array
-        std::vector<CameraFrame> frames;
-        frames.reserve(observers.size());
-        for (size_t i = 0; i < observers.size(); ++i) {
-            frames.push_back({
-                cameras[i],
-                currentFrames[i],
-                previousFrames[i].empty() ? currentFrames[i] : previousFrames[i]
-            });
-            previousFrames[i] = currentFrames[i].clone();
-        }
+        std::vector<CameraFrame> frames = buildFrames(cameras, currentFrames);
 
         // Detection
         Voxel target_zone = Voxel{{0.f, 0.f, 0.f}, 250.f};
         float min_voxel_size = 0.1f;
         size_t min_ray_threshold = 3;
 
-        auto start = std::chrono::high_resolution_clock::now();
-        auto detections = detect_objects(target_zone, frames, min_voxel_size, min_ray_threshold, 8, show_debug_viz ? &debug_viz : nullptr);
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        DetectionConfig detection_config;
+        detection_config.min_voxel_size = min_voxel_size;
+        detection_config.min_ray_threshold = min_ray_threshold;
+        detection_config.schedule = schedules[scheduleIndex];
+        detection_config.footprint_mode = static_cast<RayFootprintMode>(footprintIndex);
+        detection_config.ray_grouping = static_cast<RayGrouping>(groupingIndex);
+        detection_config.motion_pyramid_levels = motionPyramidLevels;
+        detection_config.mode = static_cast<DetectionMode>(detectionModeIndex);
+        detection_config.descent_threads = descentThreads;
+        applyCoverage(cameras, target_zone, detection_config);
+
+        if (run_schedule_benchmark) {
+            run_schedule_benchmark = false;
+            std::cout << "Schedule sweep, frame " << frame_count << ":\n";
+            printBenchmark(benchmarkDetection(target_zone, frames, scheduleSweep(detection_config)));
+        }
+        if (run_footprint_benchmark) {
+            run_footprint_benchmark = false;
+            std::cout << "Footprint sweep, frame " << frame_count << ":\n";
+            printBenchmark(benchmarkDetection(target_zone, frames, footprintSweep(detection_config), 3,
+                                              &objects[droneIndex].transform.position));
+        }
+        if (run_grouping_benchmark) {
+            run_grouping_benchmark = false;
+            std::cout << "Ray grouping sweep, frame " << frame_count << ":\n";
+            printBenchmark(benchmarkDetection(target_zone, frames, groupingSweep(detection_config), 3,
+                                              &objects[droneIndex].transform.position));
+        }
+        if (run_pyramid_benchmark) {
+            run_pyramid_benchmark = false;
+            std::cout << "Motion pyramid sweep, frame " << frame_count << ":\n";
+            printBenchmark(benchmarkDetection(target_zone, frames, pyramidSweep(detection_config), 3,
+                                              &objects[droneIndex].transform.position));
+        }
+        if (run_mode_benchmark) {
+            run_mode_benchmark = false;
+            std::cout << "Detection mode crossover (motion dilated by N pixels), frame " << frame_count << ":\n";
+            printBenchmark(benchmarkModeCrossover(target_zone, frames, detection_config, {0, 1, 2, 4, 8}, 1,
+                                                  &objects[droneIndex].transform.position));
+        }
+        if (run_refinement_benchmark) {
+            run_refinement_benchmark = false;
+            std::cout << "Voxel size sweep, voxel centroids then refined centroids, frame " << frame_count << ":\n";
+            auto configs = voxelSizeSweep(detection_config);
+            printBenchmark(benchmarkDetection(target_zone, frames, configs, 1, &objects[droneIndex].transform.position));
+            printBenchmark(benchmarkDetection(target_zone, frames, configs, 1, &objects[droneIndex].transform.position, true));
+        }
+        if (run_append_benchmark) {
+            run_append_benchmark = false;
+            std::cout << "Append buffer contention:\n";
+            core::printAppendBenchmark(core::benchmarkAppendBuffer());
+        }
 
-        auto clusters = clusterDetections(detections, min_voxel_size);
+        std::vector<Voxel> detections;
+        std::vector<Cluster> clusters;
+        std::vector<TimestampedPosition> tracked_positions;  // last position of each confirmed track
+        DetectionStats detection_stats;
+
+        if (pipelined_detection) {
+            if (!detectionPipeline) {
+                DetectionPipeline::Config pipelineConfig;
+                pipelineConfig.target_zone = target_zone;
+                pipelineConfig.detection = detection_config;
+                pipelineConfig.overflow = pipeline_drop_frames ? core::OverflowPolicy::DropOldest
+                                                               : core::OverflowPolicy::Block;
+                detectionPipeline = std::make_unique<DetectionPipeline>(pipelineConfig);
+                lastPipelineResult = PipelineFrame{};
+            }
+            detectionPipeline->setDetectionConfig(detection_config);
+            detectionPipeline->setOccupancyFiltering(occupancy_filtering);
+            detectionPipeline->setClutterSuppression(clutter_suppression);
+            detectionPipeline->setCentroidRefinement(refine_centroids);
+            detectionPipeline->setDebugMinVoxelDepth(minVoxelDepth);
+            detectionPipeline->submit(frame_count, std::move(frames), show_debug_viz);
+
+            PipelineFrame result;
+            if (detectionPipeline->pollLatest(result)) {
+                lastPipelineResult = std::move(result);
+                if (show_debug_viz) {
+                    debug_viz = lastPipelineResult.debug_viz;
+                }
+            }
 
+            detections = lastPipelineResult.detections;
+            clusters = lastPipelineResult.clusters;
+            tracked_positions = lastPipelineResult.confirmed_positions;
+            detection_stats = lastPipelineResult.stats;
+        } else {
+            detectionPipeline.reset();
 
-        tracker.update(clusters, frame_count);
+            if (clutter_suppression) {
+                detection_config.clutter = clutterMap.cells();
+            }
 
-        auto confirmed_tracks = tracker.getConfirmedTracks();
+            // Same as detect_objects, keeping the rays for the centroid refinement
+            std::vector<Ray> rays;
+            auto start = std::chrono::high_resolution_clock::now();
+            if (refine_centroids && detection_config.mode == DetectionMode::RayCasting) {
+                detection_config.record_votes = true;
+                std::vector<MotionPyramid> pyramids;
+                rays = extractMotionRays(frames, detection_config, clutter_suppression ? &pixelClutter : nullptr, &pyramids);
+                detections = detect_objects_from_rays(target_zone, rays, detection_config, show_debug_viz ? &debug_viz : nullptr,
+                                                      &detection_stats, pyramids.empty() ? nullptr : &pyramids);
+            } else {
+                detections = detect_objects(target_zone, frames, detection_config, show_debug_viz ? &debug_viz : nullptr, &detection_stats,
+                                            clutter_suppression ? &pixelClutter : nullptr);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
+            if (clutter_suppression) {
+                clutterMap.update(detections, detection_stats.clutter_hits);
+            }
 
+            if (occupancy_filtering) {
+                occupancyMap.update(detections);
+                detections = occupancyMap.filter(detections);
+            }
 
-        avg_detection_time += (duration.count() - avg_detection_time) / frame_count;
+            if (linear_octree_clustering) {
+                clusters = clusterDetections(toLinearOctree(detections, target_zone, min_voxel_size), min_voxel_size);
+            } else {
+                clusters = clusterDetections(detections, min_voxel_size, 2.5f, 3, descentThreads);
+            }
+            if (!rays.empty()) {
+                refineClusterCentroids(clusters, rays, detection_stats.votes, min_ray_threshold);
+            }
+
+
+            tracker.update(clusters, frame_count, descentThreads);
+
+            if (clutter_suppression) {
+                std::vector<Eigen::Vector3f> centroids;
+                for (const auto& cluster : clusters) {
+                    centroids.push_back(cluster.centroid);
+                }
+                for (size_t i = 0; i < pixelClutter.size(); ++i) {
+                    pixelClutter[i].protect(frames[i].camera, centroids, frames[i].current_frame.cols, frames[i].current_frame.rows);
+                }
+            }
+
+            for (const Track* track : tracker.getConfirmedTracks()) {
+                tracked_positions.push_back(track->positions.back());
+            }
+
+            avg_detection_time += (duration.count() - avg_detection_time) / frame_count;
+        }
 
 
         // Compute centroid (even if empty, for safe debug rendering)
@@ -381,13 +777,8 @@ int main() {
             float rayLength = 1000.0f;
             float rayThickness = 0.1f;
 
-            // Limit to avoid GPU overload
-            const size_t MAX_DEBUG_RAYS = 500;
-            size_t rayCount = debug_viz.rays.size();
-            size_t step = std::max(size_t(1), rayCount / MAX_DEBUG_RAYS);
-
-            for (size_t i = 0; i < rayCount; i += step) {
-                const auto& ray_info = debug_viz.rays[i];
+            // Already capped by the recorder (DebugVisualization::max_rays, max_voxels, min_voxel_depth)
+            for (const auto& ray_info : debug_viz.rays) {
                 scene::Transform rayTransform;
 
                 Eigen::Vector3f dir = ray_info.ray.direction.normalized();
@@ -412,14 +803,13 @@ int main() {
 
                 std::shared_ptr<Material> rayMaterial;
                 if (ray_info.contributed_to_detection) {
-                    rayMaterial = cameraRayMaterials[ray_info.camera_id];
+                    rayMaterial = cameraRayMaterials[ray_info.camera_id % cameraRayMaterials.size()];
                     debugObjects.push_back({rayLineMesh, rayTransform, rayMaterial});
                 }
 
             }
 
             for (const auto& voxel_info : debug_viz.voxels) {
-                if (voxel_info.depth < minVoxelDepth) continue;
                 scene::Transform voxelTransform;
                 voxelTransform.position = voxel_info.voxel.center;
                 float size = voxel_info.voxel.half_size * 2.0f;
@@ -431,7 +821,7 @@ int main() {
         }
 
         // Debug window rendering (always runs)
-        auto surfaceTextureView = debugWindow.getCurrentTextureView();
+        auto surfaceTextureView = debugWindow->getCurrentTextureView();
 
         ImGui_ImplGlfw_NewFrame();
         ImGui_ImplWGPU_NewFrame();
@@ -440,12 +830,106 @@ int main() {
         ImGui::Begin("Stats");
         ImGui::Checkbox("Show Debug Visualization", &show_debug_viz);
         ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate);
-        ImGui::Text("Detection time: %.2f ms", avg_detection_time / 1000.0);
+        if (ImGui::Checkbox("Layered capture", &layered_capture)) {
+            capture.setLayered(layered_capture);
+        }
+        if (ImGui::Checkbox("ID buffer capture (exact motion, no shading)", &id_capture)) {
+            capture.setIdCapture(id_capture);
+        }
+        if (ImGui::Checkbox("MSAA 4x (instead of 2x supersampling)", &msaa)) {
+            capture.setAntiAliasing(msaa ? 1 : 2, msaa ? core::Renderer::msaaSampleCount : 1);
+        }
+        if (layered_capture) {
+            bool changed = ImGui::SliderFloat("Capture noise", &capture_post_process.noise, 0.0f, 1.0f);
+            changed |= ImGui::Checkbox("Difference on GPU", &capture_post_process.difference);
+            if (changed) {
+                capture.setPostProcess(capture_post_process);
+            }
+        }
+        bool culling_changed = ImGui::Checkbox("Frustum culling + LOD", &capture_culling);
+        if (capture_culling) {
+            culling_changed |= ImGui::SliderFloat("LOD pixel error", &lod_pixel_error, 0.0f, 4.0f);
+            const auto& culling = capture.cullingStats();
+            ImGui::Text("Drawn: %zu / %zu objects, %.1fM / %.1fM indices",
+                        culling.drawnObjects, culling.totalObjects,
+                        culling.drawnIndices / 1e6, culling.totalIndices / 1e6);
+        }
+        if (culling_changed) {
+            capture.setCulling(capture_culling, lod_pixel_error);
+        }
+        if (ImGui::Checkbox("Static scene cache", &static_cache)) {
+            capture.setStaticCache(static_cache);
+        }
+        if (static_cache) {
+            const auto& cached = capture.staticCacheStats();
+            ImGui::Text("Static renders: %zu reused, %zu redone", cached.reused, cached.rendered);
+        }
+        if (ImGui::Button("Benchmark anti-aliasing")) {
+            run_capture_benchmark = true;
+        }
+        if (ImGui::Checkbox("Pipelined detection", &pipelined_detection) && !pipelined_detection) {
+            debug_viz = DebugVisualization{};
+        }
+        if (ImGui::Checkbox("Drop frames when saturated", &pipeline_drop_frames)) {
+            detectionPipeline.reset();  // rebuilt with the new policy on the next frame
+        }
+        if (detectionPipeline) {
+            ImGui::Text("Stages: motion %.2f ms, voting %.2f ms, tracking %.2f ms",
+                        detectionPipeline->stageMs(DetectionPipeline::MotionExtraction),
+                        detectionPipeline->stageMs(DetectionPipeline::VoxelVoting),
+                        detectionPipeline->stageMs(DetectionPipeline::ClusteringTracking));
+            ImGui::Text("Result lag: %d frames, dropped: %zu",
+                        frame_count - static_cast<int>(lastPipelineResult.frame),
+                        detectionPipeline->droppedFrames());
+        } else {
+            ImGui::Text("Detection time: %.2f ms", avg_detection_time / 1000.0);
+        }
         ImGui::Text("Detections: %zu", detections.size());
+        ImGui::Text("Rays: %zu, nodes visited: %zu", detection_stats.ray_count, detection_stats.nodes_visited);
+        ImGui::Combo("Subdivision", &scheduleIndex, scheduleNames, IM_ARRAYSIZE(scheduleNames));
+        if (ImGui::Button("Benchmark schedules")) {
+            run_schedule_benchmark = true;
+        }
+        ImGui::Combo("Wide rays", &footprintIndex, footprintNames, IM_ARRAYSIZE(footprintNames));
+        if (ImGui::Button("Benchmark footprint modes")) {
+            run_footprint_benchmark = true;
+        }
+        ImGui::Combo("Ray grouping", &groupingIndex, groupingNames, IM_ARRAYSIZE(groupingNames));
+        if (ImGui::Button("Benchmark ray grouping")) {
+            run_grouping_benchmark = true;
+        }
+        ImGui::SliderInt("Motion pyramid levels", &motionPyramidLevels, 0, 4);
+        if (ImGui::Button("Benchmark motion pyramid")) {
+            run_pyramid_benchmark = true;
+        }
+        ImGui::Text("Pyramid rays refined: %zu", detection_stats.pyramid_rays_refined);
+        ImGui::Combo("Detection mode", &detectionModeIndex, detectionModeNames, IM_ARRAYSIZE(detectionModeNames));
+        if (ImGui::Button("Benchmark mode crossover")) {
+            run_mode_benchmark = true;
+        }
+        ImGui::SliderInt("Descent threads", &descentThreads, 1, 16);
+        if (ImGui::Button("Benchmark append buffer")) {
+            run_append_benchmark = true;
+        }
         ImGui::Text("Clusters: %zu", clusters.size());
-        if (!confirmed_tracks.empty()) {
-            auto tracked_position = confirmed_tracks[0]->positions.back().position;
-            auto error = (tracked_position - objects[droneIndex].transform.position).norm();
+        ImGui::Checkbox("Linear octree clustering", &linear_octree_clustering);
+        ImGui::Checkbox("Refine centroids", &refine_centroids);
+        if (ImGui::Button("Benchmark centroid refinement")) {
+            run_refinement_benchmark = true;
+        }
+        if (ImGui::Checkbox("Occupancy filtering", &occupancy_filtering)) {
+            occupancyMap.clear();
+        }
+        if (ImGui::Checkbox("Clutter suppression", &clutter_suppression)) {
+            pixelClutter.clear();
+            clutterMap.clear();
+        }
+        ImGui::Text("Clutter skipped nodes: %zu", detection_stats.clutter_hits.size());
+        ImGui::Checkbox("Coverage pre-culling", &coverage_culling);
+        ImGui::Text("Rays outside coverage: %zu", detection_stats.rays_outside_coverage);
+        if (!tracked_positions.empty()) {
+            const auto& tracked = tracked_positions[0];
+            auto error = (tracked.position - droneHistory[tracked.frame % droneHistory.size()]).norm();
             total_error += error;
             ImGui::Text("Error: %.3f m", error);
         } else {
@@ -454,8 +938,8 @@ int main() {
         ImGui::SliderInt("Min Voxel Depth", &minVoxelDepth, 0, 10);
         ImGui::End();
 
-        if (debugWindow.activeCamera > 0 && debugWindow.activeCamera <= static_cast<int>(observers.size())) {
-            auto activeCamera = observers[debugWindow.activeCamera - 1].getCamera();
+        if (debugWindow->activeCamera > 0 && debugWindow->activeCamera <= static_cast<int>(observers.size())) {
+            auto activeCamera = observers[debugWindow->activeCamera - 1].getCamera();
 #ifdef Debug
             auto viewProjection = activeCamera.getViewProjectionMatrix();
 
@@ -492,10 +976,16 @@ int main() {
                 renderObjects.insert(renderObjects.end(), debugObjects.begin(), debugObjects.end());
             }
 
-            renderer.renderScene(renderObjects, activeCamera, debugDepthView, debugRenderView, false);
-            debugDownsampler.downsample(debugRenderView, surfaceTextureView, surfaceWidth, surfaceHeight);
+            if (msaa) {
+                renderer.renderScene(renderObjects, activeCamera, debugMsaaDepthView, debugMsaaView, false, surfaceTextureView);
+            } else {
+                renderer.renderScene(renderObjects, activeCamera, debugDepthView, debugRenderView, false);
+            }
 
             auto enc = ctx.device.CreateCommandEncoder();
+            if (!msaa) {
+                debugDownsampler->downsample(enc, debugDownsampleBindGroup, surfaceTextureView, surfaceWidth, surfaceHeight);
+            }
             noisepass.render(enc, surfaceTextureView, fbWidth, fbHeight, curr_real_time, 0);
             auto command = enc.Finish();
             ctx.queue.Submit(1, &command);
@@ -505,7 +995,7 @@ int main() {
             renderer.renderImgui(depthView, surfaceTextureView, true);  // clear=true since no scene rendered
         }
 
-        debugWindow.present();
+        debugWindow->present();
         ctx.processEvents();
     }
 
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include "core/context.hpp"
+
+/**
+ * Command line of main. Every option is also reachable from the UI except the ones fixed at
+ * startup (headless, adapter, cameras, resolution, shader cache).
+ */
+struct RunOptions {
+    bool headless = false;       // no window, surface or ImGui: capture and detect, print a summary
+    core::AdapterPreference adapter = core::AdapterPreference::Default;
+    int cameras = 5;             // observation cameras on a circle around the zone
+    uint32_t width = 800;        // capture resolution per camera
+    uint32_t height = 600;
+    int frames = 0;              // stop after this many frames, 0: until the window closes (headless: 300)
+    bool shader_cache = true;    // shaders, pipelines and decoded textures kept in .cache
+    bool layered = false;        // see MultiCameraCapture::setLayered
+    bool ids = false;            // see MultiCameraCapture::setIdCapture
+    bool msaa = false;           // 4x MSAA instead of 2x supersampling
+    bool culling = false;        // see MultiCameraCapture::setCulling
+    bool static_cache = false;   // see MultiCameraCapture::setStaticCache
+    bool pipelined = false;      // see DetectionPipeline
+    int descent_threads = 1;     // see DetectionConfig::descent_threads
+    bool coverage = false;       // see CoverageVolume
+    bool help = false;           // --help was given, nothing to run
+};
+
+inline void printUsage(const char* program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "  --headless               no window: capture and detect --frames frames, then print throughput\n"
+        "  --adapter <preference>   default, high-performance, low-power, prefer-software or software\n"
+        "                           (software is SwiftShader, for machines without a GPU)\n"
+        "  --cameras <n>            observation cameras (default 5)\n"
+        "  --width <px>             capture width per camera (default 800)\n"
+        "  --height <px>            capture height per camera (default 600)\n"
+        "  --frames <n>             frames to run, 0 runs until the window closes (headless default 300)\n"
+        "  --layered                layered multi-view capture\n"
+        "  --ids                    ID buffer capture: motion of moving objects only, exact and unshaded\n"
+        "  --msaa                   4x MSAA capture instead of 2x supersampling\n"
+        "  --culling                frustum culling and LOD in the captures\n"
+        "  --static-cache           render static objects once per camera, then only moving ones\n"
+        "  --pipelined              staged detection pipeline\n"
+        "  --descent-threads <n>    octree descent threads (default 1)\n"
+        "  --coverage               drop ray segments outside the overlap of the camera frustums\n"
+        "  --no-shader-cache        compile every shader and pipeline and decode every texture, as on a first run\n"
+        "  --help\n",
+        program);
+}
+
+/**
+ * Parses "--option value" and "--option=value" arguments into options.
+ * Returns false, after printing why, on an unknown option or a bad value; also on --help, which
+ * sets RunOptions::help.
+ */
+inline bool parseRunOptions(int argc, char** argv, RunOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value;
+        bool hasValue = false;
+        if (size_t equals = arg.find('='); equals != std::string::npos) {
+            value = arg.substr(equals + 1);
+            arg = arg.substr(0, equals);
+            hasValue = true;
+        }
+
+        auto next = [&](std::string& out) {
+            if (hasValue) {
+                out = value;
+                return true;
+            }
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "%s needs a value\n", arg.c_str());
+                return false;
+            }
+            out = argv[++i];
+            return true;
+        };
+        // Integer in [min, max of the option's type]
+        auto count = [&](auto& out, long min) {
+            using T = std::remove_reference_t<decltype(out)>;
+            std::string text;
+            if (!next(text)) return false;
+            char* end = nullptr;
+            errno = 0;
+            long number = std::strtol(text.c_str(), &end, 10);
+            if (end == text.c_str() || *end != '\0') {
+                std::fprintf(stderr, "%s: not a count: %s\n", arg.c_str(), text.c_str());
+                return false;
+            }
+            if (errno == ERANGE || number < min || static_cast<unsigned long>(number) > std::numeric_limits<T>::max()) {
+                std::fprintf(stderr, "%s: %s is out of range [%ld, %llu]\n", arg.c_str(), text.c_str(), min,
+                             static_cast<unsigned long long>(std::numeric_limits<T>::max()));
+                return false;
+            }
+            out = static_cast<T>(number);
+            return true;
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            options.help = true;
+            return false;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--adapter") {
+            std::string name;
+            if (!next(name)) return false;
+            if (name == "default") options.adapter = core::AdapterPreference::Default;
+            else if (name == "high-performance") options.adapter = core::AdapterPreference::HighPerformance;
+            else if (name == "low-power") options.adapter = core::AdapterPreference::LowPower;
+            else if (name == "prefer-software") options.adapter = core::AdapterPreference::PreferSoftware;
+            else if (name == "software") options.adapter = core::AdapterPreference::ForceSoftware;
+            else {
+                std::fprintf(stderr, "Unknown adapter preference: %s\n", name.c_str());
+                return false;
+            }
+        } else if (arg == "--cameras") {
+            if (!count(options.cameras, 1)) return false;
+        } else if (arg == "--width") {
+            if (!count(options.width, 1)) return false;
+        } else if (arg == "--height") {
+            if (!count(options.height, 1)) return false;
+        } else if (arg == "--frames") {
+            if (!count(options.frames, 0)) return false;
+        } else if (arg == "--descent-threads") {
+            if (!count(options.descent_threads, 1)) return false;
+        } else if (arg == "--layered") {
+            options.layered = true;
+        } else if (arg == "--ids") {
+            options.ids = true;
+        } else if (arg == "--msaa") {
+            options.msaa = true;
+        } else if (arg == "--culling") {
+            options.culling = true;
+        } else if (arg == "--static-cache") {
+            options.static_cache = true;
+        } else if (arg == "--pipelined") {
+            options.pipelined = true;
+        } else if (arg == "--coverage") {
+            options.coverage = true;
+        } else if (arg == "--no-shader-cache") {
+            options.shader_cache = false;
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.cameras < 1 || options.width == 0 || options.height == 0) {
+        std::fprintf(stderr, "Needs at least one camera and a non-empty resolution\n");
+        return false;
+    }
+    if (options.headless && options.frames == 0) {
+        options.frames = 300;
+    }
+    return true;
+}
@@ -45,7 +45,7 @@ public:
             );
             t.scale = Eigen::Vector3f(config.insectSize, config.insectSize, config.insectSize);
 
-            insects_.push_back({mesh, t, material});
+            insects_.push_back({mesh, t, material, true});
         }
     }
 
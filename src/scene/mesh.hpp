@@ -2,7 +2,12 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 
 #include <vector>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <numeric>
 #include <webgpu/webgpu_cpp.h>
+#include <Eigen/Geometry>
 #include "tiny_obj_loader.h"
 #include <ranges>
 
@@ -20,12 +25,27 @@ public:
     wgpu::Buffer indexBuffer;
     uint32_t indexCount = 0;
 
+    // Local space bounding box of the vertices, for culling (see SceneBVH)
+    Eigen::AlignedBox3f bounds;
+
+    // Simplified versions of the mesh, coarsest last
+    struct Lod {
+        std::shared_ptr<Mesh> mesh;
+        float error;  // local space, vertices moved by up to this much
+    };
+    std::vector<Lod> lods;
+
     void upload(wgpu::Device device, wgpu::Queue queue,
                 const std::vector<Vertex>& vertices,
                 const std::vector<uint16_t>& indices) {
         
         indexCount = static_cast<uint32_t>(indices.size());
 
+        bounds.setEmpty();
+        for (const auto& vertex : vertices) {
+            bounds.extend(Eigen::Vector3f(vertex.position[0], vertex.position[1], vertex.position[2]));
+        }
+
         // Create vertex buffer
         wgpu::BufferDescriptor vbDesc{
             .label = "Vertex buffer",
@@ -45,7 +65,8 @@ public:
         queue.WriteBuffer(indexBuffer, 0, indices.data(), indices.size() * sizeof(uint16_t));
     }
 
-    static Mesh createMesh(std::string path, wgpu::Device device, wgpu::Queue queue){
+    // With lodLevels > 0, also generates that many simplified meshes (see generateLods)
+    static Mesh createMesh(std::string path, wgpu::Device device, wgpu::Queue queue, int lodLevels = 0){
         tinyobj::ObjReaderConfig reader_config;
         tinyobj::ObjReader reader;
 
@@ -95,9 +116,59 @@ public:
 
         Mesh mesh;
         mesh.upload(device, queue, vertices, indices);
+        if (lodLevels > 0) {
+            mesh.generateLods(device, queue, vertices, indices, lodLevels);
+        }
         return mesh;
     }
 
+    /**
+     * Fills lods by vertex clustering: vertices are snapped to a grid spanning the bounds,
+     * merged per cell and UV chart (averaged position, color and UV) and the triangles that
+     * collapse are dropped. A chart is a set of triangles connected through shared vertices, so
+     * UVs are only averaged along a continuous parameterization: the two sides of a seam
+     * (vertices duplicated with other UVs) or two leaf cards in the same cell stay apart, and the
+     * error bound of the positions holds for what is textured on them. Level k uses a grid of baseResolution >> k cells along the largest side; levels
+     * that remove less than a quarter of the triangles of the previous one are skipped.
+     *
+     * Args:
+     * - vertices, indices: what was uploaded
+     * - levels: simplified meshes to try
+     * - baseResolution: grid cells along the largest side of the finest level
+     */
+    void generateLods(wgpu::Device device, wgpu::Queue queue,
+                      const std::vector<Vertex>& vertices,
+                      const std::vector<uint16_t>& indices,
+                      int levels, int baseResolution = 64) {
+        lods.clear();
+        float extent = bounds.sizes().maxCoeff();
+        size_t previousCount = indices.size();
+
+        for (int level = 0; level < levels && (baseResolution >> level) > 0; ++level) {
+            float cellSize = extent / static_cast<float>(baseResolution >> level);
+            std::vector<Vertex> lodVertices;
+            std::vector<uint16_t> lodIndices;
+            clusterVertices(vertices, indices, cellSize, lodVertices, lodIndices);
+            if (lodIndices.empty() || lodIndices.size() * 4 > previousCount * 3) continue;
+
+            auto lod = std::make_shared<Mesh>();
+            lod->upload(device, queue, lodVertices, lodIndices);
+            lod->bounds = bounds;  // cluster averages stay inside, but culling must match the original
+            lods.push_back({lod, cellSize * std::sqrt(3.0f)});
+            previousCount = lodIndices.size();
+        }
+    }
+
+    // Simplified mesh for a geometric error of at most maxError (local space)
+    const Mesh& lodFor(float maxError) const {
+        const Mesh* mesh = this;
+        for (const auto& lod : lods) {
+            if (lod.error > maxError) break;
+            mesh = lod.mesh.get();
+        }
+        return *mesh;
+    }
+
     // Factory method for a colored cube
     static Mesh createCube(wgpu::Device device, wgpu::Queue queue) {
         // Each face has its own vertices for distinct face colors
@@ -303,6 +374,80 @@ public:
         mesh.upload(device, queue, vertices, indices);
         return mesh;
     }
+
+private:
+    void clusterVertices(const std::vector<Vertex>& vertices,
+                         const std::vector<uint16_t>& indices,
+                         float cellSize,
+                         std::vector<Vertex>& outVertices,
+                         std::vector<uint16_t>& outIndices) const {
+        struct Cluster {
+            Eigen::Vector3f position = Eigen::Vector3f::Zero();
+            Eigen::Vector3f color = Eigen::Vector3f::Zero();
+            Eigen::Vector2f uv = Eigen::Vector2f::Zero();
+            uint32_t count = 0;
+        };
+
+        // UV chart of every vertex: union-find over the triangles' corners
+        std::vector<uint32_t> chart(vertices.size());
+        std::iota(chart.begin(), chart.end(), 0u);
+        auto root = [&](uint32_t v) {
+            while (chart[v] != v) {
+                chart[v] = chart[chart[v]];
+                v = chart[v];
+            }
+            return v;
+        };
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            uint32_t a = root(indices[i]);
+            chart[root(indices[i + 1])] = a;
+            chart[root(indices[i + 2])] = a;
+        }
+
+        // Cell of every vertex, 21 bits per axis, and its chart
+        std::map<std::pair<uint64_t, uint32_t>, uint16_t> cellToCluster;
+        std::vector<Cluster> clusters;
+        std::vector<uint16_t> remap(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            const Vertex& v = vertices[i];
+            Eigen::Vector3f p(v.position[0], v.position[1], v.position[2]);
+            Eigen::Vector3f cell = ((p - bounds.min()) / cellSize).array().floor();
+            uint64_t key = (uint64_t(cell.x()) & 0x1FFFFF)
+                         | (uint64_t(cell.y()) & 0x1FFFFF) << 21
+                         | (uint64_t(cell.z()) & 0x1FFFFF) << 42;
+
+            auto [it, inserted] = cellToCluster.try_emplace({key, root(static_cast<uint32_t>(i))},
+                                                            static_cast<uint16_t>(clusters.size()));
+            if (inserted) {
+                clusters.emplace_back();
+            }
+            Cluster& cluster = clusters[it->second];
+            cluster.position += p;
+            cluster.color += Eigen::Vector3f(v.color[0], v.color[1], v.color[2]);
+            cluster.uv += Eigen::Vector2f(v.uv[0], v.uv[1]);
+            cluster.count++;
+            remap[i] = it->second;
+        }
+
+        outVertices.clear();
+        outVertices.reserve(clusters.size());
+        for (const auto& cluster : clusters) {
+            Eigen::Vector3f p = cluster.position / float(cluster.count);
+            Eigen::Vector3f c = cluster.color / float(cluster.count);
+            Eigen::Vector2f uv = cluster.uv / float(cluster.count);
+            outVertices.push_back({{p.x(), p.y(), p.z()}, {c.x(), c.y(), c.z()}, {uv.x(), uv.y()}});
+        }
+
+        // Triangles with two corners in the same cell have collapsed
+        outIndices.clear();
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            uint16_t a = remap[indices[i]];
+            uint16_t b = remap[indices[i + 1]];
+            uint16_t c = remap[indices[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            outIndices.insert(outIndices.end(), {a, b, c});
+        }
+    }
 };
 
 } // namespace scene
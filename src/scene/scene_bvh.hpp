@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include "camera.hpp"
+#include "mesh.hpp"
+#include "scene_object.hpp"
+
+namespace scene {
+
+// One draw of a culled scene
+struct DrawItem {
+    uint32_t object;    // index in the object list the SceneBVH was built over
+    const Mesh* mesh;   // the object's mesh or one of its LODs
+};
+
+/**
+ * The six planes of a view-projection, in world space. A point p is inside when
+ * plane.dot((p, 1)) >= 0 for every plane. WebGPU clip space: 0 <= z <= w.
+ */
+struct Frustum {
+    std::array<Eigen::Vector4f, 6> planes;
+
+    enum Test { Outside, Intersects, Inside };
+
+    static Frustum fromViewProjection(const Eigen::Matrix4f& m) {
+        Frustum frustum;
+        frustum.planes[0] = m.row(3) + m.row(0);  // left
+        frustum.planes[1] = m.row(3) - m.row(0);  // right
+        frustum.planes[2] = m.row(3) + m.row(1);  // bottom
+        frustum.planes[3] = m.row(3) - m.row(1);  // top
+        frustum.planes[4] = m.row(2);             // near
+        frustum.planes[5] = m.row(3) - m.row(2);  // far
+        return frustum;
+    }
+
+    // Conservative: a box near a frustum corner can be reported as intersecting while outside
+    Test test(const Eigen::AlignedBox3f& box) const {
+        Test result = Inside;
+        for (const auto& plane : planes) {
+            Eigen::Vector3f normal = plane.head<3>();
+            // Corners furthest along and against the plane normal
+            Eigen::Vector3f positive = (normal.array() >= 0).select(box.max(), box.min());
+            Eigen::Vector3f negative = (normal.array() >= 0).select(box.min(), box.max());
+            if (normal.dot(positive) + plane.w() < 0) return Outside;
+            if (normal.dot(negative) + plane.w() < 0) result = Intersects;
+        }
+        return result;
+    }
+};
+
+/**
+ * Bounding volume hierarchy over the world bounding boxes of the scene objects, to cull them
+ * against a camera frustum and pick their level of detail.
+ *
+ * Rebuilt from scratch with build() whenever objects move, which is every frame here (drone and
+ * insects): it is a median split over a few hundred boxes, cheap next to rendering them. Leaves
+ * hold up to leafSize objects; a node entirely inside the frustum takes all its objects without
+ * testing them further.
+ *
+ * LODs are picked by distance: the coarsest Mesh::Lod whose error, seen from the camera at the
+ * distance of the object's box, projects to at most Config::maxPixelError pixels.
+ */
+class SceneBVH {
+public:
+    struct Config {
+        bool frustumCulling = true;
+        bool lod = true;
+        float maxPixelError = 1.0f;      // LOD error allowed on screen
+        uint32_t viewportHeight = 600;   // pixels of the images the LODs are chosen for
+        uint32_t leafSize = 4;
+    };
+
+    SceneBVH() = default;
+    explicit SceneBVH(Config config) : config_(config) {}
+
+    void setConfig(const Config& config) { config_ = config; }
+    const Config& config() const { return config_; }
+
+    // World space bounds of the object's mesh under its transform
+    static Eigen::AlignedBox3f worldBounds(const SceneObject& object) {
+        const Eigen::AlignedBox3f& local = object.mesh->bounds;
+        if (local.isEmpty()) return local;
+
+        Eigen::Matrix4f model = object.transform.getMatrix();
+        Eigen::Vector3f center = (model * local.center().homogeneous()).head<3>();
+        Eigen::Vector3f halfSize = model.block<3, 3>(0, 0).cwiseAbs() * (local.sizes() * 0.5f);
+        return Eigen::AlignedBox3f(center - halfSize, center + halfSize);
+    }
+
+    void build(const std::vector<SceneObject>& objects) {
+        boxes_.resize(objects.size());
+        order_.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            boxes_[i] = worldBounds(objects[i]);
+            order_[i] = static_cast<uint32_t>(i);
+        }
+
+        nodes_.clear();
+        nodes_.reserve(2 * objects.size() / std::max<uint32_t>(config_.leafSize, 1) + 1);
+        if (!objects.empty()) {
+            buildNode(0, static_cast<uint32_t>(objects.size()));
+        }
+    }
+
+    /**
+     * Objects of the last build() seen by camera, in object order, with their LOD.
+     *
+     * Args:
+     * - camera: the viewpoint
+     * - objects: the list build() was called with
+     * - out: cleared then filled
+     */
+    void collect(const Camera& camera, const std::vector<SceneObject>& objects,
+                 std::vector<DrawItem>& out) const {
+        out.clear();
+        if (nodes_.empty()) return;
+
+        Frustum frustum = Frustum::fromViewProjection(camera.getViewProjectionMatrix());
+        std::vector<uint32_t> visible;
+
+        // (node, known to be inside the frustum)
+        std::vector<std::pair<uint32_t, bool>> stack = {{0, !config_.frustumCulling}};
+        while (!stack.empty()) {
+            auto [index, inside] = stack.back();
+            stack.pop_back();
+            const Node& node = nodes_[index];
+
+            if (!inside) {
+                Frustum::Test test = frustum.test(node.box);
+                if (test == Frustum::Outside) continue;
+                inside = test == Frustum::Inside;
+            }
+
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    if (inside || frustum.test(boxes_[order_[i]]) != Frustum::Outside) {
+                        visible.push_back(order_[i]);
+                    }
+                }
+                continue;
+            }
+            stack.push_back({index + 1, inside});
+            stack.push_back({node.right, inside});
+        }
+
+        // Draw order of the unculled scene
+        std::sort(visible.begin(), visible.end());
+
+        float focal = config_.viewportHeight * 0.5f / std::tan(camera.fov * float(M_PI) / 360.0f);
+        out.reserve(visible.size());
+        for (uint32_t object : visible) {
+            const Mesh* mesh = objects[object].mesh.get();
+            if (config_.lod && !mesh->lods.empty()) {
+                float distance = boxes_[object].exteriorDistance(camera.position);
+                float scale = objects[object].transform.scale.cwiseAbs().maxCoeff();
+                if (distance > 0.0f && scale > 0.0f) {
+                    // Local error projecting to maxPixelError pixels at that distance
+                    mesh = &mesh->lodFor(config_.maxPixelError * distance / (focal * scale));
+                }
+            }
+            out.push_back({object, mesh});
+        }
+    }
+
+    size_t objectCount() const { return boxes_.size(); }
+
+private:
+    // Inner nodes have count 0, their left child follows them and right is stored
+    struct Node {
+        Eigen::AlignedBox3f box;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t right = 0;
+    };
+
+    Config config_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> order_;             // object indices, leaves hold ranges of it
+    std::vector<Eigen::AlignedBox3f> boxes_;  // world bounds per object
+
+    uint32_t buildNode(uint32_t first, uint32_t count) {
+        uint32_t index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+
+        Eigen::AlignedBox3f box;
+        Eigen::AlignedBox3f centers;
+        for (uint32_t i = first; i < first + count; ++i) {
+            box.extend(boxes_[order_[i]]);
+            centers.extend(boxes_[order_[i]].center());
+        }
+        nodes_[index].box = box;
+
+        Eigen::Index axis;
+        centers.sizes().maxCoeff(&axis);
+        if (count <= config_.leafSize || centers.sizes()[axis] <= 0.0f) {
+            nodes_[index].first = first;
+            nodes_[index].count = count;
+            return index;
+        }
+
+        // Median split along the longest axis of the centers
+        uint32_t half = count / 2;
+        std::nth_element(order_.begin() + first, order_.begin() + first + half, order_.begin() + first + count,
+                         [&](uint32_t a, uint32_t b) {
+                             return boxes_[a].center()[axis] < boxes_[b].center()[axis];
+                         });
+
+        buildNode(first, half);
+        uint32_t right = buildNode(first + half, count - half);
+        nodes_[index].right = right;
+        return index;
+    }
+};
+
+} // namespace scene
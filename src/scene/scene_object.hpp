@@ -11,6 +11,7 @@ struct SceneObject {
     std::shared_ptr<Mesh> mesh;
     Transform transform;
     std::shared_ptr<Material> material;
+    bool moving = false;  // drawn with its own ID in ID buffer captures (see Renderer::renderIds)
 };
 
 } // namespace scene
@@ -0,0 +1,336 @@
+#pragma once
+#define STB_IMAGE_IMPLEMENTATION
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "stb_image.h"
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define TEXTURE_CACHE_MMAP
+#endif
+
+namespace scene {
+
+// Read-only view of a whole file, mapped when the platform allows it, read otherwise
+class MappedFile {
+public:
+    static std::shared_ptr<MappedFile> open(const std::filesystem::path& path) {
+        auto file = std::shared_ptr<MappedFile>(new MappedFile());
+        std::error_code error;
+        file->size_ = std::filesystem::file_size(path, error);
+        if (error || file->size_ == 0) return nullptr;
+
+#ifdef TEXTURE_CACHE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        void* mapped = ::mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return nullptr;
+        file->data_ = static_cast<const uint8_t*>(mapped);
+#else
+        std::ifstream stream(path, std::ios::binary);
+        file->buffer_.resize(file->size_);
+        if (!stream.read(reinterpret_cast<char*>(file->buffer_.data()), file->size_)) return nullptr;
+        file->data_ = file->buffer_.data();
+#endif
+        return file;
+    }
+
+    ~MappedFile() {
+#ifdef TEXTURE_CACHE_MMAP
+        if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile() = default;
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<uint8_t> buffer_;
+};
+
+/**
+ * Decoded image with its full mip chain, 8 bits per channel, tightly packed rows. Level 0 is the
+ * image, each next level halves both sizes (rounding down, at least 1) down to 1x1.
+ */
+struct MipChain {
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    uint32_t channels = 0;
+    std::vector<Level> levels;
+
+    uint32_t width() const { return levels.empty() ? 0 : levels[0].width; }
+    uint32_t height() const { return levels.empty() ? 0 : levels[0].height; }
+
+    // Keeps the level data alive: the mapped cache file or the decoded pixels
+    std::shared_ptr<MappedFile> file;
+    std::shared_ptr<std::vector<uint8_t>> pixels;
+
+    static uint32_t levelCount(uint32_t width, uint32_t height) {
+        uint32_t count = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Mip chain of an image by repeated 2x2 box filtering, the last row or column of an odd
+     * size being reused for the missing texels.
+     *
+     * Args:
+     * - image: level 0, width * height * channels bytes
+     */
+    static MipChain generate(const uint8_t* image, uint32_t width, uint32_t height, uint32_t channels) {
+        MipChain chain;
+        chain.channels = channels;
+
+        uint32_t count = levelCount(width, height);
+        std::vector<size_t> offsets;
+        size_t total = 0;
+        for (uint32_t level = 0, w = width, h = height; level < count; ++level) {
+            offsets.push_back(total);
+            total += size_t(w) * h * channels;
+            w = std::max(w / 2, 1u);
+            h = std::max(h / 2, 1u);
+        }
+
+        chain.pixels = std::make_shared<std::vector<uint8_t>>(total);
+        uint8_t* out = chain.pixels->data();
+        std::memcpy(out, image, size_t(width) * height * channels);
+
+        uint32_t w = width, h = height;
+        for (uint32_t level = 1; level < count; ++level) {
+            const uint8_t* src = out + offsets[level - 1];
+            uint8_t* dst = out + offsets[level];
+            uint32_t dw = std::max(w / 2, 1u);
+            uint32_t dh = std::max(h / 2, 1u);
+            for (uint32_t y = 0; y < dh; ++y) {
+                uint32_t y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                for (uint32_t x = 0; x < dw; ++x) {
+                    uint32_t x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        uint32_t sum = src[(size_t(y0) * w + x0) * channels + c] + src[(size_t(y0) * w + x1) * channels + c]
+                                     + src[(size_t(y1) * w + x0) * channels + c] + src[(size_t(y1) * w + x1) * channels + c];
+                        dst[(size_t(y) * dw + x) * channels + c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+            w = dw;
+            h = dh;
+        }
+
+        for (uint32_t level = 0, lw = width, lh = height; level < count; ++level) {
+            size_t size = size_t(lw) * lh * channels;
+            chain.levels.push_back({lw, lh, out + offsets[level], size});
+            lw = std::max(lw / 2, 1u);
+            lh = std::max(lh / 2, 1u);
+        }
+        return chain;
+    }
+
+    // Bilinear resampling of an image to another size, texel centers aligned
+    static std::vector<uint8_t> resample(const uint8_t* image, uint32_t width, uint32_t height, uint32_t channels,
+                                         uint32_t newWidth, uint32_t newHeight) {
+        std::vector<uint8_t> out(size_t(newWidth) * newHeight * channels);
+        for (uint32_t y = 0; y < newHeight; ++y) {
+            float fy = std::clamp((y + 0.5f) * height / newHeight - 0.5f, 0.0f, float(height - 1));
+            uint32_t y0 = static_cast<uint32_t>(fy), y1 = std::min(y0 + 1, height - 1);
+            float ty = fy - y0;
+            for (uint32_t x = 0; x < newWidth; ++x) {
+                float fx = std::clamp((x + 0.5f) * width / newWidth - 0.5f, 0.0f, float(width - 1));
+                uint32_t x0 = static_cast<uint32_t>(fx), x1 = std::min(x0 + 1, width - 1);
+                float tx = fx - x0;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    auto at = [&](uint32_t xi, uint32_t yi) { return float(image[(size_t(yi) * width + xi) * channels + c]); };
+                    float top = at(x0, y0) + (at(x1, y0) - at(x0, y0)) * tx;
+                    float bottom = at(x0, y1) + (at(x1, y1) - at(x0, y1)) * tx;
+                    out[(size_t(y) * newWidth + x) * channels + c] = static_cast<uint8_t>(top + (bottom - top) * ty + 0.5f);
+                }
+            }
+        }
+        return out;
+    }
+};
+
+/**
+ * Decoded textures with their mip chains, kept in a directory between runs so that a warm start
+ * maps the file instead of decoding the PNG and filtering the mips again.
+ *
+ * One file per image, channel count and size: a header recording the size and modification time of
+ * the source image, then all levels back to back. An entry whose source changed is rebuilt.
+ * Writes go through a temporary file and a rename, as in core::BlobCache.
+ */
+class TextureCache {
+public:
+    // An empty directory disables the files: every load decodes and filters
+    explicit TextureCache(std::filesystem::path directory = {}) : directory_(std::move(directory)) {
+        if (directory_.empty()) return;
+        std::error_code error;
+        std::filesystem::create_directories(directory_, error);
+        if (error) {
+            std::fprintf(stderr, "Texture cache disabled, cannot create %s: %s\n",
+                         directory_.string().c_str(), error.message().c_str());
+            directory_.clear();
+        }
+    }
+
+    /**
+     * Mip chain of an image file, from the cache when it is up to date.
+     * Throws std::runtime_error when the image cannot be decoded.
+     *
+     * Args:
+     * - path: image file, any format stb_image reads
+     * - channels: 1 to 4, forced regardless of the channels of the file
+     * - size: when not 0, the image is first resampled to size x size (texture array layers)
+     */
+    MipChain load(const std::string& path, uint32_t channels, uint32_t size = 0) {
+        Header expected{};
+        std::memcpy(expected.magic, "MIPC", 4);
+        expected.version = 2;
+        expected.channels = channels;
+        expected.resampledSize = size;
+        std::error_code error;
+        expected.sourceSize = std::filesystem::file_size(path, error);
+        if (!error) {
+            expected.sourceTime = static_cast<int64_t>(
+                std::filesystem::last_write_time(path, error).time_since_epoch().count());
+        }
+
+        std::filesystem::path entry = entryPath(path, channels, size);
+        if (!entry.empty()) {
+            MipChain chain;
+            if (read(entry, expected, chain)) {
+                hits_++;
+                return chain;
+            }
+        }
+
+        int width, height, fileChannels;
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &fileChannels, static_cast<int>(channels));
+        if (!data) {
+            throw std::runtime_error("Failed to load texture: " + path);
+        }
+        MipChain chain;
+        if (size != 0 && (uint32_t(width) != size || uint32_t(height) != size)) {
+            std::vector<uint8_t> resampled = MipChain::resample(data, width, height, channels, size, size);
+            chain = MipChain::generate(resampled.data(), size, size, channels);
+        } else {
+            chain = MipChain::generate(data, width, height, channels);
+        }
+        stbi_image_free(data);
+        misses_++;
+
+        if (!entry.empty()) {
+            expected.width = chain.width();
+            expected.height = chain.height();
+            expected.levels = static_cast<uint32_t>(chain.levels.size());
+            write(entry, expected, chain);
+        }
+        return chain;
+    }
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint32_t channels;
+        uint32_t resampledSize;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        uint32_t padding;
+    };
+
+    std::filesystem::path directory_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+
+    std::filesystem::path entryPath(const std::string& path, uint32_t channels, uint32_t size) const {
+        if (directory_.empty()) return {};
+        std::string name = std::filesystem::path(path).filename().string();
+        // FNV-1a of the full path, two images can share a file name
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : std::filesystem::absolute(path).string()) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char suffix[48];
+        std::snprintf(suffix, sizeof(suffix), ".%016llx.%u.%u.mips", static_cast<unsigned long long>(hash), channels, size);
+        return directory_ / (name + suffix);
+    }
+
+    static bool read(const std::filesystem::path& entry, const Header& expected, MipChain& chain) {
+        std::shared_ptr<MappedFile> file = MappedFile::open(entry);
+        if (!file || file->size() < sizeof(Header)) return false;
+
+        Header header;
+        std::memcpy(&header, file->data(), sizeof(Header));
+        if (std::memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version
+            || header.channels != expected.channels || header.resampledSize != expected.resampledSize
+            || header.sourceSize != expected.sourceSize
+            || header.sourceTime != expected.sourceTime
+            || header.levels != MipChain::levelCount(header.width, header.height)) {
+            return false;
+        }
+
+        chain.channels = header.channels;
+        chain.file = file;
+        size_t offset = sizeof(Header);
+        for (uint32_t level = 0, w = header.width, h = header.height; level < header.levels; ++level) {
+            size_t size = size_t(w) * h * header.channels;
+            if (offset + size > file->size()) return false;
+            chain.levels.push_back({w, h, file->data() + offset, size});
+            offset += size;
+            w = std::max(w / 2, 1u);
+            h = std::max(h / 2, 1u);
+        }
+        return true;
+    }
+
+    static void write(const std::filesystem::path& entry, const Header& header, const MipChain& chain) {
+        std::filesystem::path temporary = entry;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            for (const auto& level : chain.levels) {
+                file.write(reinterpret_cast<const char*>(level.data), level.size);
+            }
+            if (!file) return;
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, entry, error);
+    }
+};
+
+} // namespace scene
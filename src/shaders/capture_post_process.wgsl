@@ -0,0 +1,57 @@
+// Capture post-processing of every camera in one dispatch (z = layer): box filter downsample of
+// the render layers, the sensor noise of noise_pass.wgsl and optionally the temporal difference
+// against the previous frame.
+// Channels are stored swapped so the rgba8unorm output has the byte order of a BGRA8 texture,
+// which is what the capture readback expects. Alpha holds the difference when it is enabled.
+struct Params {
+    time: f32,
+    seed: f32,
+    noise: f32,        // blend of the noise, 0 disables it
+    difference: u32,   // 1: alpha = grey level of |current - previous|
+}
+
+@group(0) @binding(0) var srcTexture: texture_2d_array<f32>;
+@group(0) @binding(1) var dstTexture: texture_storage_2d_array<rgba8unorm, write>;
+@group(0) @binding(2) var previousTexture: texture_2d_array<f32>;  // dstTexture of the last frame
+@group(0) @binding(3) var<uniform> params: Params;
+
+fn hash12(p: vec2<f32>, seed: f32) -> f32 {
+    let p3 = fract(vec3<f32>(p.xyx) * 0.1031);
+    let p3a = p3 + dot(p3, p3.yzx + 33.33 + seed);
+    return fract((p3a.x + p3a.y) * p3a.z);
+}
+
+@compute @workgroup_size(8, 8, 1)
+fn main(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(dstTexture);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+
+    let factor = textureDimensions(srcTexture) / size;
+    let origin = id.xy * factor;
+    var sum = vec4f(0.0);
+    for (var y = 0u; y < factor.y; y++) {
+        for (var x = 0u; x < factor.x; x++) {
+            sum += textureLoad(srcTexture, origin + vec2u(x, y), id.z, 0);
+        }
+    }
+    var color = sum.rgb / f32(factor.x * factor.y);
+
+    if (params.noise > 0.0) {
+        // Same pattern as the fragment shader (y up), decorrelated between cameras
+        let frag = vec2f(f32(id.x) + 0.5, f32(size.y - id.y) - 0.5);
+        let n = hash12(frag + vec2f(params.time * 60.0, params.time * 13.0), params.seed + f32(id.z) * 17.0);
+        color = mix(color, vec3f(n), params.noise);
+    }
+
+    // Differences of the stored 8-bit values, as the CPU would compute them
+    color = round(color * 255.0) / 255.0;
+    var alpha = 1.0;
+    if (params.difference != 0u) {
+        let previous = textureLoad(previousTexture, id.xy, id.z, 0).bgr;
+        alpha = dot(abs(color - previous), vec3f(0.299, 0.587, 0.114));
+    }
+
+    textureStore(dstTexture, id.xy, id.z, vec4f(color.bgr, alpha));
+}
@@ -0,0 +1,56 @@
+// ID buffer of Renderer::renderIds: static objects only write depth, moving objects write the
+// ID of their draw over them. Same draws and materials as unlit.wgsl, no shading.
+struct Material {
+    color: vec4f,
+    layer: u32,
+    alphaTest: u32,
+}
+struct Draw {
+    model: mat4x4f,
+    material: u32,
+    id: u32,
+}
+const NO_LAYER = 0xFFFFFFFFu;
+
+@binding(0) @group(0) var textures: texture_2d_array<f32>;
+@binding(1) @group(0) var textureSampler: sampler;
+@binding(2) @group(0) var<storage, read> materials: array<Material>;
+
+@binding(0) @group(1) var<uniform> viewProjection: mat4x4f;
+@binding(1) @group(1) var<storage, read> draws: array<Draw>;
+
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) uv: vec2f,
+    @location(1) @interpolate(flat) draw: u32,
+}
+
+@vertex
+fn vertexMain(@location(0) position: vec3f,
+              @location(1) color: vec3f,
+              @location(2) uv: vec2f,
+              @builtin(instance_index) instance: u32) -> VertexOutput {
+    var output: VertexOutput;
+    output.position = viewProjection * draws[instance].model * vec4f(position, 1.0);
+    output.uv = uv;
+    output.draw = instance;
+    return output;
+}
+
+@fragment
+fn fragmentOpaque(@location(0) uv: vec2f,
+                  @location(1) @interpolate(flat) draw: u32) -> @location(0) u32 {
+    return draws[draw].id;
+}
+
+// Alpha-tested materials: only the mask is sampled
+@fragment
+fn fragmentMasked(@location(0) uv: vec2f,
+                  @location(1) @interpolate(flat) draw: u32) -> @location(0) u32 {
+    let params = materials[draws[draw].material];
+    let layer = select(0u, params.layer, params.layer != NO_LAYER);
+    if (textureSample(textures, textureSampler, uv, layer).a < 0.5) {
+        discard;
+    }
+    return draws[draw].id;
+}
@@ -1,39 +1,61 @@
-struct Uniforms {
-    mvp: mat4x4f,
+// Scene of Renderer::renderScene: one instance per draw, its model matrix and material id in a
+// storage buffer, every material in the MaterialTable bind group
+struct Material {
+    color: vec4f,
+    layer: u32,
+    alphaTest: u32,
 }
-@binding(0) @group(0) var<uniform> uniforms: Uniforms;
+struct Draw {
+    model: mat4x4f,
+    material: u32,
+    id: u32,
+}
+const NO_LAYER = 0xFFFFFFFFu;
+
+@binding(0) @group(0) var textures: texture_2d_array<f32>;
+@binding(1) @group(0) var textureSampler: sampler;
+@binding(2) @group(0) var<storage, read> materials: array<Material>;
 
-@binding(1) @group(0) var diffuseTexture: texture_2d<f32>;
-@binding(2) @group(0) var diffuseSampler: sampler;
-@binding(3) @group(0) var maskTexture: texture_2d<f32>;
+@binding(0) @group(1) var<uniform> viewProjection: mat4x4f;
+@binding(1) @group(1) var<storage, read> draws: array<Draw>;
 
 struct VertexOutput {
     @builtin(position) position: vec4f,
     @location(0) color: vec3f,
     @location(1) uv: vec2f,
+    @location(2) @interpolate(flat) material: u32,
 }
 
 @vertex
 fn vertexMain(@location(0) position: vec3f,
               @location(1) color: vec3f,
-              @location(2) uv: vec2f) -> VertexOutput {
+              @location(2) uv: vec2f,
+              @builtin(instance_index) instance: u32) -> VertexOutput {
+    let draw = draws[instance];
+
     var output: VertexOutput;
-    output.position = uniforms.mvp * vec4f(position, 1.0);
+    output.position = viewProjection * draw.model * vec4f(position, 1.0);
     output.color = color;
     output.uv = uv;
+    output.material = draw.material;
     return output;
 }
 
 @fragment
 fn fragmentMain(@location(0) color: vec3f,
-                @location(1) uv: vec2f) -> @location(0) vec4f {
-    let diffuseColor = textureSample(diffuseTexture, diffuseSampler, uv);
-    let maskValue = textureSample(maskTexture, diffuseSampler, uv).r;
-    
-    // Discard pixels where mask is black (adjust threshold as needed)
-    if (maskValue < 0.5) {
+                @location(1) uv: vec2f,
+                @location(2) @interpolate(flat) material: u32) -> @location(0) vec4f {
+    let params = materials[material];
+
+    // Sampled for untextured materials too, textureSample needs uniform control flow
+    let textured = params.layer != NO_LAYER;
+    let texel = textureSample(textures, textureSampler, uv, select(0u, params.layer, textured));
+
+    // Discard pixels where the mask (alpha of the layer) is black
+    if (params.alphaTest != 0u && texel.a < 0.5) {
         discard;
     }
-    
-    return vec4f(color * diffuseColor.rgb, 1.0);
+
+    let diffuse = select(vec3f(1.0), texel.rgb, textured);
+    return vec4f(color * params.color.rgb * diffuse, 1.0);
 }
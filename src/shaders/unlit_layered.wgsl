@@ -0,0 +1,64 @@
+// unlit.wgsl for Renderer::renderLayers: the view-projection comes from a storage buffer too,
+// one per layer. instance_index = layer * objectCount + object.
+struct Material {
+    color: vec4f,
+    layer: u32,
+    alphaTest: u32,
+}
+struct Draw {
+    model: mat4x4f,
+    material: u32,
+    id: u32,
+}
+struct Frame {
+    objectCount: u32,
+}
+const NO_LAYER = 0xFFFFFFFFu;
+
+@binding(0) @group(0) var textures: texture_2d_array<f32>;
+@binding(1) @group(0) var textureSampler: sampler;
+@binding(2) @group(0) var<storage, read> materials: array<Material>;
+
+@binding(0) @group(1) var<storage, read> viewProjections: array<mat4x4f>;
+@binding(1) @group(1) var<storage, read> draws: array<Draw>;
+@binding(2) @group(1) var<uniform> frame: Frame;
+
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) color: vec3f,
+    @location(1) uv: vec2f,
+    @location(2) @interpolate(flat) material: u32,
+}
+
+@vertex
+fn vertexMain(@location(0) position: vec3f,
+              @location(1) color: vec3f,
+              @location(2) uv: vec2f,
+              @builtin(instance_index) instance: u32) -> VertexOutput {
+    let layerIndex = instance / frame.objectCount;
+    let draw = draws[instance % frame.objectCount];
+
+    var output: VertexOutput;
+    output.position = viewProjections[layerIndex] * draw.model * vec4f(position, 1.0);
+    output.color = color;
+    output.uv = uv;
+    output.material = draw.material;
+    return output;
+}
+
+@fragment
+fn fragmentMain(@location(0) color: vec3f,
+                @location(1) uv: vec2f,
+                @location(2) @interpolate(flat) material: u32) -> @location(0) vec4f {
+    let params = materials[material];
+
+    let textured = params.layer != NO_LAYER;
+    let texel = textureSample(textures, textureSampler, uv, select(0u, params.layer, textured));
+
+    if (params.alphaTest != 0u && texel.a < 0.5) {
+        discard;
+    }
+
+    let diffuse = select(vec3f(1.0), texel.rgb, textured);
+    return vec4f(color * params.color.rgb * diffuse, 1.0);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "core/multi_camera_capture.hpp"
+#include "vision/detect_object.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+struct CaptureBenchmarkResult {
+    std::string name;
+    double frame_ms = 0.0;      // render, downsample, copy and readback of all cameras, best of the repetitions
+    size_t moving_pixels = 0;   // in the motion masks of all cameras
+    size_t mask_error = 0;      // pixels whose motion mask differs from the reference mode's
+    size_t truth_error = 0;     // pixels whose motion mask differs from the ID buffer difference
+};
+
+struct CaptureMode {
+    std::string name;
+    uint32_t supersample;
+    uint32_t sample_count;
+    bool ids = false;           // ID buffer capture (MultiCameraCapture::setIdCapture), masks are its differences
+};
+
+/**
+ * Compares capture anti-aliasing modes on the same pair of consecutive scene states.
+ *
+ * Every mode captures previous_objects then current_objects from all cameras; the time of the
+ * second capture is reported. Aliased edges flicker from frame to frame, so the motion masks of
+ * the two captures are compared with those of the first mode, taken as the reference: the
+ * differing pixels are the noise a mode adds to (or the motion it hides from) detection.
+ *
+ * Every mode is also compared with the ground truth: the pixels whose ID buffer changed between
+ * the two states, where a moving object is or was. The ID buffer mode itself has no error
+ * against it, only a cost.
+ *
+ * Args:
+ * - ctx, renderer: renderer with createPipeline, createLayeredPipeline and createIdPipelines done
+ * - cameras: observation cameras
+ * - previous_objects, current_objects: scene of two consecutive frames
+ * - width, height: capture resolution
+ * - modes: first one is the reference
+ * - repetitions: timed captures per mode
+ */
+std::vector<CaptureBenchmarkResult> benchmarkCaptureAntiAliasing(
+    core::Context* ctx,
+    core::Renderer& renderer,
+    const std::vector<scene::Camera>& cameras,
+    const std::vector<scene::SceneObject>& previous_objects,
+    const std::vector<scene::SceneObject>& current_objects,
+    uint32_t width, uint32_t height,
+    const std::vector<CaptureMode>& modes = {
+        {"ssaa 4x (ref)", 4, 1},
+        {"none", 1, 1},
+        {"ssaa 2x", 2, 1},
+        {"msaa 4x", 1, core::Renderer::msaaSampleCount},
+        {"id buffer", 1, 1, true},
+    },
+    int repetitions = 5
+) {
+    std::vector<CaptureBenchmarkResult> results;
+    std::vector<cv::Mat> reference_masks;
+
+    // Pixels whose ID changed between the two states, per camera
+    auto idDifferences = [&](core::MultiCameraCapture& capture, const std::vector<cv::Mat>& previous_ids) {
+        std::vector<cv::Mat> current_ids = capture.ids();
+        std::vector<cv::Mat> changed(current_ids.size());
+        for (size_t i = 0; i < current_ids.size(); ++i) {
+            cv::compare(current_ids[i], previous_ids[i], changed[i], cv::CMP_NE);
+        }
+        return changed;
+    };
+
+    std::vector<cv::Mat> truth_masks;
+    {
+        core::MultiCameraCapture truth(ctx, cameras.size(), width, height, 1, 1);
+        truth.setIdCapture(true);
+        for (const auto* objects : {&previous_objects, &current_objects}) {
+            truth.renderAll(cameras, *objects, renderer);
+            truth.copyAll();
+            truth.sync();
+            truth.readAll();
+        }
+        truth_masks = truth.differences();
+    }
+
+    for (const auto& mode : modes) {
+        CaptureBenchmarkResult result;
+        result.name = mode.name;
+        result.frame_ms = std::numeric_limits<double>::infinity();
+
+        core::MultiCameraCapture capture(ctx, cameras.size(), width, height, mode.supersample, mode.sample_count);
+        capture.setIdCapture(mode.ids);
+        auto captureFrames = [&](const std::vector<scene::SceneObject>& objects) {
+            capture.renderAll(cameras, objects, renderer);
+            capture.downsampleAll();
+            capture.copyAll();
+            capture.sync();
+            return capture.readAll();
+        };
+
+        std::vector<cv::Mat> previous = captureFrames(previous_objects);
+        std::vector<cv::Mat> previous_ids = capture.ids();
+        std::vector<cv::Mat> current;
+        for (int rep = 0; rep < repetitions; ++rep) {
+            auto start = std::chrono::high_resolution_clock::now();
+            current = captureFrames(current_objects);
+            auto end = std::chrono::high_resolution_clock::now();
+            result.frame_ms = std::min(result.frame_ms, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        // Repeated captures of the same state leave no ID difference, compare with the first one
+        std::vector<cv::Mat> masks;
+        if (mode.ids) {
+            masks = idDifferences(capture, previous_ids);
+        } else {
+            for (size_t i = 0; i < cameras.size(); ++i) {
+                masks.push_back(computeMotionMask({cameras[i], current[i], previous[i]}));
+            }
+        }
+        for (size_t i = 0; i < masks.size(); ++i) {
+            result.moving_pixels += cv::countNonZero(masks[i]);
+            cv::Mat difference;
+            cv::absdiff(masks[i], truth_masks[i], difference);
+            result.truth_error += cv::countNonZero(difference);
+        }
+
+        if (reference_masks.empty()) {
+            reference_masks = masks;
+        }
+        for (size_t i = 0; i < masks.size(); ++i) {
+            cv::Mat difference;
+            cv::absdiff(masks[i], reference_masks[i], difference);
+            result.mask_error += cv::countNonZero(difference);
+        }
+
+        results.push_back(std::move(result));
+    }
+
+    return results;
+}
+
+void printCaptureBenchmark(const std::vector<CaptureBenchmarkResult>& results) {
+    std::printf("%-14s %10s %14s %12s %12s\n", "mode", "frame ms", "moving pixels", "mask error", "truth error");
+    for (const auto& r : results) {
+        std::printf("%-14s %10.2f %14zu %12zu %12zu\n", r.name.c_str(), r.frame_ms, r.moving_pixels,
+                    r.mask_error, r.truth_error);
+    }
+}
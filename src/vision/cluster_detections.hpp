@@ -1,6 +1,8 @@
 #pragma once
 
 #include "vision/detect_object.hpp"
+#include "vision/linear_octree.hpp"
+#include <utility>
 
 
 struct Cluster {
@@ -21,12 +23,15 @@ struct Cluster {
  * - min_voxel_size: used to compute epsilon (epsilon = epsilon_factor * min_voxel_size)
  * - epsilon_factor: multiplier for min_voxel_size to get neighbor distance threshold
  * - min_cluster_size: clusters smaller than this are discarded as noise
+ * - threads: > 1 compares the voxel pairs on this many workers of the calling thread's
+ *   core::WorkerPool, the neighbour pairs being gathered in a core::AppendBuffer
  */
 std::vector<Cluster> clusterDetections(
     const std::vector<Voxel>& detections,
     float min_voxel_size,
     float epsilon_factor = 2.5f,
-    size_t min_cluster_size = 3
+    size_t min_cluster_size = 3,
+    int threads = 1
 ) {
     if (detections.empty()) {
         return {};
@@ -38,12 +43,32 @@ std::vector<Cluster> clusterDetections(
 
     // Build adjacency list using squared distances
     std::vector<std::vector<size_t>> neighbors(n);
-    for (size_t i = 0; i < n; ++i) {
-        for (size_t j = i + 1; j < n; ++j) {
-            float dist_sq = (detections[i].center - detections[j].center).squaredNorm();
-            if (dist_sq <= epsilon_sq) {
-                neighbors[i].push_back(j);
-                neighbors[j].push_back(i);
+    if (threads > 1) {
+        // Rows taken from an atomic counter; sorting the pairs gives the sequential adjacency order
+        core::AppendBuffer<std::pair<uint32_t, uint32_t>> pairs;
+        std::atomic<size_t> next_row{0};
+        core::localWorkerPool().run(std::min<size_t>(threads, n), [&](size_t) {
+            auto writer = pairs.writer();
+            for (size_t i = next_row++; i < n; i = next_row++) {
+                for (size_t j = i + 1; j < n; ++j) {
+                    if ((detections[i].center - detections[j].center).squaredNorm() <= epsilon_sq) {
+                        writer.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+                    }
+                }
+            }
+        });
+        for (const auto& [i, j] : pairs.finalize([](const auto& pair) { return pair; })) {
+            neighbors[i].push_back(j);
+            neighbors[j].push_back(i);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i + 1; j < n; ++j) {
+                float dist_sq = (detections[i].center - detections[j].center).squaredNorm();
+                if (dist_sq <= epsilon_sq) {
+                    neighbors[i].push_back(j);
+                    neighbors[j].push_back(i);
+                }
             }
         }
     }
@@ -99,3 +124,252 @@ std::vector<Cluster> clusterDetections(
 }
 
 
+/**
+ * Same clustering on a LinearOctree (see toLinearOctree).
+ *
+ * Instead of comparing all pairs, the neighbours of a cell are looked up by binary search of the
+ * cells within epsilon in the sorted keys: O(n * r^3 * log n) with r = epsilon / cell size,
+ * instead of O(n^2).
+ */
+std::vector<Cluster> clusterDetections(
+    const LinearOctree& octree,
+    float min_voxel_size,
+    float epsilon_factor = 2.5f,
+    size_t min_cluster_size = 3
+) {
+    if (octree.keys.empty()) {
+        return {};
+    }
+
+    float epsilon = epsilon_factor * min_voxel_size;
+    float cell_size = octree.cellSize();
+    int reach = static_cast<int>(std::floor(epsilon / cell_size));
+    float reach_sq = (epsilon / cell_size) * (epsilon / cell_size);
+    int resolution = static_cast<int>(octree.resolution());
+    size_t n = octree.keys.size();
+
+    // Cell offsets whose centers are within epsilon
+    std::vector<Eigen::Vector3i> offsets;
+    for (int dz = -reach; dz <= reach; ++dz) {
+        for (int dy = -reach; dy <= reach; ++dy) {
+            for (int dx = -reach; dx <= reach; ++dx) {
+                if ((dx || dy || dz) && dx * dx + dy * dy + dz * dz <= reach_sq) {
+                    offsets.emplace_back(dx, dy, dz);
+                }
+            }
+        }
+    }
+
+    // BFS to find connected components
+    std::vector<int> labels(n, -1);
+    int current_label = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (labels[i] != -1) continue;
+
+        std::vector<size_t> queue;
+        queue.push_back(i);
+        labels[i] = current_label;
+
+        size_t head = 0;
+        while (head < queue.size()) {
+            Eigen::Vector3i cell = mortonDecode(octree.keys[queue[head++]]);
+
+            for (const auto& offset : offsets) {
+                Eigen::Vector3i neighbor_cell = cell + offset;
+                if ((neighbor_cell.array() < 0).any() || (neighbor_cell.array() >= resolution).any()) continue;
+
+                uint64_t key = mortonEncode(neighbor_cell.x(), neighbor_cell.y(), neighbor_cell.z());
+                auto it = std::lower_bound(octree.keys.begin(), octree.keys.end(), key);
+                if (it == octree.keys.end() || *it != key) continue;
+
+                size_t neighbor = it - octree.keys.begin();
+                if (labels[neighbor] == -1) {
+                    labels[neighbor] = current_label;
+                    queue.push_back(neighbor);
+                }
+            }
+        }
+        current_label++;
+    }
+
+    // Group voxels by cluster and compute centroids
+    std::vector<Cluster> clusters(current_label);
+    for (size_t i = 0; i < n; ++i) {
+        clusters[labels[i]].voxels.push_back(octree.keyToVoxel(octree.keys[i]));
+    }
+
+    for (auto& cluster : clusters) {
+        Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+        for (const auto& voxel : cluster.voxels) {
+            sum += voxel.center;
+        }
+        cluster.centroid = sum / static_cast<float>(cluster.voxels.size());
+    }
+
+    // Filter by minimum size
+    std::vector<Cluster> result;
+    for (auto& cluster : clusters) {
+        if (cluster.voxels.size() >= min_cluster_size) {
+            result.push_back(std::move(cluster));
+        }
+    }
+
+    return result;
+}
+
+
+/**
+ * Replaces each cluster centroid by the least-squares closest point to the rays that voted for it.
+ *
+ * The centroid from clusterDetections is a mean of voxel centers, so its error is bounded by
+ * min_voxel_size and getting finer costs whole octree levels. The rays that voted for a cluster
+ * meet at the target up to pixel noise: the point x minimizing sum w |(I - d d^T)(x - o)|^2 over
+ * them solves the 3×3 system
+ *
+ *   (sum w I - D W D^T) x = sum w o - D W (D^T o)
+ *
+ * whose precision follows the pixels rather than the voxels, so the descent can stop earlier.
+ *
+ * The rays of a cluster are the ones that reached its voxels during the descent (DetectionVote),
+ * not rays picked again by their distance to the cluster, so clutter rays only passing near it
+ * are left out. Clutter rays crossing a leaf did vote for it: after a first solve, rays farther
+ * from the point than twice the median distance (or their own footprint) are dropped and the
+ * system is solved again. The system is one Eigen expression over the cluster's rays, with
+ * weights w giving each camera the same weight whatever its ray count. Clusters seen by fewer
+ * than min_cameras cameras, with nearly parallel rays, or whose solution leaves the cluster keep
+ * their voxel centroid. With a MotionPyramid, a vote is the coarse ray the leaf's rays were
+ * refined from.
+ *
+ * Args:
+ * - clusters: from clusterDetections, on detections or on their LinearOctree; centroids are updated in place
+ * - rays: the rays given to detect_objects_from_rays, indexed by Ray::id
+ * - votes: DetectionStats::votes of that run (DetectionConfig::record_votes)
+ * - min_cameras: distinct cameras needed to triangulate, typically DetectionConfig::min_ray_threshold
+ */
+void refineClusterCentroids(std::vector<Cluster>& clusters, const std::vector<Ray>& rays, const std::vector<DetectionVote>& votes, size_t min_cameras = 3) {
+    if (clusters.empty() || rays.empty() || votes.empty()) return;
+
+    // Votes bucketed on a grid as fine as the smallest cluster voxel. Cluster voxels are matched by
+    // containing a vote's center, not by equal centers: after toLinearOctree they are grid cells
+    // rebuilt by keyToVoxel, whose centers differ from the leaves that voted.
+    Eigen::Vector3f lo = votes.front().voxel.center;
+    Eigen::Vector3f hi = lo;
+    float cell_size = std::numeric_limits<float>::max();
+    for (const auto& vote : votes) {
+        lo = lo.cwiseMin(vote.voxel.center);
+        hi = hi.cwiseMax(vote.voxel.center);
+    }
+    for (const auto& cluster : clusters) {
+        for (const auto& voxel : cluster.voxels) {
+            cell_size = std::min(cell_size, voxel.half_size * 2.0f);
+        }
+    }
+    if (!(cell_size > 0.0f) || cell_size == std::numeric_limits<float>::max()) return;
+
+    LinearOctree grid;
+    grid.origin = lo;
+    float cells = std::ceil((hi - lo).maxCoeff() / cell_size) + 1.0f;
+    grid.cells = static_cast<uint32_t>(std::clamp(cells, 1.0f, static_cast<float>(LinearOctree::kMaxCells)));
+    grid.root_size = static_cast<float>(grid.cells) * cell_size;
+
+    std::vector<std::pair<uint64_t, const DetectionVote*>> vote_keys;
+    vote_keys.reserve(votes.size());
+    for (const auto& vote : votes) {
+        vote_keys.emplace_back(grid.pointToKey(vote.voxel.center), &vote);
+    }
+    std::sort(vote_keys.begin(), vote_keys.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    int camera_count = 0;
+    for (const auto& ray : rays) {
+        camera_count = std::max(camera_count, ray.camera_id + 1);
+    }
+    std::vector<size_t> rays_per_camera(camera_count);
+
+    for (auto& cluster : clusters) {
+        std::vector<uint32_t> ids;
+        float radius = 0.0f;
+        for (const auto& voxel : cluster.voxels) {
+            radius = std::max(radius, (voxel.center - cluster.centroid).norm() + voxel.half_size * std::sqrt(3.0f));
+            Eigen::Vector3i first = mortonDecode(grid.pointToKey(voxel.center - Eigen::Vector3f::Constant(voxel.half_size)));
+            Eigen::Vector3i last = mortonDecode(grid.pointToKey(voxel.center + Eigen::Vector3f::Constant(voxel.half_size)));
+            for (int z = first.z(); z <= last.z(); ++z) {
+                for (int y = first.y(); y <= last.y(); ++y) {
+                    for (int x = first.x(); x <= last.x(); ++x) {
+                        uint64_t key = mortonEncode(x, y, z);
+                        auto it = std::lower_bound(vote_keys.begin(), vote_keys.end(), key,
+                                                   [](const auto& entry, uint64_t k) { return entry.first < k; });
+                        for (; it != vote_keys.end() && it->first == key; ++it) {
+                            const DetectionVote& vote = *it->second;
+                            if ((vote.voxel.center - voxel.center).cwiseAbs().maxCoeff() > voxel.half_size) continue;
+                            ids.insert(ids.end(), vote.ray_ids.begin(), vote.ray_ids.end());
+                        }
+                    }
+                }
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](uint32_t id) { return id >= rays.size(); }), ids.end());
+        if (ids.empty()) continue;
+
+        Eigen::Matrix3Xf directions(3, ids.size());
+        Eigen::Matrix3Xf origins(3, ids.size());
+        Eigen::VectorXi camera_ids(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const Ray& ray = rays[ids[i]];
+            directions.col(i) = ray.direction;
+            origins.col(i) = ray.origin;
+            camera_ids(i) = ray.camera_id;
+        }
+        Eigen::VectorXf along = directions.cwiseProduct(origins).colwise().sum().transpose();
+
+        // Solves with the rays of keep, each camera weighing the same
+        auto solve = [&](const std::vector<bool>& keep, Eigen::Vector3f& point) {
+            std::fill(rays_per_camera.begin(), rays_per_camera.end(), 0);
+            for (size_t i = 0; i < ids.size(); ++i) {
+                if (keep[i]) rays_per_camera[camera_ids(i)]++;
+            }
+            size_t cameras = std::count_if(rays_per_camera.begin(), rays_per_camera.end(), [](size_t n) { return n > 0; });
+            if (cameras < min_cameras) return false;
+
+            Eigen::VectorXf weights(ids.size());
+            for (size_t i = 0; i < ids.size(); ++i) {
+                weights(i) = keep[i] ? 1.0f / static_cast<float>(rays_per_camera[camera_ids(i)]) : 0.0f;
+            }
+            Eigen::Matrix3f a = weights.sum() * Eigen::Matrix3f::Identity()
+                              - directions * weights.asDiagonal() * directions.transpose();
+            Eigen::Vector3f b = origins * weights - directions * weights.cwiseProduct(along);
+
+            // Smallest eigenvalue ~ sin^2 of the widest angle between the cameras, 0 when the rays are parallel
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver;
+            solver.computeDirect(a, Eigen::EigenvaluesOnly);
+            if (solver.eigenvalues()(0) < 1e-3f * static_cast<float>(cameras)) return false;
+            point = a.ldlt().solve(b);
+            return true;
+        };
+
+        std::vector<bool> keep(ids.size(), true);
+        Eigen::Vector3f point;
+        if (!solve(keep, point)) continue;
+
+        // Votes from clutter crossing the leaves: drop rays far from the first solution, solve again
+        Eigen::Matrix3Xf offsets = (-origins).colwise() + point;
+        Eigen::ArrayXf along_point = (directions.cwiseProduct(offsets).colwise().sum()).transpose().array();
+        Eigen::ArrayXf residual = (offsets.colwise().squaredNorm().transpose().array() - along_point.square()).max(0.0f).sqrt();
+        std::vector<float> sorted(residual.data(), residual.data() + residual.size());
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        float cutoff = 2.0f * sorted[sorted.size() / 2];
+        for (size_t i = 0; i < ids.size(); ++i) {
+            float footprint = along_point(i) * rays[ids[i]].pixel_angular_size;
+            keep[i] = residual(i) <= std::max(cutoff, footprint);
+        }
+        Eigen::Vector3f trimmed;
+        if (solve(keep, trimmed)) {
+            point = trimmed;
+        }
+
+        if ((point - cluster.centroid).norm() > radius) continue;
+        cluster.centroid = point;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "vision/detect_object.hpp"
+#include "vision/occupancy_map.hpp"
+#include <memory>
+#include <vector>
+
+
+/**
+ * 3D map of the regions that keep producing detections, e.g. foliage seen by several cameras.
+ *
+ * This is an OccupancyMap with slow settings: a cell has to be hit on most frames for about
+ * 45 frames before it counts as clutter, and is forgotten about as slowly. A moving target
+ * never stays that long in one cell. A target hovering in place for several seconds would be
+ * suppressed too.
+ *
+ * Detection skips the octree nodes inside clutter cells and reports them in
+ * DetectionStats::clutter_hits. Those have to be fed back to update(), otherwise suppressed
+ * cells stop being hit and the suppression switches itself off.
+ */
+class ClutterMap {
+public:
+    static OccupancyMap::Config defaultConfig() {
+        OccupancyMap::Config config;
+        config.cell_size = 2.0f;
+        config.hit = 0.1f;
+        config.decay = 0.98f;
+        config.max_log_odds = 5.0f;
+        config.occupied_probability = 0.95f;
+        return config;
+    }
+
+    explicit ClutterMap(const Voxel& target_zone, OccupancyMap::Config config = defaultConfig())
+        : map_(target_zone, config) {}
+
+    /**
+     * Args:
+     * - detections: voxels from detect_objects
+     * - clutter_hits: DetectionStats::clutter_hits of the same frame
+     */
+    void update(const std::vector<Voxel>& detections, const std::vector<Voxel>& clutter_hits) {
+        std::vector<Voxel> hits;
+        hits.reserve(detections.size() + clutter_hits.size());
+        hits.insert(hits.end(), detections.begin(), detections.end());
+        hits.insert(hits.end(), clutter_hits.begin(), clutter_hits.end());
+        map_.update(hits);
+        cells_.reset();
+    }
+
+    // Current clutter cells for DetectionConfig::clutter, rebuilt after each update
+    std::shared_ptr<const ClutterCells> cells() {
+        if (!cells_) {
+            auto cells = std::make_shared<ClutterCells>();
+            cells->origin = map_.grid().origin;
+            cells->cell_size = map_.grid().cellSize();
+            for (uint64_t key : map_.occupiedKeys()) {
+                cells->keys.insert(ClutterCells::packIndex(mortonDecode(key)));
+            }
+            cells_ = std::move(cells);
+        }
+        return cells_;
+    }
+
+    void clear() {
+        map_.clear();
+        cells_.reset();
+    }
+
+private:
+    OccupancyMap map_;
+    std::shared_ptr<const ClutterCells> cells_;
+};
@@ -2,12 +2,21 @@
 
 #include <opencv2/opencv.hpp>
 #include <limits>
+#include <algorithm>
 #include "scene/scene_object.hpp"
 #include "scene/camera.hpp"
 #include "core/renderer.hpp"
 #include <Eigen/Dense>
 #include <vector>
 #include <unordered_set>
+#include <random>
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <atomic>
+#include <tuple>
+#include "core/append_buffer.hpp"
+#include "core/worker_pool.hpp"
 
 
 struct Voxel {
@@ -20,6 +29,12 @@ struct Ray {
     Eigen::Vector3f direction;
     int camera_id;
     float pixel_angular_size; // angular size of the area this ray represents
+    uint32_t id = 0;          // index in the ray list given to detect_objects_from_rays, kept by sub-rays
+    float t_min = 0.0f;       // only [t_min, t_max] of the ray is traversed (see CoverageVolume::clip)
+    float t_max = std::numeric_limits<float>::infinity();
+    uint8_t pyramid_level = 0;  // > 0: cast from a coarse MotionPyramid cell, refined during descent
+    uint16_t pixel_x = 0;       // cell of the ray at pyramid_level
+    uint16_t pixel_y = 0;
 };
 
 
@@ -41,9 +56,100 @@ struct VoxelDebugInfo {
     int depth;
 };
 
+/**
+ * Bounded recorder for the debug view.
+ *
+ * With dense motion, recording every ray and visited voxel costs hundreds of MB per frame, so:
+ * - visited voxels shallower than min_voxel_depth are filtered out when recorded
+ * - the remaining visited voxels are reservoir-sampled down to max_voxels, which keeps a uniform
+ *   sample of the traversal whatever its size
+ * - detection voxels are always kept (there are as many as detect_objects returns anyway)
+ * - rays are sampled down to max_rays at the end of the frame, rays that reached a detection first
+ *
+ * Which rays contributed to a detection is marked during traversal, when a ray reaches a detection leaf.
+ */
 struct DebugVisualization {
     std::vector<RayDebugInfo> rays;
     std::vector<VoxelDebugInfo> voxels;
+
+    size_t max_rays = 500;
+    size_t max_voxels = 20000;
+    int min_voxel_depth = 0;
+
+    // Starts a new frame, keeps the settings and the allocations
+    void clear(size_t ray_count = 0) {
+        rays.clear();
+        voxels.clear();
+        voxel_slots_.clear();
+        visited_seen_ = 0;
+        ray_contributed_.assign(ray_count, 0);
+    }
+
+    void recordVoxel(const Voxel& voxel, bool is_detection, int depth) {
+        if (depth < min_voxel_depth) return;
+
+        if (is_detection) {
+            voxels.push_back({voxel, true, depth});
+            return;
+        }
+
+        // Reservoir sampling (algorithm R) over the visited voxels
+        visited_seen_++;
+        if (voxel_slots_.size() < max_voxels) {
+            voxel_slots_.push_back(voxels.size());
+            voxels.push_back({voxel, false, depth});
+            return;
+        }
+
+        size_t slot = std::uniform_int_distribution<size_t>(0, visited_seen_ - 1)(rng_);
+        if (slot < max_voxels) {
+            voxels[voxel_slots_[slot]] = {voxel, false, depth};
+        }
+    }
+
+    void markContributed(const Ray& ray) {
+        if (ray.id < ray_contributed_.size()) {
+            ray_contributed_[ray.id] = 1;
+        }
+    }
+
+    // Keeps up to max_rays of all_rays, contributing rays first
+    void recordRays(const std::vector<Ray>& all_rays) {
+        size_t seen = 0;
+        for (bool contributed : {true, false}) {
+            size_t budget = max_rays - rays.size();
+            size_t start = rays.size();
+            seen = 0;
+
+            for (const auto& ray : all_rays) {
+                bool ray_contributed = ray.id < ray_contributed_.size() && ray_contributed_[ray.id];
+                if (ray_contributed != contributed) continue;
+
+                seen++;
+                if (rays.size() - start < budget) {
+                    rays.push_back({ray, ray.camera_id, contributed});
+                    continue;
+                }
+
+                size_t slot = std::uniform_int_distribution<size_t>(0, seen - 1)(rng_);
+                if (slot < budget) {
+                    rays[start + slot] = {ray, ray.camera_id, contributed};
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<size_t> voxel_slots_;       // reservoir slot -> index in voxels
+    size_t visited_seen_ = 0;
+    std::vector<uint8_t> ray_contributed_;  // indexed by Ray::id
+    std::mt19937 rng_{42};
+};
+
+// Rays (Ray::id) that reached a detection leaf, recorded with DetectionConfig::record_votes
+struct DetectionVote {
+    Voxel voxel;
+    std::vector<uint32_t> ray_ids;  // sorted, unique
 };
 
 struct DetectionStats {
@@ -55,6 +161,429 @@ struct DetectionStats {
     std::vector<size_t> checks_per_depth = std::vector<size_t>(30, 0);
     size_t rays_subdivided = 0;
     size_t total_subrays_created = 0;
+    size_t cone_cells_tested = 0;  // neighbour cells checked against a ray cone (RayFootprintMode::Cone)
+    std::vector<size_t> nodes_per_depth = std::vector<size_t>(30, 0);
+    std::vector<size_t> subdiv_per_depth = std::vector<size_t>(30, 0); // factor used at each depth (last node seen)
+    std::vector<Voxel> clutter_hits;  // nodes with enough cameras that were skipped as known clutter
+    size_t rays_outside_coverage = 0;  // rays crossing no cell seen by min_ray_threshold cameras
+    size_t nodes_outside_coverage = 0; // nodes with enough rays skipped as seen by too few cameras
+    size_t pyramid_rays_refined = 0;   // coarse MotionPyramid rays replaced by their children
+    std::vector<DetectionVote> votes;  // one per detection, in no particular order
+
+    // Adds the counters of a descent run on another thread (see DetectionConfig::descent_threads)
+    void merge(const DetectionStats& other) {
+        ray_count += other.ray_count;
+        nodes_visited += other.nodes_visited;
+        voxels_visited += other.voxels_visited;
+        intersection_checks += other.intersection_checks;
+        total_depth += other.total_depth;
+        rays_subdivided += other.rays_subdivided;
+        total_subrays_created += other.total_subrays_created;
+        cone_cells_tested += other.cone_cells_tested;
+        rays_outside_coverage += other.rays_outside_coverage;
+        nodes_outside_coverage += other.nodes_outside_coverage;
+        pyramid_rays_refined += other.pyramid_rays_refined;
+        for (size_t i = 0; i < checks_per_depth.size() && i < other.checks_per_depth.size(); ++i) {
+            checks_per_depth[i] += other.checks_per_depth[i];
+            nodes_per_depth[i] += other.nodes_per_depth[i];
+            subdiv_per_depth[i] = std::max(subdiv_per_depth[i], other.subdiv_per_depth[i]);
+        }
+        clutter_hits.insert(clutter_hits.end(), other.clutter_hits.begin(), other.clutter_hits.end());
+        votes.insert(votes.end(), other.votes.begin(), other.votes.end());
+    }
+};
+
+/**
+ * Learned suppression of the image regions of one camera that move most of the time
+ * (insects in front of the lens, foliage).
+ *
+ * The image is split in blocks of block_size pixels and a running frequency of "block has motion"
+ * is kept per block. Blocks moving more often than suppress_frequency are cleared from the motion
+ * mask, so no ray is cast from them.
+ *
+ * Clutter in front of a camera usually sits on the line of sight to the target, so frequency
+ * alone would also mask the target out. Blocks around the projection of recent detections are
+ * protected (see protect) and never suppressed.
+ */
+struct PixelClutterMask {
+    int block_size = 8;
+    float learning_rate = 0.02f;        // weight of the current frame in the running frequency
+    float suppress_frequency = 0.3f;
+    int protect_radius = 2;             // blocks around a protected point
+    int protect_frames = 30;            // frames a block stays protected after the last protect()
+    cv::Mat frequency;                  // CV_32F, one value per block
+    std::vector<int> protected_for;     // remaining protected frames, per block
+    size_t suppressed_pixels = 0;       // moving pixels removed from the last mask
+
+    /**
+     * Protects the blocks around the projection of points, typically the cluster centroids of the
+     * last frame, so that the target is not suppressed along with the clutter around it.
+     */
+    void protect(const scene::Camera& camera, const std::vector<Eigen::Vector3f>& points, int image_width, int image_height) {
+        if (frequency.empty()) return;
+
+        Eigen::Matrix4f view_projection = camera.getViewProjectionMatrix();
+        for (const auto& point : points) {
+            Eigen::Vector4f clip = view_projection * point.homogeneous();
+            if (clip.w() <= 0.0f) continue;
+
+            float x = (clip.x() / clip.w() * 0.5f + 0.5f) * image_width;
+            float y = (-clip.y() / clip.w() * 0.5f + 0.5f) * image_height;
+            int bx = static_cast<int>(std::floor(x)) / block_size;
+            int by = static_cast<int>(std::floor(y)) / block_size;
+
+            for (int dy = -protect_radius; dy <= protect_radius; ++dy) {
+                for (int dx = -protect_radius; dx <= protect_radius; ++dx) {
+                    int px = bx + dx, py = by + dy;
+                    if (px < 0 || py < 0 || px >= frequency.cols || py >= frequency.rows) continue;
+                    protected_for[static_cast<size_t>(py) * frequency.cols + px] = protect_frames;
+                }
+            }
+        }
+    }
+
+    // Learns from motion_mask (CV_8U, 0 or 255) then clears the suppressed blocks in place
+    void apply(cv::Mat& motion_mask) {
+        int grid_rows = (motion_mask.rows + block_size - 1) / block_size;
+        int grid_cols = (motion_mask.cols + block_size - 1) / block_size;
+        if (frequency.rows != grid_rows || frequency.cols != grid_cols) {
+            frequency = cv::Mat::zeros(grid_rows, grid_cols, CV_32F);
+            protected_for.assign(static_cast<size_t>(grid_rows) * grid_cols, 0);
+        }
+
+        std::vector<uint8_t> moved(static_cast<size_t>(grid_rows) * grid_cols, 0);
+        for (int y = 0; y < motion_mask.rows; ++y) {
+            const uint8_t* row = motion_mask.ptr<uint8_t>(y);
+            uint8_t* moved_row = moved.data() + static_cast<size_t>(y / block_size) * grid_cols;
+            for (int x = 0; x < motion_mask.cols; ++x) {
+                if (row[x]) moved_row[x / block_size] = 1;
+            }
+        }
+
+        std::vector<uint8_t> suppressed(moved.size(), 0);
+        for (int by = 0; by < grid_rows; ++by) {
+            float* f = frequency.ptr<float>(by);
+            for (int bx = 0; bx < grid_cols; ++bx) {
+                size_t b = static_cast<size_t>(by) * grid_cols + bx;
+                f[bx] += learning_rate * (static_cast<float>(moved[b]) - f[bx]);
+                suppressed[b] = f[bx] > suppress_frequency && protected_for[b] == 0;
+                if (protected_for[b] > 0) protected_for[b]--;
+            }
+        }
+
+        suppressed_pixels = 0;
+        for (int y = 0; y < motion_mask.rows; ++y) {
+            uint8_t* row = motion_mask.ptr<uint8_t>(y);
+            const uint8_t* suppressed_row = suppressed.data() + static_cast<size_t>(y / block_size) * grid_cols;
+            for (int x = 0; x < motion_mask.cols; ++x) {
+                if (row[x] && suppressed_row[x / block_size]) {
+                    row[x] = 0;
+                    suppressed_pixels++;
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Cells of a regular grid where motion is known to be persistent clutter.
+ * Octree nodes lying entirely inside clutter cells are not descended. Built by ClutterMap.
+ */
+struct ClutterCells {
+    Eigen::Vector3f origin = Eigen::Vector3f::Zero();   // min corner of cell (0, 0, 0)
+    float cell_size = 1.0f;
+    std::unordered_set<uint64_t> keys;                  // packIndex of each clutter cell
+
+    static uint64_t packIndex(const Eigen::Vector3i& index) {
+        return (static_cast<uint64_t>(index.x()) << 42) | (static_cast<uint64_t>(index.y()) << 21)
+             | static_cast<uint64_t>(index.z());
+    }
+
+    bool covers(const Voxel& voxel) const {
+        if (keys.empty() || voxel.half_size * 2.0f > cell_size) return false;
+
+        Eigen::Vector3f half = Eigen::Vector3f::Constant(voxel.half_size * 0.999f);
+        Eigen::Vector3i lo = ((voxel.center - half - origin) / cell_size).array().floor().cast<int>();
+        Eigen::Vector3i hi = ((voxel.center + half - origin) / cell_size).array().floor().cast<int>();
+        if (lo.minCoeff() < 0) return false;
+
+        for (int x = lo.x(); x <= hi.x(); ++x) {
+            for (int y = lo.y(); y <= hi.y(); ++y) {
+                for (int z = lo.z(); z <= hi.z(); ++z) {
+                    if (!keys.count(packIndex({x, y, z}))) return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+std::vector<std::pair<int, float>> traverseGrid(const Ray& ray, float t_entry, const Voxel& target_voxel, int n);
+float getRayEntryT(const Ray& ray, const Voxel& voxel);
+
+/**
+ * Number of camera frustums overlapping each cell of a coarse grid over the target zone.
+ *
+ * A voxel seen by fewer than min_ray_threshold cameras can never be confirmed, so it is skipped
+ * twice: clip() restricts each ray to the span between the first and the last covered cell it
+ * crosses, and rejects rays that cross none, then recursive_detection skips the nodes that
+ * covers() rejects, i.e. the uncovered cells left inside that span. Most of the saving is in
+ * clip(): a node holding rays of min_ray_threshold cameras is normally inside their frustums, so
+ * the node test mostly catches cones and sub-rays reaching past a frustum edge.
+ * The frustum test is conservative (cell against each frustum plane), so no detection is lost.
+ *
+ * Only depends on the cameras: rebuild when builtFor() returns false.
+ */
+struct CoverageVolume {
+    Voxel zone{{0.f, 0.f, 0.f}, 0.f};
+    int resolution = 32;
+    std::vector<uint8_t> counts;                    // x + y * resolution + z * resolution²
+    std::vector<Eigen::Matrix4f> view_projections;  // of the cameras it was built for
+
+    static CoverageVolume build(const std::vector<scene::Camera>& cameras, const Voxel& zone, int resolution = 32) {
+        CoverageVolume coverage;
+        coverage.zone = zone;
+        coverage.resolution = resolution;
+        coverage.counts.assign(static_cast<size_t>(resolution) * resolution * resolution, 0);
+
+        float cell_size = zone.half_size * 2.0f / resolution;
+        Eigen::Vector3f grid_min = zone.center - Eigen::Vector3f::Constant(zone.half_size);
+
+        for (const auto& camera : cameras) {
+            Eigen::Matrix4f m = camera.getViewProjectionMatrix();
+            coverage.view_projections.push_back(m);
+
+            // Frustum planes (Gribb & Hartmann), inside is dot(plane, p) >= 0, clip z in [0, 1]
+            std::array<Eigen::Vector4f, 6> planes = {
+                Eigen::Vector4f(m.row(3) + m.row(0)), Eigen::Vector4f(m.row(3) - m.row(0)),
+                Eigen::Vector4f(m.row(3) + m.row(1)), Eigen::Vector4f(m.row(3) - m.row(1)),
+                Eigen::Vector4f(m.row(2)),            Eigen::Vector4f(m.row(3) - m.row(2)),
+            };
+
+            for (int z = 0; z < resolution; ++z) {
+                for (int y = 0; y < resolution; ++y) {
+                    for (int x = 0; x < resolution; ++x) {
+                        Eigen::Vector3f lo = grid_min + Eigen::Vector3f(x, y, z) * cell_size;
+
+                        bool outside = false;
+                        for (const auto& plane : planes) {
+                            // Corner of the cell farthest along the plane normal
+                            Eigen::Vector3f corner = lo;
+                            for (int i = 0; i < 3; ++i) {
+                                if (plane[i] > 0.0f) corner[i] += cell_size;
+                            }
+                            if (plane.head<3>().dot(corner) + plane[3] < 0.0f) {
+                                outside = true;
+                                break;
+                            }
+                        }
+
+                        uint8_t& count = coverage.counts[x + y * resolution + z * resolution * resolution];
+                        if (!outside && count < 255) count++;
+                    }
+                }
+            }
+        }
+
+        return coverage;
+    }
+
+    bool builtFor(const std::vector<scene::Camera>& cameras) const {
+        if (cameras.size() != view_projections.size()) return false;
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            if (!cameras[i].getViewProjectionMatrix().isApprox(view_projections[i])) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Sets ray.t_min / t_max to the span of the cells with at least min_cameras frustums.
+     * The span is padded by one cell on each side for the sub-rays, which diverge slightly.
+     * Returns false if the ray crosses no such cell.
+     */
+    bool clip(Ray& ray, size_t min_cameras) const {
+        float t_entry = getRayEntryT(ray, zone);
+        if (t_entry < 0) return false;
+
+        std::vector<std::pair<int, float>> cells = traverseGrid(ray, t_entry, zone, resolution);
+
+        int first = -1, last = -1;
+        for (int i = 0; i < static_cast<int>(cells.size()); ++i) {
+            if (counts[cells[i].first] >= min_cameras) {
+                if (first < 0) first = i;
+                last = i;
+            }
+        }
+        if (first < 0) return false;
+
+        float cell_size = zone.half_size * 2.0f / resolution;
+        ray.t_min = std::max(ray.t_min, cells[first].second - cell_size);
+        if (last + 1 < static_cast<int>(cells.size())) {
+            ray.t_max = std::min(ray.t_max, cells[last + 1].second + cell_size);
+        }
+        return true;
+    }
+
+    // Whether a cell overlapping voxel has at least min_cameras frustums. Voxels reaching outside
+    // the zone are assumed covered.
+    bool covers(const Voxel& voxel, size_t min_cameras) const {
+        float cell_size = zone.half_size * 2.0f / resolution;
+        Eigen::Vector3f grid_min = zone.center - Eigen::Vector3f::Constant(zone.half_size);
+        Eigen::Vector3f lo = (voxel.center - Eigen::Vector3f::Constant(voxel.half_size) - grid_min) / cell_size;
+        Eigen::Vector3f hi = (voxel.center + Eigen::Vector3f::Constant(voxel.half_size) - grid_min) / cell_size;
+        if (lo.minCoeff() < 0.0f || hi.maxCoeff() > static_cast<float>(resolution)) return true;
+
+        // Cells touching the voxel only on a face are left out
+        Eigen::Vector3i first = lo.array().floor().cast<int>().matrix();
+        Eigen::Vector3i last = (hi.array().ceil() - 1.0f).cast<int>().matrix().cwiseMax(first);
+        for (int z = first.z(); z <= last.z(); ++z) {
+            for (int y = first.y(); y <= last.y(); ++y) {
+                for (int x = first.x(); x <= last.x(); ++x) {
+                    if (counts[x + y * resolution + z * resolution * resolution] >= min_cameras) return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * How recursive_detection picks the subdivision factor n (n×n×n children) of a node.
+ *
+ * - Fixed: always fixed_n (historical behaviour)
+ * - PerDepth: per_depth[depth], the last entry repeats for deeper levels
+ * - Adaptive: chosen per node from its ray density and the occupancy of its parent
+ *
+ * Whatever the mode, the factor is still clamped so children don't go below min_voxel_size.
+ */
+enum class SubdivisionMode {
+    Fixed,
+    PerDepth,
+    Adaptive
+};
+
+struct SubdivisionSchedule {
+    SubdivisionMode mode = SubdivisionMode::Fixed;
+    int fixed_n = 8;
+    std::vector<int> per_depth;
+
+    // Adaptive mode parameters
+    int min_n = 2;
+    int max_n = 16;
+    float target_rays_per_cell = 4.0f;  // a ray crosses ~n of the n^3 cells, so density ~ rays / n^2
+    float high_occupancy = 0.25f;       // above this fraction of surviving cells, pruning stops paying off
+
+    static SubdivisionSchedule fixed(int n) {
+        SubdivisionSchedule schedule;
+        schedule.mode = SubdivisionMode::Fixed;
+        schedule.fixed_n = n;
+        return schedule;
+    }
+
+    static SubdivisionSchedule perDepth(std::vector<int> factors) {
+        SubdivisionSchedule schedule;
+        schedule.mode = SubdivisionMode::PerDepth;
+        schedule.per_depth = std::move(factors);
+        return schedule;
+    }
+
+    static SubdivisionSchedule adaptive(int min_n = 2, int max_n = 16) {
+        SubdivisionSchedule schedule;
+        schedule.mode = SubdivisionMode::Adaptive;
+        schedule.min_n = min_n;
+        schedule.max_n = max_n;
+        return schedule;
+    }
+
+    /**
+     * Subdivision factor for a node, before the min_voxel_size clamp.
+     *
+     * Args:
+     * - depth: depth of the node being split (root is 0)
+     * - ray_count: number of candidate rays reaching the node
+     * - parent_occupancy: fraction of the parent's cells that were recursed into (0 for the root)
+     */
+    int factorFor(int depth, size_t ray_count, float parent_occupancy) const {
+        switch (mode) {
+            case SubdivisionMode::Fixed:
+                return fixed_n;
+
+            case SubdivisionMode::PerDepth:
+                if (per_depth.empty()) return fixed_n;
+                return per_depth[std::min(static_cast<size_t>(depth), per_depth.size() - 1)];
+
+            case SubdivisionMode::Adaptive: {
+                // Largest power of two keeping enough rays per cell for the camera vote to prune anything.
+                // Few rays over a fine grid only buys DDA steps.
+                int n = min_n;
+                while (n * 2 <= max_n && static_cast<float>(ray_count) / ((n * 2) * (n * 2)) >= target_rays_per_cell) {
+                    n *= 2;
+                }
+                // The parent barely pruned: the motion fills this region, a finer grid won't cut more
+                if (parent_occupancy > high_occupancy) {
+                    n = std::max(min_n, n / 2);
+                }
+                return n;
+            }
+        }
+        return fixed_n;
+    }
+};
+
+/**
+ * How a ray wider than the cells it crosses is handled.
+ *
+ * - Subdivide: split it into 4 narrower rays (subdivideRay) once its footprint exceeds 2 child voxels
+ * - Cone: keep one ray, treated as a cone of half-angle pixel_angular_size / 2, and collect every
+ *   cell the cone may touch with a conservative test (traverseCone). No extra rays are created.
+ */
+enum class RayFootprintMode {
+    Subdivide,
+    Cone
+};
+
+/**
+ * How moving pixels are turned into rays.
+ *
+ * - Pixel: one ray per moving pixel
+ * - Blob: one ray per 8-connected blob of moving pixels, through its centroid and as wide as the
+ *   blob (see groupMotionPixels). The ray count follows the number of moving objects instead of
+ *   their area; wide rays are narrowed again during descent by subdivideRay or the cone traversal.
+ */
+enum class RayGrouping {
+    Pixel,
+    Blob
+};
+
+/**
+ * How the octree descent decides which cells a camera sees moving.
+ *
+ * - RayCasting: rays are cast through the moving pixels and traversed through the cells
+ *   (recursive_detection). Cost follows the number of rays.
+ * - Projection: each cell is projected into every camera and the moving pixels under its screen
+ *   rectangle are counted with a summed-area table (MotionIntegral, recursive_projection). Cost
+ *   follows the number of cells visited, whatever the amount of motion.
+ */
+enum class DetectionMode {
+    RayCasting,
+    Projection
+};
+
+struct DetectionConfig {
+    float min_voxel_size = 0.1f;    // voxel size at which the recursion stops
+    size_t min_ray_threshold = 3;   // distinct cameras needed for a voxel to be kept
+    SubdivisionSchedule schedule;
+    RayFootprintMode footprint_mode = RayFootprintMode::Subdivide;
+    float cone_min_footprint = 0.25f;  // Cone mode and pyramid rays: below this fraction of a cell, the cone is walked as a line
+    std::shared_ptr<const ClutterCells> clutter;  // optional, nodes inside these cells are skipped
+    std::shared_ptr<const CoverageVolume> coverage;  // optional, rays are clipped to the covered cells, other nodes skipped
+    RayGrouping ray_grouping = RayGrouping::Pixel;
+    int max_bundle_pixels = 16;     // Blob grouping: larger blobs are split in tiles of this size
+    int motion_pyramid_levels = 0;  // > 0: rays start from blocks of 2^levels pixels (see MotionPyramid), ray_grouping is ignored
+    DetectionMode mode = DetectionMode::RayCasting;  // Projection ignores the ray options above
+    float projection_margin = 0.25f;  // Projection: pixels the voxel footprint is grown by (see MotionIntegral)
+    int descent_threads = 1;        // RayCasting: > 1 descends the root's children on this many threads (not while recording debug)
+    bool record_votes = false;      // RayCasting: fill DetectionStats::votes (see refineClusterCentroids)
 };
 
 std::vector<Ray> subdivideRay(const Ray& ray) {
@@ -75,7 +604,7 @@ std::vector<Ray> subdivideRay(const Ray& ray) {
     for (int i : {-1, 1}) {
         for (int j : {-1, 1}) {
             Eigen::Vector3f new_dir = ray.direction + (i * offset) * u + (j * offset) * v;
-            sub_rays[idx++] = {ray.origin, new_dir.normalized(), ray.camera_id, new_size};
+            sub_rays[idx++] = {ray.origin, new_dir.normalized(), ray.camera_id, new_size, ray.id, ray.t_min, ray.t_max};
         }
     }
 
@@ -83,35 +612,295 @@ std::vector<Ray> subdivideRay(const Ray& ray) {
 }
 
 
-std::vector<Ray> generateRays(const scene::Camera& camera,
-                               const std::vector<std::pair<float, float>>& pixels,
-                               float screenWidth, float screenHeight, int camera_id) {
+/**
+ * Unit direction from origin through the point (x, y) of a width×height image, in pixel
+ * coordinates (y down), unprojected at the far plane.
+ */
+Eigen::Vector3f pixelRayDirection(const Eigen::Matrix4f& inv_view_projection, const Eigen::Vector3f& origin,
+                                  float x, float y, float width, float height) {
+    // Convert to NDC
+    float ndcX = (2.0f * x) / width - 1.0f;
+    float ndcY = 1.0f - (2.0f * y) / height;
+
+    Eigen::Vector4f worldCoords = inv_view_projection * Eigen::Vector4f(ndcX, ndcY, 1.0f, 1.0f);
+    Eigen::Vector3f worldPoint = worldCoords.head<3>() / worldCoords.w();
+    return (worldPoint - origin).normalized();
+}
+
+/**
+ * Writes the rays of the given pixels of camera to out[0 .. pixels.size()), one pixel wide.
+ * Lets each camera fill its own slice of a shared buffer without locking.
+ */
+void generateRaysInto(const scene::Camera& camera,
+                      const std::vector<cv::Point>& pixels,
+                      float screenWidth, float screenHeight, int camera_id, Ray* out) {
     Eigen::Matrix4f invViewProj = camera.getViewProjectionMatrix().inverse();
 
-    std::vector<Ray> rays;
-    rays.reserve(pixels.size());
+    float fov_radians = camera.fov * (M_PI / 180.0f);
+    float pixel_angular_size = fov_radians / screenWidth;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        Eigen::Vector3f direction = pixelRayDirection(invViewProj, camera.position, static_cast<float>(pixels[i].x),
+                                                      static_cast<float>(pixels[i].y), screenWidth, screenHeight);
+        out[i] = {camera.position, direction, camera_id, pixel_angular_size};
+    }
+}
+
+/**
+ * Group of neighbouring moving pixels cast as a single ray.
+ */
+struct PixelBundle {
+    float x, y;         // centroid, in pixels
+    float extent;       // diameter covering the pixels of the bundle, in pixels
+};
+
+/**
+ * Collapses the moving pixels of a motion mask into one bundle per 8-connected blob.
+ *
+ * Blobs larger than max_bundle_pixels in width or height are split in tiles of that size, one
+ * bundle per non-empty tile, so that a large moving area does not become a single ray wider
+ * than the octree cells it has to vote in.
+ *
+ * Args:
+ * - motion_mask: CV_8U, non-zero for moving pixels
+ * - max_bundle_pixels: largest bundle side
+ */
+std::vector<PixelBundle> groupMotionPixels(const cv::Mat& motion_mask, int max_bundle_pixels) {
+    cv::Mat labels, blob_stats, centroids;
+    int label_count = cv::connectedComponentsWithStats(motion_mask, labels, blob_stats, centroids, 8, CV_32S);
+
+    std::vector<PixelBundle> bundles;
+    bundles.reserve(label_count);
+
+    for (int label = 1; label < label_count; ++label) {  // 0 is the background
+        int left = blob_stats.at<int>(label, cv::CC_STAT_LEFT);
+        int top = blob_stats.at<int>(label, cv::CC_STAT_TOP);
+        int width = blob_stats.at<int>(label, cv::CC_STAT_WIDTH);
+        int height = blob_stats.at<int>(label, cv::CC_STAT_HEIGHT);
+
+        if (width <= max_bundle_pixels && height <= max_bundle_pixels) {
+            bundles.push_back({
+                static_cast<float>(centroids.at<double>(label, 0)),
+                static_cast<float>(centroids.at<double>(label, 1)),
+                std::hypot(static_cast<float>(width), static_cast<float>(height))
+            });
+            continue;
+        }
+
+        // Large blob: centroid of its pixels in each tile of the bounding box
+        for (int tile_y = top; tile_y < top + height; tile_y += max_bundle_pixels) {
+            for (int tile_x = left; tile_x < left + width; tile_x += max_bundle_pixels) {
+                int x_end = std::min(tile_x + max_bundle_pixels, left + width);
+                int y_end = std::min(tile_y + max_bundle_pixels, top + height);
+
+                float sum_x = 0.0f, sum_y = 0.0f;
+                int count = 0;
+                for (int y = tile_y; y < y_end; ++y) {
+                    const int* row = labels.ptr<int>(y);
+                    for (int x = tile_x; x < x_end; ++x) {
+                        if (row[x] == label) {
+                            sum_x += x;
+                            sum_y += y;
+                            count++;
+                        }
+                    }
+                }
+
+                if (count > 0) {
+                    bundles.push_back({sum_x / count, sum_y / count,
+                                       std::hypot(static_cast<float>(x_end - tile_x), static_cast<float>(y_end - tile_y))});
+                }
+            }
+        }
+    }
+
+    return bundles;
+}
+
+/**
+ * Same as generateRaysInto, with one ray per bundle, as wide as the bundle.
+ */
+void generateBundleRaysInto(const scene::Camera& camera,
+                            const std::vector<PixelBundle>& bundles,
+                            float screenWidth, float screenHeight, int camera_id, Ray* out) {
+    Eigen::Matrix4f invViewProj = camera.getViewProjectionMatrix().inverse();
 
     float fov_radians = camera.fov * (M_PI / 180.0f);
     float pixel_angular_size = fov_radians / screenWidth;
-    for (const auto& [pixelX, pixelY] : pixels) {
-        // Convert to NDC
-        float ndcX = (2.0f * pixelX) / screenWidth - 1.0f;
-        float ndcY = 1.0f - (2.0f * pixelY) / screenHeight;
+    for (size_t i = 0; i < bundles.size(); ++i) {
+        Eigen::Vector3f direction = pixelRayDirection(invViewProj, camera.position, bundles[i].x, bundles[i].y,
+                                                      screenWidth, screenHeight);
+        out[i] = {camera.position, direction, camera_id, pixel_angular_size * std::max(bundles[i].extent, 1.0f)};
+    }
+}
 
-        Eigen::Vector4f clipCoords(ndcX, ndcY, 1.0f, 1.0f);
-        Eigen::Vector4f worldCoords = invViewProj * clipCoords;
-        Eigen::Vector3f worldPoint = worldCoords.head<3>() / worldCoords.w();
+/**
+ * Motion mask of one camera at decreasing resolutions: levels[k] has one cell per 2^k×2^k block of
+ * the full resolution mask, set if any pixel of the block moves.
+ *
+ * Coarse octree levels do not need full resolution rays. Detection starts from one ray per moving
+ * cell of the coarsest level, and refinePyramidRay replaces a ray by the rays of its moving
+ * children one level down once it gets wider than the octree cells it traverses. The image is
+ * only looked at in full resolution inside the projection of the voxels that survived.
+ */
+struct MotionPyramid {
+    std::vector<cv::Mat> levels;        // CV_8U, 0 or 255, levels[0] is the motion mask
+    Eigen::Vector3f camera_position;
+    Eigen::Matrix4f inv_view_projection;
+    int camera_id = 0;
+    float pixel_angular_size = 0.0f;    // of a full resolution pixel
+
+    static MotionPyramid build(const cv::Mat& motion_mask, const scene::Camera& camera, int camera_id, int level_count) {
+        MotionPyramid pyramid;
+        pyramid.camera_position = camera.position;
+        pyramid.inv_view_projection = camera.getViewProjectionMatrix().inverse();
+        pyramid.camera_id = camera_id;
+        pyramid.pixel_angular_size = camera.fov * (M_PI / 180.0f) / motion_mask.cols;
+
+        pyramid.levels.push_back(motion_mask);
+        for (int level = 1; level <= level_count; ++level) {
+            const cv::Mat& finer = pyramid.levels.back();
+            cv::Mat coarser;
+            // Area averaging then "> 0" is an OR over each 2×2 block
+            cv::resize(finer, coarser, cv::Size((finer.cols + 1) / 2, (finer.rows + 1) / 2), 0, 0, cv::INTER_AREA);
+            cv::threshold(coarser, coarser, 0, 255, cv::THRESH_BINARY);
+            pyramid.levels.push_back(coarser);
+        }
+        return pyramid;
+    }
 
-        rays.push_back({camera.position, (worldPoint - camera.position).normalized(), camera_id, pixel_angular_size});
+    // Ray through the center of cell (x, y) of a level, as wide as the cell
+    Ray rayAt(int level, int x, int y) const {
+        float scale = static_cast<float>(1 << level);
+        float width = static_cast<float>(levels[0].cols);
+        float height = static_cast<float>(levels[0].rows);
+
+        // Full resolution pixel coordinates of the cell center, level 0 gives the pixel itself
+        float pixelX = (x + 0.5f) * scale - 0.5f;
+        float pixelY = (y + 0.5f) * scale - 0.5f;
+
+        Ray ray{camera_position, pixelRayDirection(inv_view_projection, camera_position, pixelX, pixelY, width, height),
+                camera_id, pixel_angular_size * scale};
+        ray.pyramid_level = static_cast<uint8_t>(level);
+        ray.pixel_x = static_cast<uint16_t>(x);
+        ray.pixel_y = static_cast<uint16_t>(y);
+        return ray;
     }
+};
 
-    return rays;
+/**
+ * Appends the rays of the moving children of a pyramid ray (at pyramid_level - 1) to out.
+ * Children keep the id and the [t_min, t_max] span of the parent.
+ */
+void refinePyramidRay(const Ray& ray, const MotionPyramid& pyramid, std::vector<Ray>& out) {
+    int level = ray.pyramid_level - 1;
+    const cv::Mat& mask = pyramid.levels[level];
+
+    for (int dy = 0; dy < 2; ++dy) {
+        int y = ray.pixel_y * 2 + dy;
+        if (y >= mask.rows) continue;
+        const uint8_t* row = mask.ptr<uint8_t>(y);
+
+        for (int dx = 0; dx < 2; ++dx) {
+            int x = ray.pixel_x * 2 + dx;
+            if (x >= mask.cols || !row[x]) continue;
+
+            Ray child = pyramid.rayAt(level, x, y);
+            child.id = ray.id;
+            child.t_min = ray.t_min;
+            child.t_max = ray.t_max;
+            out.push_back(child);
+        }
+    }
 }
 
+/**
+ * Summed-area table of the motion mask of one camera, for DetectionMode::Projection.
+ *
+ * movingPixels counts the moving pixels under the screen rectangle bounding the projection of a
+ * voxel with 4 lookups, so the test costs the same for the root zone as for a leaf.
+ *
+ * A pixel center inside the projection is exactly a pixel ray crossing the voxel. Rays are wider
+ * than that (RayCasting splits them once they cover 2 cells), so the rectangle is grown by
+ * `margin` pixels: 0 only counts pixel centers and loses small targets whose center rays miss each
+ * other, 0.5 counts every pixel the rectangle touches and smears detections across the footprint.
+ */
+struct MotionIntegral {
+    cv::Mat sum;                        // CV_32S, (rows + 1) × (cols + 1), moving pixels above and left of each entry
+    Eigen::Matrix4f view_projection;
+    int width = 0;
+    int height = 0;
+
+    static MotionIntegral build(const cv::Mat& motion_mask, const scene::Camera& camera) {
+        MotionIntegral integral;
+        integral.view_projection = camera.getViewProjectionMatrix();
+        integral.width = motion_mask.cols;
+        integral.height = motion_mask.rows;
+
+        cv::Mat ones;
+        cv::threshold(motion_mask, ones, 0, 1, cv::THRESH_BINARY);
+        cv::integral(ones, integral.sum, CV_32S);
+        return integral;
+    }
+
+    int totalMovingPixels() const {
+        return sum.at<int>(height, width);
+    }
+
+    // Pixel coordinates (x, y) and clip w of a point, pixel x is centered on ndc 2x / width - 1 as in generateRaysInto
+    Eigen::Vector3f project(const Eigen::Vector3f& point) const {
+        Eigen::Vector4f clip = view_projection * point.homogeneous();
+        if (clip.w() <= 0.0f) return {0.0f, 0.0f, clip.w()};
+        return {(clip.x() / clip.w() + 1.0f) * 0.5f * width, (1.0f - clip.y() / clip.w()) * 0.5f * height, clip.w()};
+    }
+
+    /**
+     * Moving pixels centered in the bounding rectangle of projected corners (from project), grown by margin.
+     * A box reaching behind the camera is given the whole image, a conservative answer.
+     */
+    int movingPixels(const std::array<Eigen::Vector3f, 8>& corners, float margin = 0.25f) const {
+        float min_x = std::numeric_limits<float>::infinity();
+        float min_y = min_x;
+        float max_x = -min_x;
+        float max_y = -min_x;
+        int behind = 0;
+
+        for (const auto& corner : corners) {
+            if (corner.z() <= 0.0f) {
+                behind++;
+                continue;
+            }
+            min_x = std::min(min_x, corner.x());
+            max_x = std::max(max_x, corner.x());
+            min_y = std::min(min_y, corner.y());
+            max_y = std::max(max_y, corner.y());
+        }
+
+        if (behind == 8) return 0;
+        if (behind > 0) return totalMovingPixels();
+
+        int x0 = std::max(0, static_cast<int>(std::ceil(min_x - margin)));
+        int y0 = std::max(0, static_cast<int>(std::ceil(min_y - margin)));
+        int x1 = std::min(width - 1, static_cast<int>(std::floor(max_x + margin)));
+        int y1 = std::min(height - 1, static_cast<int>(std::floor(max_y + margin)));
+        if (x0 > x1 || y0 > y1) return 0;
+
+        return sum.at<int>(y1 + 1, x1 + 1) - sum.at<int>(y0, x1 + 1) - sum.at<int>(y1 + 1, x0) + sum.at<int>(y0, x0);
+    }
+
+    int movingPixels(const Voxel& voxel, float margin = 0.25f) const {
+        std::array<Eigen::Vector3f, 8> corners;
+        for (int corner = 0; corner < 8; ++corner) {
+            Eigen::Vector3f offset((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+            corners[corner] = project(voxel.center + offset * voxel.half_size);
+        }
+        return movingPixels(corners, margin);
+    }
+};
+
 // https://en.wikipedia.org/wiki/Slab_method
 bool rayIntersectsVoxel(const Ray& ray, const Voxel& voxel) {
-    float tmin = 0.0f;
-    float tmax = std::numeric_limits<float>::infinity();
+    float tmin = ray.t_min;
+    float tmax = ray.t_max;
 
     for (int i = 0; i < 3; ++i) {
         // Compute min and max from center + half_size
@@ -137,8 +926,8 @@ bool rayIntersectsVoxel(const Ray& ray, const Voxel& voxel) {
  *
  */
 float getRayEntryT(const Ray& ray, const Voxel& voxel) {
-    float tmin = 0.0f;
-    float tmax = std::numeric_limits<float>::infinity();
+    float tmin = ray.t_min;
+    float tmax = ray.t_max;
 
     for (int i = 0; i < 3; ++i) {
         // Compute min and max from center + half_size
@@ -216,7 +1005,8 @@ std::vector<std::pair<int, float>> traverseGrid(const Ray& ray, float t_entry, c
 
     while (curr_idx_vec.x() >= 0 && curr_idx_vec.x() < n
         && curr_idx_vec.y() >= 0 && curr_idx_vec.y() < n
-        && curr_idx_vec.z() >= 0 && curr_idx_vec.z() < n) {
+        && curr_idx_vec.z() >= 0 && curr_idx_vec.z() < n
+        && curr_t <= ray.t_max) {
 
         // record curr voxel to result
         int idx = curr_idx_vec.x() + curr_idx_vec.y() * n + curr_idx_vec.z() * n * n;
@@ -260,70 +1050,290 @@ Voxel indexToVoxel(int idx, const Voxel& parent, int n) {
 }
 
 /**
- * Populates the "detections" vector with all voxels where we might have found an object
- *
+ * Conservative cone vs axis aligned box test.
  *
+ * The box is replaced by its bounding sphere, so this can report cells the cone only grazes, but
+ * never misses one it touches.
+ * The cone has its apex at the ray origin, axis ray.direction (unit) and the given half-angle.
  */
-void recursive_detection(Voxel& target_zone, std::vector<Ray>& candidate_rays, float min_voxel_size, size_t min_ray_threshold, std::vector<Voxel>& detections,DetectionStats& stats, DebugVisualization& debug_viz, int subdiv_n, int depth = 0){
+bool coneIntersectsVoxel(const Ray& ray, float sin_half_angle, float cos_half_angle, const Voxel& voxel) {
+    float radius = voxel.half_size * 1.7320508f;  // sqrt(3)
+    Eigen::Vector3f to_center = voxel.center - ray.origin;
 
-    debug_viz.voxels.push_back({target_zone, false, depth});
+    float along = to_center.dot(ray.direction);
+    if (along < -radius) return false;  // behind the camera
 
-    stats.nodes_visited++;
-    stats.total_depth += depth;
+    float across = (to_center - along * ray.direction).norm();
+    // Signed distance from the sphere center to the cone surface, measured perpendicular to it
+    return across * cos_half_angle - along * sin_half_angle <= radius;
+}
 
-    // If we reached target size, make final detection
-    float current_size = target_zone.half_size * 2.0;
-    if (current_size <= min_voxel_size) {
-        // No need to check ray voxel intersection because if it wasn't intersecting the recursion would not be called on this voxel
-        detections.push_back(target_zone);
-        debug_viz.voxels[debug_viz.voxels.size() - 1].is_detection = true;
-        return;
+/**
+ * Cone counterpart of traverseGrid: flattened indices of all the cells of the n×n×n grid
+ * inside target_voxel that the cone around the ray may touch, sorted and without duplicates.
+ * Empty when coneIntersectsVoxel rejects target_voxel.
+ *
+ * The axis is sampled one cell apart between the first and last distances at which the cone can
+ * reach target_voxel (its bounding sphere), whether or not the center line enters it. Around
+ * each sample, the cells within the cone radius there plus half a step are tested with
+ * coneIntersectsVoxel; every point of the cone is within that distance of a sample, so no
+ * touched cell is missed.
+ * While the cone radius stays under min_footprint cells over the whole grid, the cone is walked
+ * as its center line (plain DDA), which misses target_voxel when the line does.
+ */
+std::vector<int> traverseCone(const Ray& ray, const Voxel& target_voxel, int n, float min_footprint, DetectionStats& stats) {
+    std::vector<int> cells;
+    float half_angle = ray.pixel_angular_size * 0.5f;
+    float sin_half_angle = std::sin(half_angle);
+    float cos_half_angle = std::cos(half_angle);
+    float tan_half_angle = std::tan(half_angle);
+    if (!coneIntersectsVoxel(ray, sin_half_angle, cos_half_angle, target_voxel)) return cells;
+
+    // Distances along the axis where the cone can meet the bounding sphere of target_voxel
+    float voxel_size = (target_voxel.half_size * 2) / n;
+    float radius = target_voxel.half_size * 1.7320508f;  // sqrt(3)
+    float along = (target_voxel.center - ray.origin).dot(ray.direction);
+    float t_near = std::max(ray.t_min, along - radius);
+    float t_far = std::min(along + radius, ray.t_max);
+    if (t_far < t_near) return cells;
+
+    if (t_far * tan_half_angle < min_footprint * voxel_size) {
+        float t_entry = getRayEntryT(ray, target_voxel);
+        if (t_entry < 0) return cells;
+        for (const auto& [idx, t] : traverseGrid(ray, t_entry, target_voxel, n)) {
+            cells.push_back(idx);
+        }
+        return cells;
     }
 
+    Eigen::Vector3f grid_min = target_voxel.center - Eigen::Vector3f::Constant(target_voxel.half_size);
+    float slack = voxel_size * 0.5f;  // half the distance between two samples
+    std::vector<char> tested(size_t(n) * n * n, 0);
+    int samples = static_cast<int>(std::ceil((t_far - t_near) / voxel_size)) + 1;
+
+    for (int s = 0; s < samples; ++s) {
+        float t = std::min(t_near + s * voxel_size, t_far);
+        Eigen::Vector3f axis = ray.origin + ray.direction * t;
+        float extent = (t + slack) * tan_half_angle + slack;
+
+        int lo[3], hi[3];
+        bool outside = false;
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = std::max(0, static_cast<int>(std::floor((axis[k] - extent - grid_min[k]) / voxel_size)));
+            hi[k] = std::min(n - 1, static_cast<int>(std::floor((axis[k] + extent - grid_min[k]) / voxel_size)));
+            outside |= lo[k] > hi[k];
+        }
+        if (outside) continue;
+
+        for (int z = lo[2]; z <= hi[2]; ++z) {
+            for (int y = lo[1]; y <= hi[1]; ++y) {
+                for (int x = lo[0]; x <= hi[0]; ++x) {
+                    int idx = x + y * n + z * n * n;
+                    if (tested[idx]) continue;
+                    tested[idx] = 1;
+
+                    stats.cone_cells_tested++;
+                    if (coneIntersectsVoxel(ray, sin_half_angle, cos_half_angle, indexToVoxel(idx, target_voxel, n))) {
+                        cells.push_back(idx);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(cells.begin(), cells.end());
+    return cells;
+}
+
+/**
+ * Subdivision factor of a node of recursive_detection, clamped so that children are not smaller
+ * than min_voxel_size.
+ */
+int nodeSubdivision(const Voxel& target_zone, size_t ray_count, const DetectionConfig& config, DetectionStats& stats, int depth, float parent_occupancy) {
+    int subdiv_n = config.schedule.factorFor(depth, ray_count, parent_occupancy);
+
     // Clamp subdivision so child voxels don't go below min_voxel_size
-    int max_subdiv = static_cast<int>(current_size / min_voxel_size);
+    float current_size = target_zone.half_size * 2.0f;
+    int max_subdiv = static_cast<int>(current_size / config.min_voxel_size);
     subdiv_n = std::min(subdiv_n, std::max(2, max_subdiv));
+    if (depth < static_cast<int>(stats.subdiv_per_depth.size())) {
+        stats.subdiv_per_depth[depth] = subdiv_n;
+    }
+    return subdiv_n;
+}
 
-    // Separate into n*n*n smaller voxels
-    int total_cells = subdiv_n * subdiv_n * subdiv_n;  // 512 for 8×8×8
-    std::vector<std::vector<Ray>> child_rays_map(total_cells);
+/**
+ * Rays of an octree descent, addressed by 32-bit index.
+ *
+ * Indices below base() are the root rays, in a vector the pool only reads, so that threads
+ * descending different branches share them. Rays made during the descent (sub-rays, refined
+ * pyramid rays) go to the pool's own side vector and take the indices from base() on; a pool per
+ * thread keeps them apart without locking.
+ */
+class RayPool {
+public:
+    RayPool() = default;
+    explicit RayPool(const std::vector<Ray>& shared) : shared_(&shared), base_(shared.size()) {}
 
+    const Ray& operator[](uint32_t index) const {
+        return index < base_ ? (*shared_)[index] : local_[index - base_];
+    }
 
+    size_t size() const {
+        return base_ + local_.size();
+    }
 
-    for(auto ray : candidate_rays){
-        float t_entry = getRayEntryT(ray, target_zone); // get where the ray enters the target zone
+    size_t base() const {
+        return base_;
+    }
 
-        // Calculate if we need to subdivide
-        float distance = t_entry;
-        float ray_footprint = distance * ray.pixel_angular_size;
-        float child_voxel_size = (target_zone.half_size * 2.0f) / subdiv_n;
+    void push_back(const Ray& ray) {
+        local_.push_back(ray);
+    }
+
+    // Drops the rays from index size on, not below base()
+    void resize(size_t size) {
+        local_.resize(size - base_);
+    }
+
+    void reserve(size_t size) {
+        local_.reserve(size > base_ ? size - base_ : 0);
+    }
 
-        std::vector<Ray> rays_to_process;
+private:
+    const std::vector<Ray>* shared_ = nullptr;
+    size_t base_ = 0;
+    std::vector<Ray> local_;
+};
 
-        float threshold = 2.0f;
-        if (ray_footprint > child_voxel_size * threshold && depth > 1) { // if the ray is bigger than the voxel size, we subdivide to avoid missing intersections because of sampling
-            stats.rays_subdivided++;
-            stats.total_subrays_created += 3; // 4 new rays but net +3
-            rays_to_process = subdivideRay(ray);
-        } else {
-            rays_to_process = {ray};
+/**
+ * One level of recursive_detection: buckets the candidate rays of target_zone into its
+ * subdiv_n^3 cells (child_rays_map, indices into ray_pool) and returns the cells reached by
+ * min_ray_threshold distinct cameras. Sub-rays and refined pyramid rays are appended to ray_pool.
+ */
+std::vector<int> distributeRays(const Voxel& target_zone, int subdiv_n, const std::vector<uint32_t>& candidate_rays, RayPool& ray_pool, const DetectionConfig& config, DetectionStats& stats, int depth, const std::vector<MotionPyramid>* pyramids, std::vector<std::vector<uint32_t>>& child_rays_map) {
+    // Separate into n*n*n smaller voxels
+    int total_cells = subdiv_n * subdiv_n * subdiv_n;  // 512 for 8×8×8
+    child_rays_map.assign(total_cells, {});
+
+    // Pyramid rays are replaced by their moving children, one level finer at a time, until they are narrower
+    // than cone_min_footprint children: from there a line samples them as well as a full resolution ray
+    std::vector<uint32_t> refined_rays;
+    const std::vector<uint32_t>* rays = &candidate_rays;
+    bool has_pyramid_rays = pyramids && std::any_of(candidate_rays.begin(), candidate_rays.end(),
+                                                    [&](uint32_t index) { return ray_pool[index].pyramid_level > 0; });
+    if (has_pyramid_rays) {
+        float child_voxel_size = (target_zone.half_size * 2.0f) / subdiv_n;
+        std::vector<Ray> pending;
+        refined_rays.reserve(candidate_rays.size());
+        for (uint32_t index : candidate_rays) {
+            if (ray_pool[index].pyramid_level > 0) {
+                pending.push_back(ray_pool[index]);
+            } else {
+                refined_rays.push_back(index);
+            }
         }
 
-        for (const auto& r : rays_to_process) {
-            float t = getRayEntryT(r, target_zone);
-            if (t < 0) continue;  // skip if doesn't intersect
+        while (!pending.empty()) {
+            Ray ray = pending.back();
+            pending.pop_back();
+
+            // Distance to the node, along the axis when only the cone reaches it
+            float t_entry = getRayEntryT(ray, target_zone);
+            float distance = t_entry >= 0 ? t_entry : (target_zone.center - ray.origin).dot(ray.direction);
+            if (ray.pyramid_level > 0 && distance * ray.pixel_angular_size > child_voxel_size * config.cone_min_footprint) {
+                refinePyramidRay(ray, (*pyramids)[ray.camera_id], pending);
+                stats.pyramid_rays_refined++;
+            } else {
+                refined_rays.push_back(static_cast<uint32_t>(ray_pool.size()));
+                ray_pool.push_back(ray);
+            }
+        }
+        rays = &refined_rays;
+    }
+
+    // A coarse pyramid ray stands for a whole block of pixels, its center line is not enough
+    auto traverse_as_cone = [&](const Ray& ray) {
+        return config.footprint_mode == RayFootprintMode::Cone || ray.pyramid_level > 0;
+    };
+
+    if (config.footprint_mode == RayFootprintMode::Cone || has_pyramid_rays) {
+        for (uint32_t index : *rays) {
+            const Ray& ray = ray_pool[index];
+            if (!traverse_as_cone(ray)) continue;
 
             stats.intersection_checks++;
-            std::vector<std::pair<int, float>> intersections = traverseGrid(r, t, target_zone, subdiv_n);
-            stats.voxels_visited += intersections.size();
+            std::vector<int> cells = traverseCone(ray, target_zone, subdiv_n, config.cone_min_footprint, stats);
+            stats.voxels_visited += cells.size();
 
-            for (const auto& [voxel_idx, t_val] : intersections) {
-                child_rays_map[voxel_idx].push_back(r);
+            for (int voxel_idx : cells) {
+                child_rays_map[voxel_idx].push_back(index);
             }
         }
+    }
+    if (config.footprint_mode == RayFootprintMode::Subdivide) {
+        for (uint32_t index : *rays) {
+            Ray ray = ray_pool[index];  // copy, the pool may grow below
+            if (traverse_as_cone(ray)) continue;
+
+            float t_entry = getRayEntryT(ray, target_zone); // get where the ray enters the target zone
+
+            // Calculate if we need to subdivide
+            float distance = t_entry;
+            float ray_footprint = distance * ray.pixel_angular_size;
+            float child_voxel_size = (target_zone.half_size * 2.0f) / subdiv_n;
+
+            // if the ray is bigger than the voxel size, we subdivide to avoid missing intersections because of sampling.
+            // Wide rays (RayGrouping::Blob) may need several rounds, each one halves the footprint (at most 256 sub-rays)
+            float threshold = 2.0f;
+            if (ray_footprint <= child_voxel_size * threshold || depth <= 1) {
+                if (t_entry < 0) continue;  // skip if doesn't intersect
+
+                stats.intersection_checks++;
+                std::vector<std::pair<int, float>> intersections = traverseGrid(ray, t_entry, target_zone, subdiv_n);
+                stats.voxels_visited += intersections.size();
+
+                for (const auto& [voxel_idx, t_val] : intersections) {
+                    child_rays_map[voxel_idx].push_back(index);
+                }
+                continue;
+            }
+
+            std::vector<Ray> rays_to_process = {ray};
+            for (int round = 0; round < 4 && ray_footprint > child_voxel_size * threshold; ++round) {
+                std::vector<Ray> sub_rays;
+                sub_rays.reserve(rays_to_process.size() * 4);
+                for (const auto& r : rays_to_process) {
+                    std::vector<Ray> split = subdivideRay(r);
+                    sub_rays.insert(sub_rays.end(), split.begin(), split.end());
+                }
+                stats.rays_subdivided += rays_to_process.size();
+                stats.total_subrays_created += rays_to_process.size() * 3; // 4 new rays but net +3
+                rays_to_process = std::move(sub_rays);
+                ray_footprint *= 0.5f;
+            }
+
+            for (const auto& r : rays_to_process) {
+                float t = getRayEntryT(r, target_zone);
+                if (t < 0) continue;  // skip if doesn't intersect
 
+                stats.intersection_checks++;
+                std::vector<std::pair<int, float>> intersections = traverseGrid(r, t, target_zone, subdiv_n);
+                stats.voxels_visited += intersections.size();
+                if (intersections.empty()) continue;
+
+                uint32_t sub_index = static_cast<uint32_t>(ray_pool.size());
+                ray_pool.push_back(r);
+                for (const auto& [voxel_idx, t_val] : intersections) {
+                    child_rays_map[voxel_idx].push_back(sub_index);
+                }
+            }
+
+        }
     }
-    // Recurse for children with enough cameras
+
+    // Find children with enough cameras
+    std::vector<int> surviving_children;
     for (int voxel_idx = 0; voxel_idx < total_cells; ++voxel_idx) {
         auto& child_rays = child_rays_map[voxel_idx];
 
@@ -332,118 +1342,518 @@ void recursive_detection(Voxel& target_zone, std::vector<Ray>& candidate_rays, f
         // Count unique cameras from the rays themselves
         std::unordered_set<int> cameras;
 
-        for (const auto& ray : child_rays) {
-            cameras.insert(ray.camera_id);
+        for (uint32_t index : child_rays) {
+            cameras.insert(ray_pool[index].camera_id);
         }
 
-        if (cameras.size() >= min_ray_threshold) {
-            Voxel child = indexToVoxel(voxel_idx, target_zone, subdiv_n);
-            recursive_detection(child, child_rays, min_voxel_size, min_ray_threshold, detections, stats, debug_viz, subdiv_n, depth + 1);
+        if (cameras.size() >= config.min_ray_threshold) {
+            surviving_children.push_back(voxel_idx);
         }
     }
+    return surviving_children;
 }
 
 /**
- * Returns a list of voxels in which there is a possible detection
- * Each returned voxel represents a quadrant of the initial voxel (octree)
+ * Populates the "detections" vector with all voxels where we might have found an object
  *
- * We cast a ray in the direction of all movements in the camera.
- * If multiple ray intersect with the same voxel, there is a detection in that voxel.
- * If we subdivide voxels enough, we will get a precise 3D location for the detection.
+ * parent_occupancy is the fraction of the parent's cells that were recursed into, used by the adaptive schedule.
  *
- * Args:
- * - target_zone: Initial voxel where we want to detect objects
- * - camera_frames: camera parameters, current frame, and previous frame for ray calculation
- * - min_voxel_size: voxel size at which the algorithm will stop the recursion
- * - min_ray_threshold: how many rays have to hit one voxel in order to consider that it's a detection (will depend on the number of cameras aiming at the target zone)
+ * Rays are stored once in ray_pool and the per cell buckets only hold their 4-byte indices, a
+ * Ray being 52 bytes and landing in several buckets per level. Sub-rays and refined pyramid rays
+ * made for a node are appended to the pool and dropped again when the node returns, so the pool
+ * works as a stack and only holds the rays of the current branch.
  *
- * */
-std::vector<Voxel> detect_objects(Voxel target_zone, const std::vector<CameraFrame>& camera_frames, float min_voxel_size = 0.1f, size_t min_ray_threshold = 3, int subdiv_n = 8, DebugVisualization* debug_viz = nullptr){
-    std::vector<Ray> all_rays;
-    std::vector<Voxel> detections;
-    DetectionStats stats;
+ * detections is anything with push_back(Voxel): a std::vector, or a core::AppendBuffer writer
+ * when branches are descended by several threads (see detect_objects_from_rays).
+ */
+template <typename DetectionSink>
+void recursive_detection(Voxel& target_zone, std::vector<uint32_t>& candidate_rays, RayPool& ray_pool, const DetectionConfig& config, DetectionSink& detections, DetectionStats& stats, DebugVisualization* debug_viz, int depth = 0, float parent_occupancy = 0.0f, const std::vector<MotionPyramid>* pyramids = nullptr){
+
+    stats.nodes_visited++;
+    stats.total_depth += depth;
+    if (depth < static_cast<int>(stats.nodes_per_depth.size())) {
+        stats.nodes_per_depth[depth]++;
+    }
+
+    // If we reached target size, make final detection
+    float current_size = target_zone.half_size * 2.0;
+    if (current_size <= config.min_voxel_size) {
+        // No need to check ray voxel intersection because if it wasn't intersecting the recursion would not be called on this voxel
+        detections.push_back(target_zone);
+        if (config.record_votes) {
+            DetectionVote vote{target_zone, {}};
+            vote.ray_ids.reserve(candidate_rays.size());
+            for (uint32_t index : candidate_rays) {
+                vote.ray_ids.push_back(ray_pool[index].id);
+            }
+            std::sort(vote.ray_ids.begin(), vote.ray_ids.end());
+            vote.ray_ids.erase(std::unique(vote.ray_ids.begin(), vote.ray_ids.end()), vote.ray_ids.end());
+            stats.votes.push_back(std::move(vote));
+        }
+        if (debug_viz) {
+            debug_viz->recordVoxel(target_zone, true, depth);
+            for (uint32_t index : candidate_rays) {
+                debug_viz->markContributed(ray_pool[index]);
+            }
+        }
+        return;
+    }
+
     if (debug_viz) {
-        debug_viz->rays.clear();
+        debug_viz->recordVoxel(target_zone, false, depth);
     }
 
-    for (size_t cam_idx = 0; cam_idx < camera_frames.size(); ++cam_idx) {
-        const auto& frame = camera_frames[cam_idx];
+    int subdiv_n = nodeSubdivision(target_zone, candidate_rays.size(), config, stats, depth, parent_occupancy);
+    int total_cells = subdiv_n * subdiv_n * subdiv_n;
+    size_t pool_size = ray_pool.size();  // rays added past this belong to this node
 
-    // compute temporal difference with previous image
-        cv::Mat diff;
-        cv::absdiff(frame.current_frame, frame.previous_frame, diff);
+    std::vector<std::vector<uint32_t>> child_rays_map;
+    std::vector<int> surviving_children = distributeRays(target_zone, subdiv_n, candidate_rays, ray_pool, config, stats, depth, pyramids, child_rays_map);
 
-        // If color, turn it to greyscale
-        if (diff.channels() > 1) {
-            cv::cvtColor(diff, diff, cv::COLOR_BGR2GRAY);
+    // Recurse for children with enough cameras
+    float occupancy = static_cast<float>(surviving_children.size()) / total_cells;
+    for (int voxel_idx : surviving_children) {
+        Voxel child = indexToVoxel(voxel_idx, target_zone, subdiv_n);
+        if (config.clutter && config.clutter->covers(child)) {
+            stats.clutter_hits.push_back(child);
+            continue;
+        }
+        if (config.coverage && !config.coverage->covers(child, config.min_ray_threshold)) {
+            stats.nodes_outside_coverage++;
+            continue;
         }
+        recursive_detection(child, child_rays_map[voxel_idx], ray_pool, config, detections, stats, debug_viz, depth + 1, occupancy, pyramids);
+    }
 
-        cv::Mat binary;
-        int threshold = 5;
-        cv::threshold(diff, binary, threshold, 255, cv::THRESH_BINARY);
-        //cv::imshow("Camera " + std::to_string(&frame - &camera_frames[0]) + " Diff", diff);
+    ray_pool.resize(pool_size);
+}
 
-    // Get camera rays from all pixels where movement is detected by the temporal image difference
-        std::vector<std::pair<float, float>> movement_pixels;
-        std::vector<cv::Point> points;
-        cv::findNonZero(binary, points);
-        for (const auto& pt : points) {
-            movement_pixels.push_back({static_cast<float>(pt.x), static_cast<float>(pt.y)});
-        }
+/**
+ * DetectionMode::Projection counterpart of recursive_detection.
+ *
+ * target_zone is already known to be seen moving by enough cameras. Each child is projected into
+ * every camera and kept if at least min_ray_threshold cameras have moving pixels under it. The
+ * adaptive schedule gets the moving pixel count of the node instead of a ray count, one pixel
+ * being one ray in RayCasting mode.
+ *
+ * Bounding rectangles are looser than the exact projection, so coarse levels keep slightly more
+ * cells than ray casting. At min_voxel_size the rectangle is about a pixel and both modes agree.
+ */
+void recursive_projection(Voxel& target_zone, size_t moving_pixels, const std::vector<MotionIntegral>& integrals, const DetectionConfig& config, std::vector<Voxel>& detections, DetectionStats& stats, DebugVisualization* debug_viz, int depth = 0, float parent_occupancy = 0.0f) {
+    stats.nodes_visited++;
+    stats.total_depth += depth;
+    if (depth < static_cast<int>(stats.nodes_per_depth.size())) {
+        stats.nodes_per_depth[depth]++;
+    }
 
-        auto rays = generateRays(frame.camera, movement_pixels,
-                                frame.current_frame.cols, frame.current_frame.rows, cam_idx);
-        all_rays.insert(all_rays.end(), rays.begin(), rays.end());
-        stats.ray_count = all_rays.size();
+    float current_size = target_zone.half_size * 2.0;
+    if (current_size <= config.min_voxel_size) {
+        detections.push_back(target_zone);
+        if (debug_viz) {
+            debug_viz->recordVoxel(target_zone, true, depth);
+        }
+        return;
     }
 
     if (debug_viz) {
-        debug_viz->rays.reserve(all_rays.size());
-        for (const auto& ray : all_rays) {
-            debug_viz->rays.push_back({ray, ray.camera_id, false});
+        debug_viz->recordVoxel(target_zone, false, depth);
+    }
+
+    int subdiv_n = config.schedule.factorFor(depth, moving_pixels, parent_occupancy);
+    int max_subdiv = static_cast<int>(current_size / config.min_voxel_size);
+    subdiv_n = std::min(subdiv_n, std::max(2, max_subdiv));
+    if (depth < static_cast<int>(stats.subdiv_per_depth.size())) {
+        stats.subdiv_per_depth[depth] = subdiv_n;
+    }
+
+    // A camera seeing no motion over the node sees none over its children
+    std::vector<const MotionIntegral*> active;
+    for (const auto& integral : integrals) {
+        if (integral.movingPixels(target_zone, config.projection_margin) > 0) {
+            active.push_back(&integral);
+        }
+    }
+
+    // Children share their corners: project the (n + 1)^3 grid vertices once per camera
+    int vertices_n = subdiv_n + 1;
+    float child_size = current_size / subdiv_n;
+    Eigen::Vector3f min_corner = target_zone.center - Eigen::Vector3f::Constant(target_zone.half_size);
+    std::vector<std::vector<Eigen::Vector3f>> projected(active.size(), std::vector<Eigen::Vector3f>(vertices_n * vertices_n * vertices_n));
+    for (size_t cam_idx = 0; cam_idx < active.size(); ++cam_idx) {
+        for (int z = 0; z < vertices_n; ++z) {
+            for (int y = 0; y < vertices_n; ++y) {
+                for (int x = 0; x < vertices_n; ++x) {
+                    Eigen::Vector3f vertex = min_corner + Eigen::Vector3f(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)) * child_size;
+                    projected[cam_idx][(z * vertices_n + y) * vertices_n + x] = active[cam_idx]->project(vertex);
+                }
+            }
+        }
+    }
+
+    int total_cells = subdiv_n * subdiv_n * subdiv_n;
+    std::vector<std::pair<int, size_t>> surviving_children;  // cell index, moving pixels over all cameras
+    for (int voxel_idx = 0; voxel_idx < total_cells; ++voxel_idx) {
+        // Same layout as indexToVoxel
+        int cx = voxel_idx % subdiv_n;
+        int cy = (voxel_idx / subdiv_n) % subdiv_n;
+        int cz = voxel_idx / (subdiv_n * subdiv_n);
+        stats.voxels_visited++;
+
+        size_t cameras = 0;
+        size_t pixels = 0;
+        for (size_t cam_idx = 0; cam_idx < active.size(); ++cam_idx) {
+            // Not enough cameras left to reach the threshold
+            if (cameras + (active.size() - cam_idx) < config.min_ray_threshold) break;
+
+            stats.intersection_checks++;
+            if (depth < static_cast<int>(stats.checks_per_depth.size())) {
+                stats.checks_per_depth[depth]++;
+            }
+
+            std::array<Eigen::Vector3f, 8> corners;
+            for (int corner = 0; corner < 8; ++corner) {
+                int vx = cx + (corner & 1), vy = cy + ((corner >> 1) & 1), vz = cz + ((corner >> 2) & 1);
+                corners[corner] = projected[cam_idx][(vz * vertices_n + vy) * vertices_n + vx];
+            }
+            int count = active[cam_idx]->movingPixels(corners, config.projection_margin);
+            if (count > 0) {
+                cameras++;
+                pixels += static_cast<size_t>(count);
+            }
+        }
+
+        if (cameras >= config.min_ray_threshold) {
+            surviving_children.emplace_back(voxel_idx, pixels);
+        }
+    }
+
+    float occupancy = static_cast<float>(surviving_children.size()) / total_cells;
+    for (auto [voxel_idx, pixels] : surviving_children) {
+        Voxel child = indexToVoxel(voxel_idx, target_zone, subdiv_n);
+        if (config.clutter && config.clutter->covers(child)) {
+            stats.clutter_hits.push_back(child);
+            continue;
         }
+        recursive_projection(child, pixels, integrals, config, detections, stats, debug_viz, depth + 1, occupancy);
+    }
+}
+
+/**
+ * Binary mask (255 = moving) of the pixels that changed between the previous and the current frame.
+ */
+cv::Mat computeMotionMask(const CameraFrame& frame) {
+    // compute temporal difference with previous image
+    cv::Mat diff;
+    cv::absdiff(frame.current_frame, frame.previous_frame, diff);
+
+    // If color, turn it to greyscale
+    if (diff.channels() > 1) {
+        cv::cvtColor(diff, diff, cv::COLOR_BGR2GRAY);
     }
 
+    cv::Mat binary;
+    int threshold = 5;
+    cv::threshold(diff, binary, threshold, 255, cv::THRESH_BINARY);
 
+    return binary;
+}
 
-    /*
-    std::cout << "Total rays generated: " << all_rays.size() << std::endl;
+/**
+ * Casts one ray per moving pixel of every camera.
+ *
+ * Movement is the thresholded temporal difference between the current and the previous frame.
+ * The camera_id of a ray is the index of its camera in camera_frames.
+ *
+ * Cameras are independent, so both passes run across cameras in parallel:
+ * 1. differencing and moving pixel extraction, giving the ray count of each camera
+ * 2. after a prefix sum over those counts, each camera generates its rays directly into its own
+ *    slice of the output, so no locking or concatenation is needed
+ * Rays come out grouped by camera, in camera order, as with a serial loop.
+ *
+ * With RayGrouping::Blob, neighbouring moving pixels are cast as one ray (see groupMotionPixels).
+ *
+ * With pixel_clutter, one mask per camera learns and removes the persistently moving regions
+ * before rays are generated (resized to the camera count on first use).
+ *
+ * With DetectionConfig::motion_pyramid_levels and pyramids, one MotionPyramid per camera is built
+ * into pyramids and the rays are cast from the moving cells of its coarsest level. These rays
+ * have to be detected with the same pyramids (see detect_objects_from_rays).
+ */
+std::vector<Ray> extractMotionRays(const std::vector<CameraFrame>& camera_frames, const DetectionConfig& config = DetectionConfig(), std::vector<PixelClutterMask>* pixel_clutter = nullptr, std::vector<MotionPyramid>* pyramids = nullptr) {
+    size_t camera_count = camera_frames.size();
+    int top_level = pyramids ? config.motion_pyramid_levels : 0;
+    bool bundled = top_level == 0 && config.ray_grouping == RayGrouping::Blob;
+    std::vector<std::vector<cv::Point>> movement_pixels(camera_count);
+    std::vector<std::vector<PixelBundle>> movement_bundles(camera_count);
+
+    if (pyramids) {
+        pyramids->clear();
+        pyramids->resize(top_level > 0 ? camera_count : 0);
+    }
 
-    // Check how many pixels detected movement per camera
-    int total_movement_pixels = 0;
-    for (const auto& frame : camera_frames) {
-        cv::Mat diff, binary;
-        cv::absdiff(frame.current_frame, frame.previous_frame, diff);
-        if (diff.channels() > 1) cv::cvtColor(diff, diff, cv::COLOR_BGR2GRAY);
-        cv::threshold(diff, binary, 25, 255, cv::THRESH_BINARY);
-        int movement_count = cv::countNonZero(binary);
-        std::cout << "Camera movement pixels: " << movement_count << std::endl;
-        total_movement_pixels += movement_count;
+    if (pixel_clutter && pixel_clutter->size() != camera_count) {
+        pixel_clutter->resize(camera_count);
     }
-    */
 
-    // populate detections
+    // Get moving pixels from the temporal image difference
+    cv::parallel_for_(cv::Range(0, static_cast<int>(camera_count)), [&](const cv::Range& range) {
+        for (int cam_idx = range.start; cam_idx < range.end; ++cam_idx) {
+            cv::Mat binary = computeMotionMask(camera_frames[cam_idx]);
+            if (pixel_clutter) {
+                (*pixel_clutter)[cam_idx].apply(binary);
+            }
+            if (top_level > 0) {
+                (*pyramids)[cam_idx] = MotionPyramid::build(binary, camera_frames[cam_idx].camera, cam_idx, top_level);
+                cv::findNonZero((*pyramids)[cam_idx].levels[top_level], movement_pixels[cam_idx]);
+            } else if (bundled) {
+                movement_bundles[cam_idx] = groupMotionPixels(binary, config.max_bundle_pixels);
+            } else {
+                cv::findNonZero(binary, movement_pixels[cam_idx]);
+            }
+        }
+    });
+
+    // Exclusive prefix sum: where each camera's rays start in the output
+    std::vector<size_t> offsets(camera_count + 1, 0);
+    for (size_t cam_idx = 0; cam_idx < camera_count; ++cam_idx) {
+        size_t count = bundled ? movement_bundles[cam_idx].size() : movement_pixels[cam_idx].size();
+        offsets[cam_idx + 1] = offsets[cam_idx] + count;
+    }
 
-    DebugVisualization dummy_viz;
-    DebugVisualization& viz_ref = debug_viz ? *debug_viz : dummy_viz;
-    recursive_detection(target_zone, all_rays, min_voxel_size, min_ray_threshold, detections, stats, viz_ref, subdiv_n, 0);
+    std::vector<Ray> all_rays(offsets[camera_count]);
 
-    if (debug_viz && !detections.empty()) {
-        for (auto& ray_info : debug_viz->rays) {
-            for (const auto& det : detections) {
-                if (rayIntersectsVoxel(ray_info.ray, det)) {
-                    ray_info.contributed_to_detection = true;
-                    break;
+    // Get camera rays from all pixels where movement is detected
+    cv::parallel_for_(cv::Range(0, static_cast<int>(camera_count)), [&](const cv::Range& range) {
+        for (int cam_idx = range.start; cam_idx < range.end; ++cam_idx) {
+            const auto& frame = camera_frames[cam_idx];
+            if (top_level > 0) {
+                Ray* out = all_rays.data() + offsets[cam_idx];
+                for (const auto& cell : movement_pixels[cam_idx]) {
+                    *out++ = (*pyramids)[cam_idx].rayAt(top_level, cell.x, cell.y);
                 }
+            } else if (bundled) {
+                generateBundleRaysInto(frame.camera, movement_bundles[cam_idx],
+                                       frame.current_frame.cols, frame.current_frame.rows, cam_idx,
+                                       all_rays.data() + offsets[cam_idx]);
+            } else {
+                generateRaysInto(frame.camera, movement_pixels[cam_idx],
+                                 frame.current_frame.cols, frame.current_frame.rows, cam_idx,
+                                 all_rays.data() + offsets[cam_idx]);
             }
         }
+    });
+
+    return all_rays;
+}
+
+/**
+ * DetectionMode::Projection counterpart of extractMotionRays: one MotionIntegral per camera,
+ * in camera order. pixel_clutter is used as in extractMotionRays.
+ */
+std::vector<MotionIntegral> extractMotionIntegrals(const std::vector<CameraFrame>& camera_frames, std::vector<PixelClutterMask>* pixel_clutter = nullptr) {
+    size_t camera_count = camera_frames.size();
+    std::vector<MotionIntegral> integrals(camera_count);
+
+    if (pixel_clutter && pixel_clutter->size() != camera_count) {
+        pixel_clutter->resize(camera_count);
     }
 
-    return detections;
+    cv::parallel_for_(cv::Range(0, static_cast<int>(camera_count)), [&](const cv::Range& range) {
+        for (int cam_idx = range.start; cam_idx < range.end; ++cam_idx) {
+            cv::Mat binary = computeMotionMask(camera_frames[cam_idx]);
+            if (pixel_clutter) {
+                (*pixel_clutter)[cam_idx].apply(binary);
+            }
+            integrals[cam_idx] = MotionIntegral::build(binary, camera_frames[cam_idx].camera);
+        }
+    });
+
+    return integrals;
+}
+
+/**
+ * recursive_detection with the children of target_zone shared out between config.descent_threads
+ * workers of the calling thread's core::WorkerPool. Each worker takes the next surviving child from
+ * an atomic counter and descends it with its own stats, reading the root rays from rays and
+ * keeping the rays it makes in a RayPool of its own, and pushes detections into a shared
+ * core::AppendBuffer. Rays refined at the root (pyramid rays) are appended to rays for the
+ * workers to share, and removed again before returning.
+ *
+ * Detections are returned sorted by voxel center (z, y, x), so the result does not depend on
+ * thread scheduling; recursive_detection returns the same voxels in traversal order.
+ */
+std::vector<Voxel> parallel_detection(Voxel& target_zone, std::vector<uint32_t>& root_rays, std::vector<Ray>& rays, const DetectionConfig& config, DetectionStats& stats, const std::vector<MotionPyramid>* pyramids = nullptr) {
+    RayPool root_pool(rays);
+    if (target_zone.half_size * 2.0f <= config.min_voxel_size) {
+        std::vector<Voxel> detections;
+        recursive_detection(target_zone, root_rays, root_pool, config, detections, stats, nullptr, 0, 0.0f, pyramids);
+        return detections;
+    }
+
+    // Root level on the calling thread, as recursive_detection would
+    stats.nodes_visited++;
+    stats.nodes_per_depth[0]++;
+    int subdiv_n = nodeSubdivision(target_zone, root_rays.size(), config, stats, 0, 0.0f);
+    std::vector<std::vector<uint32_t>> child_rays_map;
+    std::vector<int> surviving_children = distributeRays(target_zone, subdiv_n, root_rays, root_pool, config, stats, 0, pyramids, child_rays_map);
+    float occupancy = static_cast<float>(surviving_children.size()) / (subdiv_n * subdiv_n * subdiv_n);
+
+    // Rays refined at the root (pyramid rays) join the shared ones, at the indices they had in root_pool
+    size_t ray_count = rays.size();
+    rays.reserve(root_pool.size());
+    for (size_t i = ray_count; i < root_pool.size(); ++i) {
+        rays.push_back(root_pool[static_cast<uint32_t>(i)]);
+    }
+
+    core::AppendBuffer<Voxel> buffer;
+    std::atomic<size_t> next_child{0};
+    int thread_count = std::min<int>(config.descent_threads, static_cast<int>(surviving_children.size()));
+    std::vector<DetectionStats> thread_stats(thread_count);
+
+    core::localWorkerPool().run(thread_count, [&](size_t t) {
+        RayPool pool(rays);  // sub-rays are pushed per branch
+        auto writer = buffer.writer();
+        DetectionStats& local = thread_stats[t];
+
+        for (size_t i = next_child++; i < surviving_children.size(); i = next_child++) {
+            int voxel_idx = surviving_children[i];
+            Voxel child = indexToVoxel(voxel_idx, target_zone, subdiv_n);
+            if (config.clutter && config.clutter->covers(child)) {
+                local.clutter_hits.push_back(child);
+                continue;
+            }
+            if (config.coverage && !config.coverage->covers(child, config.min_ray_threshold)) {
+                local.nodes_outside_coverage++;
+                continue;
+            }
+            recursive_detection(child, child_rays_map[voxel_idx], pool, config, writer, local, nullptr, 1, occupancy, pyramids);
+        }
+    });
+
+    rays.resize(ray_count);
+    for (const auto& local : thread_stats) {
+        stats.merge(local);
+    }
+    return buffer.finalize([](const Voxel& voxel) {
+        return std::make_tuple(voxel.center.z(), voxel.center.y(), voxel.center.x());
+    });
+}
+
+/**
+ * Voxel voting half of detect_objects: runs the octree descent on already extracted rays.
+ *
+ * Same arguments as detect_objects, with the rays from extractMotionRays instead of the frames,
+ * and the pyramids it built if the rays come from a MotionPyramid. The rays are not copied: their
+ * ids are set to their index and, with DetectionConfig::coverage, their [t_min, t_max] clipped.
+ */
+std::vector<Voxel> detect_objects_from_rays(Voxel target_zone, std::vector<Ray>& all_rays, const DetectionConfig& config, DebugVisualization* debug_viz = nullptr, DetectionStats* stats_out = nullptr, const std::vector<MotionPyramid>* pyramids = nullptr){
+    std::vector<Voxel> detections;
+    DetectionStats stats;
+    stats.ray_count = all_rays.size();
+
+    for (size_t i = 0; i < all_rays.size(); ++i) {
+        all_rays[i].id = static_cast<uint32_t>(i);
+    }
+
+    if (debug_viz) {
+        debug_viz->clear(all_rays.size());
+    }
+
+    // populate detections, the descent works on indices into all_rays, clipped in place
+    std::vector<uint32_t> root_rays;
+    root_rays.reserve(all_rays.size());
+    for (Ray& ray : all_rays) {
+        if (config.coverage && !config.coverage->clip(ray, config.min_ray_threshold)) continue;
+        root_rays.push_back(ray.id);
+    }
+    stats.rays_outside_coverage = all_rays.size() - root_rays.size();
+    if (config.descent_threads > 1 && !debug_viz) {
+        detections = parallel_detection(target_zone, root_rays, all_rays, config, stats, pyramids);
+    } else {
+        RayPool ray_pool(all_rays);
+        ray_pool.reserve(all_rays.size() * 2);
+        recursive_detection(target_zone, root_rays, ray_pool, config, detections, stats, debug_viz, 0, 0.0f, pyramids);
+    }
+
+    if (debug_viz) {
+        debug_viz->recordRays(all_rays);
+    }
+
+    if (stats_out) {
+        *stats_out = stats;
+    }
 
+    return detections;
 }
 
+/**
+ * Voxel voting half of detect_objects in DetectionMode::Projection, on the integrals from
+ * extractMotionIntegrals. stats.ray_count is the number of moving pixels, the rays RayCasting
+ * would have cast. The debug visualization only gets the visited voxels.
+ */
+std::vector<Voxel> detect_objects_from_integrals(Voxel target_zone, const std::vector<MotionIntegral>& integrals, const DetectionConfig& config, DebugVisualization* debug_viz = nullptr, DetectionStats* stats_out = nullptr) {
+    std::vector<Voxel> detections;
+    DetectionStats stats;
 
+    if (debug_viz) {
+        debug_viz->clear(0);
+    }
 
+    size_t cameras = 0;
+    for (const auto& integral : integrals) {
+        int count = integral.movingPixels(target_zone, config.projection_margin);
+        stats.ray_count += integral.totalMovingPixels();
+        cameras += count > 0 ? 1 : 0;
+    }
+
+    if (cameras >= config.min_ray_threshold) {
+        recursive_projection(target_zone, stats.ray_count, integrals, config, detections, stats, debug_viz, 0);
+    }
 
+    if (stats_out) {
+        *stats_out = stats;
+    }
+
+    return detections;
+}
 
+/**
+ * Returns a list of voxels in which there is a possible detection
+ * Each returned voxel represents a quadrant of the initial voxel (octree)
+ *
+ * We cast a ray in the direction of all movements in the camera.
+ * If multiple ray intersect with the same voxel, there is a detection in that voxel.
+ * If we subdivide voxels enough, we will get a precise 3D location for the detection.
+ *
+ * Args:
+ * - target_zone: Initial voxel where we want to detect objects
+ * - camera_frames: camera parameters, current frame, and previous frame for ray calculation
+ * - config: min_voxel_size (voxel size at which the algorithm will stop the recursion),
+ *   min_ray_threshold (how many rays have to hit one voxel in order to consider that it's a detection, will depend on the number of cameras aiming at the target zone)
+ *   and the subdivision schedule of the octree
+ * - debug_viz: optional, filled with the rays and visited voxels
+ * - stats_out: optional, filled with the traversal statistics
+ * - pixel_clutter: optional, per camera suppression of persistently moving pixels (see PixelClutterMask)
+ *
+ * With DetectionMode::Projection, voxels are projected into the cameras instead (see recursive_projection).
+ *
+ * */
+std::vector<Voxel> detect_objects(Voxel target_zone, const std::vector<CameraFrame>& camera_frames, const DetectionConfig& config, DebugVisualization* debug_viz = nullptr, DetectionStats* stats_out = nullptr, std::vector<PixelClutterMask>* pixel_clutter = nullptr){
+    if (config.mode == DetectionMode::Projection) {
+        return detect_objects_from_integrals(target_zone, extractMotionIntegrals(camera_frames, pixel_clutter),
+                                             config, debug_viz, stats_out);
+    }
+
+    std::vector<MotionPyramid> pyramids;
+    std::vector<Ray> all_rays = extractMotionRays(camera_frames, config, pixel_clutter, &pyramids);
+    return detect_objects_from_rays(target_zone, all_rays, config, debug_viz, stats_out,
+                                    pyramids.empty() ? nullptr : &pyramids);
+}
+
+std::vector<Voxel> detect_objects(Voxel target_zone, const std::vector<CameraFrame>& camera_frames, float min_voxel_size = 0.1f, size_t min_ray_threshold = 3, int subdiv_n = 8, DebugVisualization* debug_viz = nullptr){
+    DetectionConfig config;
+    config.min_voxel_size = min_voxel_size;
+    config.min_ray_threshold = min_ray_threshold;
+    config.schedule = SubdivisionSchedule::fixed(subdiv_n);
+    return detect_objects(target_zone, camera_frames, config, debug_viz);
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include "vision/detect_object.hpp"
+#include "vision/cluster_detections.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+struct DetectionBenchmarkResult {
+    std::string name;
+    DetectionStats stats;
+    size_t detections = 0;
+    double wall_ms = 0.0;   // best of the repetitions
+    float error = -1.0f;    // distance from the ground truth to the closest cluster centroid, -1 if unknown
+};
+
+
+/**
+ * Runs detect_objects on the same frame set once per configuration and reports traversal cost.
+ *
+ * The best wall time over `repetitions` runs is kept to filter out scheduling noise.
+ *
+ * Args:
+ * - target_zone: root voxel handed to detect_objects
+ * - camera_frames: frame set to replay (typically the current frame of the drone scenario)
+ * - configs: named configurations to compare
+ * - repetitions: runs per configuration
+ * - ground_truth: optional, true position of the target to score the clustered detections
+ * - refine_centroids: score the centroids after refineClusterCentroids (the refinement is not timed)
+ */
+std::vector<DetectionBenchmarkResult> benchmarkDetection(
+    const Voxel& target_zone,
+    const std::vector<CameraFrame>& camera_frames,
+    const std::vector<std::pair<std::string, DetectionConfig>>& configs,
+    int repetitions = 3,
+    const Eigen::Vector3f* ground_truth = nullptr,
+    bool refine_centroids = false
+) {
+    std::vector<DetectionBenchmarkResult> results;
+    results.reserve(configs.size());
+
+    for (const auto& [name, config] : configs) {
+        DetectionBenchmarkResult result;
+        result.name = name;
+        result.wall_ms = std::numeric_limits<double>::infinity();
+
+        DetectionConfig run_config = config;
+        run_config.record_votes = refine_centroids;
+
+        for (int rep = 0; rep < repetitions; ++rep) {
+            DetectionStats stats;
+            // Same as detect_objects, keeping the rays for the centroid refinement
+            std::vector<Ray> rays;
+            std::vector<Voxel> detections;
+            auto start = std::chrono::high_resolution_clock::now();
+            if (refine_centroids && run_config.mode == DetectionMode::RayCasting) {
+                std::vector<MotionPyramid> pyramids;
+                rays = extractMotionRays(camera_frames, run_config, nullptr, &pyramids);
+                detections = detect_objects_from_rays(target_zone, rays, run_config, nullptr, &stats,
+                                                      pyramids.empty() ? nullptr : &pyramids);
+            } else {
+                detections = detect_objects(target_zone, camera_frames, run_config, nullptr, &stats);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+
+            double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            if (ms < result.wall_ms) {
+                result.wall_ms = ms;
+                result.stats = stats;
+                result.detections = detections.size();
+
+                if (ground_truth) {
+                    result.error = -1.0f;
+                    auto clusters = clusterDetections(detections, config.min_voxel_size);
+                    if (!rays.empty()) {
+                        refineClusterCentroids(clusters, rays, stats.votes, config.min_ray_threshold);
+                    }
+                    for (const auto& cluster : clusters) {
+                        float error = (cluster.centroid - *ground_truth).norm();
+                        if (result.error < 0.0f || error < result.error) {
+                            result.error = error;
+                        }
+                    }
+                }
+            }
+        }
+
+        results.push_back(std::move(result));
+    }
+
+    return results;
+}
+
+/**
+ * Subdivision schedules compared by the schedule sweep.
+ * Every entry shares `base` except for the schedule.
+ */
+std::vector<std::pair<std::string, DetectionConfig>> scheduleSweep(const DetectionConfig& base) {
+    std::vector<std::pair<std::string, SubdivisionSchedule>> schedules = {
+        {"fixed 2", SubdivisionSchedule::fixed(2)},
+        {"fixed 4", SubdivisionSchedule::fixed(4)},
+        {"fixed 8", SubdivisionSchedule::fixed(8)},
+        {"fixed 16", SubdivisionSchedule::fixed(16)},
+        {"16,8,4,2", SubdivisionSchedule::perDepth({16, 8, 4, 2})},
+        {"8,4,2", SubdivisionSchedule::perDepth({8, 4, 2})},
+        {"4,4,2", SubdivisionSchedule::perDepth({4, 4, 2})},
+        {"adaptive", SubdivisionSchedule::adaptive()},
+    };
+
+    std::vector<std::pair<std::string, DetectionConfig>> configs;
+    for (auto& [name, schedule] : schedules) {
+        DetectionConfig config = base;
+        config.schedule = schedule;
+        configs.emplace_back(name, config);
+    }
+    return configs;
+}
+
+/**
+ * Subdivided rays against cone traversal, everything else from `base`.
+ */
+std::vector<std::pair<std::string, DetectionConfig>> footprintSweep(const DetectionConfig& base) {
+    DetectionConfig subdivide = base;
+    subdivide.footprint_mode = RayFootprintMode::Subdivide;
+
+    DetectionConfig cone = base;
+    cone.footprint_mode = RayFootprintMode::Cone;
+
+    DetectionConfig cone_exact = cone;
+    cone_exact.cone_min_footprint = 0.0f;
+
+    return {
+        {"subdivide", subdivide},
+        {"cone", cone},
+        {"cone exact", cone_exact},
+    };
+}
+
+/**
+ * One ray per pixel against one ray per blob, with both footprint modes, everything else from `base`.
+ */
+std::vector<std::pair<std::string, DetectionConfig>> groupingSweep(const DetectionConfig& base) {
+    std::vector<std::pair<std::string, DetectionConfig>> configs;
+    for (RayGrouping grouping : {RayGrouping::Pixel, RayGrouping::Blob}) {
+        for (RayFootprintMode mode : {RayFootprintMode::Subdivide, RayFootprintMode::Cone}) {
+            DetectionConfig config = base;
+            config.ray_grouping = grouping;
+            config.footprint_mode = mode;
+
+            std::string name = grouping == RayGrouping::Pixel ? "pixel" : "blob";
+            name += mode == RayFootprintMode::Subdivide ? " subdiv" : " cone";
+            configs.emplace_back(name, config);
+        }
+    }
+    return configs;
+}
+
+/**
+ * Full resolution rays against coarse-to-fine MotionPyramid rays, everything else from `base`.
+ */
+std::vector<std::pair<std::string, DetectionConfig>> pyramidSweep(const DetectionConfig& base) {
+    std::vector<std::pair<std::string, DetectionConfig>> configs;
+    for (int levels : {0, 2, 3, 4}) {
+        DetectionConfig config = base;
+        config.motion_pyramid_levels = levels;
+        configs.emplace_back(levels == 0 ? "full res" : "pyramid " + std::to_string(levels), config);
+    }
+    return configs;
+}
+
+/**
+ * Octree depths compared by the centroid refinement benchmark: min_voxel_size from `base` and
+ * 2, 4, 8 times coarser, everything else from `base`.
+ */
+std::vector<std::pair<std::string, DetectionConfig>> voxelSizeSweep(const DetectionConfig& base) {
+    std::vector<std::pair<std::string, DetectionConfig>> configs;
+    for (float factor : {1.0f, 2.0f, 4.0f, 8.0f}) {
+        DetectionConfig config = base;
+        config.min_voxel_size = base.min_voxel_size * factor;
+        char name[32];
+        std::snprintf(name, sizeof(name), "voxel %.2f", config.min_voxel_size);
+        configs.emplace_back(name, config);
+    }
+    return configs;
+}
+
+/**
+ * Ray casting against voxel projection, everything else from `base`.
+ */
+std::vector<std::pair<std::string, DetectionConfig>> detectionModeSweep(const DetectionConfig& base) {
+    DetectionConfig ray_casting = base;
+    ray_casting.mode = DetectionMode::RayCasting;
+
+    DetectionConfig projection = base;
+    projection.mode = DetectionMode::Projection;
+
+    return {
+        {"ray casting", ray_casting},
+        {"projection", projection},
+    };
+}
+
+/**
+ * Copy of camera_frames whose motion masks are those of camera_frames dilated by radius pixels.
+ * Stands in for heavier motion (larger or closer objects) on the same scene.
+ */
+std::vector<CameraFrame> dilateMotion(const std::vector<CameraFrame>& camera_frames, int radius) {
+    std::vector<CameraFrame> dilated;
+    dilated.reserve(camera_frames.size());
+
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * radius + 1, 2 * radius + 1));
+    for (const auto& frame : camera_frames) {
+        cv::Mat mask = computeMotionMask(frame);
+        if (radius > 0) {
+            cv::dilate(mask, mask, kernel);
+        }
+        // computeMotionMask(previous = 0, current = mask) gives back mask
+        dilated.push_back({frame.camera, mask, cv::Mat::zeros(mask.rows, mask.cols, CV_8UC1)});
+    }
+    return dilated;
+}
+
+/**
+ * Runs detectionModeSweep with increasingly dilated motion (see dilateMotion) to find where
+ * projection starts beating ray casting. Result names carry the dilation radius.
+ */
+std::vector<DetectionBenchmarkResult> benchmarkModeCrossover(
+    const Voxel& target_zone,
+    const std::vector<CameraFrame>& camera_frames,
+    const DetectionConfig& base,
+    const std::vector<int>& dilation_radii = {0, 1, 2, 4, 8},
+    int repetitions = 1,
+    const Eigen::Vector3f* ground_truth = nullptr
+) {
+    std::vector<DetectionBenchmarkResult> results;
+    for (int radius : dilation_radii) {
+        auto frames = dilateMotion(camera_frames, radius);
+        for (auto& result : benchmarkDetection(target_zone, frames, detectionModeSweep(base), repetitions, ground_truth)) {
+            result.name = (result.name == "ray casting" ? "ray" : "proj") + std::string(" +") + std::to_string(radius);
+            results.push_back(std::move(result));
+        }
+    }
+    return results;
+}
+
+void printBenchmark(const std::vector<DetectionBenchmarkResult>& results) {
+    std::printf("%-12s %10s %12s %12s %12s %14s %8s %10s %10s\n",
+                "config", "rays", "ray tests", "subrays", "nodes", "cells", "dets", "error m", "ms");
+    for (const auto& r : results) {
+        std::printf("%-12s %10zu %12zu %12zu %12zu %14zu %8zu %10.3f %10.2f\n",
+                    r.name.c_str(), r.stats.ray_count, r.stats.intersection_checks,
+                    r.stats.total_subrays_created, r.stats.nodes_visited,
+                    r.stats.voxels_visited, r.detections, r.error, r.wall_ms);
+    }
+}
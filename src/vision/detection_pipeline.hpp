@@ -0,0 +1,328 @@
+#pragma once
+
+#include "core/bounded_queue.hpp"
+#include "vision/detect_object.hpp"
+#include "vision/cluster_detections.hpp"
+#include "vision/occupancy_map.hpp"
+#include "vision/clutter_map.hpp"
+#include "vision/track_clusters.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+
+/**
+ * One frame set travelling through the DetectionPipeline.
+ * Each stage fills its own fields and hands the whole item to the next stage.
+ */
+struct PipelineFrame {
+    size_t frame = 0;
+    std::vector<CameraFrame> camera_frames;
+    bool record_debug = false;
+
+    // Motion extraction
+    std::vector<Ray> rays;
+    std::vector<MotionPyramid> pyramids;  // empty unless DetectionConfig::motion_pyramid_levels > 0
+    std::vector<MotionIntegral> integrals;  // instead of rays with DetectionMode::Projection
+
+    // Voxel voting
+    std::vector<Voxel> detections;
+    DetectionStats stats;
+    DebugVisualization debug_viz;
+
+    // Clustering and tracking
+    std::vector<Cluster> clusters;
+    std::vector<TimestampedPosition> confirmed_positions;  // last position of each confirmed track
+};
+
+
+/**
+ * Runs detection as a chain of stages, each on its own thread:
+ *
+ *   submit (capture) -> motion extraction -> voxel voting -> clustering + tracking -> results
+ *
+ * Stages are connected by bounded queues, so while frame N is being voted on, frame N+1 can be
+ * differenced and frame N+2 rendered. Throughput is bounded by the slowest stage instead of the
+ * sum of all of them, at the cost of a few frames of latency.
+ *
+ * Every stage is single-threaded and the queues are FIFO, so results come out in frame order.
+ * When the pipeline is saturated, submit either blocks (back-pressure on the capture loop) or
+ * drops the oldest waiting frame set, depending on Config::overflow. The results queue follows
+ * the same policy, and internal queues always block: with OverflowPolicy::Block a frame set that
+ * entered the pipeline is never lost, it waits for waitNext or pollLatest.
+ */
+class DetectionPipeline {
+public:
+    struct Config {
+        Voxel target_zone{{0.f, 0.f, 0.f}, 250.f};
+        DetectionConfig detection;
+        float epsilon_factor = 2.5f;        // see clusterDetections
+        size_t min_cluster_size = 3;        // see clusterDetections
+        ClusterTracker::Config tracker;
+        OccupancyMap::Config occupancy;
+        bool occupancy_filtering = false;   // cluster only the detections confirmed by the OccupancyMap
+        bool clutter_suppression = false;   // PixelClutterMask per camera and ClutterMap
+        bool refine_centroids = false;      // refineClusterCentroids, ray casting only
+        size_t queue_capacity = 2;          // frame sets waiting in front of each stage
+        core::OverflowPolicy overflow = core::OverflowPolicy::Block;
+    };
+
+    enum Stage {
+        MotionExtraction,
+        VoxelVoting,
+        ClusteringTracking,
+        StageCount
+    };
+
+    explicit DetectionPipeline(Config config)
+        : config_(config)
+        , tracker_(config.tracker)
+        , occupancyMap_(config.target_zone, config.occupancy)
+        , occupancyFiltering_(config.occupancy_filtering)
+        , clutterMap_(config.target_zone)
+        , clutterSuppression_(config.clutter_suppression)
+        , refineCentroids_(config.refine_centroids)
+        , input_(config.queue_capacity, config.overflow)
+        , rays_(config.queue_capacity)
+        , detections_(config.queue_capacity)
+        , results_(config.queue_capacity, config.overflow)
+    {
+        for (auto& ms : stageMs_) {
+            ms = 0.0;
+        }
+
+        threads_[MotionExtraction] = std::thread([this] {
+            runStage(input_, rays_, MotionExtraction, [this](PipelineFrame& item) {
+                DetectionConfig detection_config = detectionConfig();
+                bool suppress_clutter = clutterSuppression_;
+                if (!suppress_clutter) {
+                    pixelClutter_.clear();
+                }
+                auto* pixel_clutter = suppress_clutter ? &pixelClutter_ : nullptr;
+
+                if (detection_config.mode == DetectionMode::Projection) {
+                    item.integrals = extractMotionIntegrals(item.camera_frames, pixel_clutter);
+                } else {
+                    item.rays = extractMotionRays(item.camera_frames, detection_config, pixel_clutter, &item.pyramids);
+                }
+
+                if (suppress_clutter) {
+                    std::vector<Eigen::Vector3f> protected_points = protectedPoints();
+                    for (size_t i = 0; i < pixelClutter_.size(); ++i) {
+                        const auto& frame = item.camera_frames[i];
+                        pixelClutter_[i].protect(frame.camera, protected_points, frame.current_frame.cols, frame.current_frame.rows);
+                    }
+                }
+                item.camera_frames.clear();  // images are not needed past this point
+            });
+        });
+
+        threads_[VoxelVoting] = std::thread([this] {
+            runStage(rays_, detections_, VoxelVoting, [this](PipelineFrame& item) {
+                DetectionConfig detection_config = detectionConfig();
+                if (clutterSuppression_) {
+                    detection_config.clutter = clutterCells();
+                }
+                bool refine_centroids = refineCentroids_;
+                detection_config.record_votes = refine_centroids;
+                item.debug_viz.min_voxel_depth = debugMinVoxelDepth_;
+                // The mode of the frame set is the one it was extracted with
+                if (!item.integrals.empty()) {
+                    item.detections = detect_objects_from_integrals(config_.target_zone, item.integrals, detection_config,
+                                                                    item.record_debug ? &item.debug_viz : nullptr, &item.stats);
+                } else {
+                    item.detections = detect_objects_from_rays(config_.target_zone, item.rays, detection_config,
+                                                               item.record_debug ? &item.debug_viz : nullptr, &item.stats,
+                                                               item.pyramids.empty() ? nullptr : &item.pyramids);
+                }
+                if (!refine_centroids) {
+                    item.rays.clear();  // otherwise kept with the votes for the clustering stage
+                }
+                item.pyramids.clear();
+                item.integrals.clear();
+            });
+        });
+
+        threads_[ClusteringTracking] = std::thread([this] {
+            runStage(detections_, results_, ClusteringTracking, [this](PipelineFrame& item) {
+                if (clutterSuppression_) {
+                    clutterMap_.update(item.detections, item.stats.clutter_hits);
+                }
+
+                if (occupancyFiltering_) {
+                    occupancyMap_.update(item.detections);
+                    item.detections = occupancyMap_.filter(item.detections);
+                } else if (occupancyMap_.size() > 0) {
+                    occupancyMap_.clear();
+                }
+
+                DetectionConfig detection_config = detectionConfig();
+                item.clusters = clusterDetections(item.detections, detection_config.min_voxel_size, config_.epsilon_factor,
+                                                  config_.min_cluster_size, detection_config.descent_threads);
+                if (!item.rays.empty()) {
+                    refineClusterCentroids(item.clusters, item.rays, item.stats.votes, detection_config.min_ray_threshold);
+                    item.rays.clear();
+                    item.stats.votes.clear();
+                }
+                tracker_.update(item.clusters, item.frame, detection_config.descent_threads);
+
+                if (clutterSuppression_) {
+                    std::vector<Eigen::Vector3f> centroids;
+                    for (const auto& cluster : item.clusters) {
+                        centroids.push_back(cluster.centroid);
+                    }
+                    std::lock_guard lock(configMutex_);
+                    clutterCells_ = clutterMap_.cells();
+                    protectedPoints_ = std::move(centroids);
+                } else {
+                    clutterMap_.clear();
+                    std::lock_guard lock(configMutex_);
+                    clutterCells_.reset();
+                }
+
+                for (const Track* track : tracker_.getConfirmedTracks()) {
+                    item.confirmed_positions.push_back(track->positions.back());
+                }
+            });
+        });
+    }
+
+    ~DetectionPipeline() {
+        // Closing every queue, not just the input: with OverflowPolicy::Block nobody drains results_
+        input_.close();
+        rays_.close();
+        detections_.close();
+        results_.close();
+        for (auto& thread : threads_) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    DetectionPipeline(const DetectionPipeline&) = delete;
+    DetectionPipeline& operator=(const DetectionPipeline&) = delete;
+
+    /**
+     * Queues a frame set for detection.
+     * With OverflowPolicy::Block this waits while the first stage is saturated.
+     */
+    bool submit(size_t frame, std::vector<CameraFrame> camera_frames, bool record_debug = false) {
+        PipelineFrame item;
+        item.frame = frame;
+        item.camera_frames = std::move(camera_frames);
+        item.record_debug = record_debug;
+        return input_.push(std::move(item));
+    }
+
+    /**
+     * Non-blocking: takes the most recent finished frame set, discarding older ones.
+     * Returns false if nothing finished since the last call.
+     */
+    bool pollLatest(PipelineFrame& out) {
+        bool found = false;
+        while (results_.tryPop(out)) {
+            found = true;
+        }
+        return found;
+    }
+
+    // Blocking: waits for the next finished frame set in order
+    bool waitNext(PipelineFrame& out) {
+        return results_.pop(out);
+    }
+
+    // Takes effect from the next frame set entering voxel voting
+    void setDetectionConfig(const DetectionConfig& detection) {
+        std::lock_guard lock(configMutex_);
+        config_.detection = detection;
+    }
+
+    void setOccupancyFiltering(bool enabled) {
+        occupancyFiltering_ = enabled;
+    }
+
+    void setClutterSuppression(bool enabled) {
+        clutterSuppression_ = enabled;
+    }
+
+    void setCentroidRefinement(bool enabled) {
+        refineCentroids_ = enabled;
+    }
+
+    // DebugVisualization::min_voxel_depth of the frame sets submitted with record_debug
+    void setDebugMinVoxelDepth(int depth) {
+        debugMinVoxelDepth_ = depth;
+    }
+
+    // Moving average of the time spent in a stage per frame set
+    double stageMs(Stage stage) const {
+        return stageMs_[stage].load();
+    }
+
+    // Frame sets discarded at submit or before being taken (OverflowPolicy::DropOldest only)
+    size_t droppedFrames() const {
+        return input_.dropped() + results_.dropped();
+    }
+
+private:
+    Config config_;
+    std::mutex configMutex_;
+    ClusterTracker tracker_;      // only touched by the clustering + tracking thread
+    OccupancyMap occupancyMap_;   // same
+    std::atomic<bool> occupancyFiltering_;
+
+    // Clutter suppression: the clustering thread learns, the two first stages apply.
+    // The hand-over (clutterCells_, protectedPoints_) is guarded by configMutex_.
+    std::vector<PixelClutterMask> pixelClutter_;  // motion extraction thread only
+    ClutterMap clutterMap_;                       // clustering + tracking thread only
+    std::atomic<bool> clutterSuppression_;
+    std::shared_ptr<const ClutterCells> clutterCells_;
+    std::vector<Eigen::Vector3f> protectedPoints_;
+
+    std::atomic<bool> refineCentroids_;
+    std::atomic<int> debugMinVoxelDepth_ = 0;
+
+    core::BoundedQueue<PipelineFrame> input_;
+    core::BoundedQueue<PipelineFrame> rays_;
+    core::BoundedQueue<PipelineFrame> detections_;
+    core::BoundedQueue<PipelineFrame> results_;
+
+    std::array<std::atomic<double>, StageCount> stageMs_;
+    std::array<std::thread, StageCount> threads_;
+
+    DetectionConfig detectionConfig() {
+        std::lock_guard lock(configMutex_);
+        return config_.detection;
+    }
+
+    std::shared_ptr<const ClutterCells> clutterCells() {
+        std::lock_guard lock(configMutex_);
+        return clutterCells_;
+    }
+
+    std::vector<Eigen::Vector3f> protectedPoints() {
+        std::lock_guard lock(configMutex_);
+        return protectedPoints_;
+    }
+
+    template <typename Work>
+    void runStage(core::BoundedQueue<PipelineFrame>& in, core::BoundedQueue<PipelineFrame>& out,
+                  Stage stage, Work work) {
+        PipelineFrame item;
+        while (in.pop(item)) {
+            auto start = std::chrono::high_resolution_clock::now();
+            work(item);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            stageMs_[stage] = stageMs_[stage].load() * 0.9 + ms * 0.1;
+
+            if (!out.push(std::move(item))) break;
+            item = PipelineFrame{};
+        }
+        out.close();
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "vision/detect_object.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+
+// Spreads the 21 low bits of v so that there are two zero bits between each of them
+inline uint64_t mortonSpread(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+inline uint32_t mortonCompact(uint64_t x) {
+    x &= 0x1249249249249249ULL;
+    x = (x ^ (x >> 2))  & 0x10c30c30c30c30c3ULL;
+    x = (x ^ (x >> 4))  & 0x100f00f00f00f00fULL;
+    x = (x ^ (x >> 8))  & 0x1f0000ff0000ffULL;
+    x = (x ^ (x >> 16)) & 0x1f00000000ffffULL;
+    x = (x ^ (x >> 32)) & 0x1fffff;
+    return static_cast<uint32_t>(x);
+}
+
+inline uint64_t mortonEncode(uint32_t x, uint32_t y, uint32_t z) {
+    return mortonSpread(x) | (mortonSpread(y) << 1) | (mortonSpread(z) << 2);
+}
+
+inline Eigen::Vector3i mortonDecode(uint64_t key) {
+    return {
+        static_cast<int>(mortonCompact(key)),
+        static_cast<int>(mortonCompact(key >> 1)),
+        static_cast<int>(mortonCompact(key >> 2))
+    };
+}
+
+
+/**
+ * Sparse set of cells of one level of the descent, stored as sorted, unique 64-bit Morton keys.
+ *
+ * The root bounds are stored once, each cell costs 8 bytes (vs 16 for a Voxel) and the keys are
+ * sorted, so two frames diff with a linear merge and neighbour queries are binary searches.
+ * Cells are root_size / cells wide. cells is the product of the subdivision factors down to the
+ * level, so not necessarily a power of two, and at most 2^21 (21 bits per axis).
+ */
+struct LinearOctree {
+    static constexpr uint32_t kMaxCells = 1u << 21;
+
+    Eigen::Vector3f origin = Eigen::Vector3f::Zero();  // min corner of the root
+    float root_size = 0.0f;
+    uint32_t cells = 1;  // per axis
+    std::vector<uint64_t> keys;
+
+    float cellSize() const {
+        return root_size / static_cast<float>(cells);
+    }
+
+    uint32_t resolution() const {
+        return cells;
+    }
+
+    // Key of the cell containing point, clamped to the root
+    uint64_t pointToKey(const Eigen::Vector3f& point) const {
+        Eigen::Vector3f cell = (point - origin) / cellSize();
+        int max_index = static_cast<int>(resolution()) - 1;
+        auto index = [max_index](float v) {
+            return static_cast<uint32_t>(std::clamp(static_cast<int>(std::floor(v)), 0, max_index));
+        };
+        return mortonEncode(index(cell.x()), index(cell.y()), index(cell.z()));
+    }
+
+    Voxel keyToVoxel(uint64_t key) const {
+        float size = cellSize();
+        Eigen::Vector3f center = origin + (mortonDecode(key).cast<float>() + Eigen::Vector3f::Constant(0.5f)) * size;
+        return Voxel{center, size * 0.5f};
+    }
+
+    bool contains(uint64_t key) const {
+        return std::binary_search(keys.begin(), keys.end(), key);
+    }
+
+    std::vector<Voxel> toVoxels() const {
+        std::vector<Voxel> voxels;
+        voxels.reserve(keys.size());
+        for (uint64_t key : keys) {
+            voxels.push_back(keyToVoxel(key));
+        }
+        return voxels;
+    }
+};
+
+
+/**
+ * Converts detect_objects output to a LinearOctree.
+ *
+ * Detections are leaves of the descent, root_size / (product of the subdivision factors on their
+ * path) wide: a power of two only for schedules made of powers of two, and smaller than a
+ * min_voxel_size that the factors do not divide. The grid is taken from the smallest leaf, so that
+ * each leaf of that size is exactly one cell; leaves of a branch split less (adaptive schedule)
+ * are stored as the cell containing their center. Without detections, e.g. for a bare grid, the
+ * cells are the largest power of two subdivision not wider than min_voxel_size.
+ *
+ * With an adaptive schedule the smallest leaf can change from one frame to the next, and with it
+ * the grid: compare cellSize() before diffing two frames.
+ *
+ * Args:
+ * - detections: voxels from detect_objects
+ * - target_zone: the root voxel given to detect_objects
+ * - min_voxel_size: the min_voxel_size given to detect_objects
+ */
+LinearOctree toLinearOctree(const std::vector<Voxel>& detections, const Voxel& target_zone, float min_voxel_size) {
+    LinearOctree octree;
+    octree.root_size = target_zone.half_size * 2.0f;
+    octree.origin = target_zone.center - Eigen::Vector3f::Constant(target_zone.half_size);
+    if (detections.empty()) {
+        int level = std::clamp(static_cast<int>(std::ceil(std::log2(octree.root_size / min_voxel_size))), 0, 21);
+        octree.cells = 1u << level;
+    } else {
+        float leaf_size = octree.root_size;
+        for (const auto& voxel : detections) {
+            leaf_size = std::min(leaf_size, voxel.half_size * 2.0f);
+        }
+        float cells = std::round(octree.root_size / leaf_size);
+        octree.cells = static_cast<uint32_t>(std::clamp(cells, 1.0f, static_cast<float>(LinearOctree::kMaxCells)));
+    }
+
+    octree.keys.reserve(detections.size());
+    for (const auto& voxel : detections) {
+        octree.keys.push_back(octree.pointToKey(voxel.center));
+    }
+
+    std::sort(octree.keys.begin(), octree.keys.end());
+    octree.keys.erase(std::unique(octree.keys.begin(), octree.keys.end()), octree.keys.end());
+    return octree;
+}
+
+/**
+ * Cells that appeared (in current, not in previous) and disappeared between two frames.
+ * Both octrees must share root and cells.
+ */
+void diffLinearOctrees(const LinearOctree& previous, const LinearOctree& current,
+                       std::vector<uint64_t>& added, std::vector<uint64_t>& removed) {
+    added.clear();
+    removed.clear();
+    std::set_difference(current.keys.begin(), current.keys.end(),
+                        previous.keys.begin(), previous.keys.end(), std::back_inserter(added));
+    std::set_difference(previous.keys.begin(), previous.keys.end(),
+                        current.keys.begin(), current.keys.end(), std::back_inserter(removed));
+}
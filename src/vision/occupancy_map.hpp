@@ -0,0 +1,178 @@
+#pragma once
+
+#include "vision/detect_object.hpp"
+#include "vision/linear_octree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Sparse log-odds occupancy map accumulated over frames.
+ *
+ * Cells live on a Morton grid like LinearOctree and are stored in a hash map, so only cells that
+ * were detected recently take memory. Each frame that has detections in a cell adds `hit` to its
+ * log-odds, and every frame the log-odds of all cells decay towards 0 (p = 0.5) by `decay`.
+ * Cells are coarser than detections (Config::cell_size) so that a moving target keeps hitting the
+ * same cell for a few frames, while one-frame false positives never reach the threshold.
+ *
+ * The decay is applied lazily from the frame a cell was last updated, so update() costs
+ * O(detections + occupied cells) and never walks the whole map:
+ * - cells are bucketed by the frame they were last hit, and the bucket that falls out of the
+ *   expiry horizon is erased when its frame comes back around
+ * - the cells above the occupancy threshold are kept in a separate list for occupiedVoxels()
+ *
+ * update() has to be called once per frame, with an empty list on frames without detections.
+ */
+class OccupancyMap {
+public:
+    struct Config {
+        float cell_size = 1.0f;           // meters, upper bound (rounded down to a power of 2 of the zone)
+        float hit = 0.6f;                 // log-odds added per frame with detections in a cell
+        float decay = 0.8f;               // log-odds multiplier per frame
+        float max_log_odds = 3.5f;        // clamp so that a cell can be forgotten in bounded time
+        float occupied_probability = 0.7f;  // two consecutive hits with the defaults
+        float expire_log_odds = 0.05f;    // cells below this are forgotten
+    };
+
+    explicit OccupancyMap(const Voxel& target_zone) : OccupancyMap(target_zone, Config()) {}
+
+    OccupancyMap(const Voxel& target_zone, Config config)
+        : config_(config)
+        , grid_(toLinearOctree({}, target_zone, config.cell_size))
+        , occupiedLogOdds_(std::log(config.occupied_probability / (1.0f - config.occupied_probability)))
+    {
+        // Frames after which even a saturated cell is below expire_log_odds
+        int horizon = 1;
+        if (config_.decay > 0.0f && config_.decay < 1.0f) {
+            horizon = static_cast<int>(std::ceil(std::log(config_.expire_log_odds / config_.max_log_odds) / std::log(config_.decay)));
+        }
+        buckets_.resize(static_cast<size_t>(std::max(horizon, 1)) + 1);
+    }
+
+    /**
+     * Adds one frame of detections, decays everything else.
+     *
+     * Args:
+     * - detections: voxels from detect_objects, at most one hit per cell and frame is counted
+     */
+    void update(const std::vector<Voxel>& detections) {
+        frame_++;
+
+        // Forget cells that were not hit for a whole horizon
+        auto& expired = buckets_[frame_ % buckets_.size()];
+        for (uint64_t key : expired) {
+            auto it = cells_.find(key);
+            if (it != cells_.end() && it->second.frame + buckets_.size() <= frame_) {
+                cells_.erase(it);
+            }
+        }
+        expired.clear();
+
+        std::vector<uint64_t> occupied;
+        occupied.reserve(occupied_.size() + detections.size());
+
+        for (const auto& voxel : detections) {
+            uint64_t key = grid_.pointToKey(voxel.center);
+            Cell& cell = cells_[key];
+            if (cell.frame == frame_) continue;
+
+            cell.log_odds = std::min(decayed(cell) + config_.hit, config_.max_log_odds);
+            cell.frame = frame_;
+            expired.push_back(key);
+
+            if (cell.log_odds >= occupiedLogOdds_ && !cell.occupied) {
+                cell.occupied = true;
+                occupied.push_back(key);
+            }
+        }
+
+        // Occupied cells that were not hit this frame may have decayed below the threshold
+        for (uint64_t key : occupied_) {
+            auto it = cells_.find(key);
+            if (it == cells_.end()) continue;
+
+            if (decayed(it->second) >= occupiedLogOdds_) {
+                occupied.push_back(key);
+            } else {
+                it->second.occupied = false;
+            }
+        }
+        occupied_ = std::move(occupied);
+    }
+
+    // Cells whose occupancy probability is above Config::occupied_probability
+    std::vector<Voxel> occupiedVoxels() const {
+        std::vector<Voxel> voxels;
+        voxels.reserve(occupied_.size());
+        for (uint64_t key : occupied_) {
+            voxels.push_back(grid_.keyToVoxel(key));
+        }
+        return voxels;
+    }
+
+    /**
+     * Keeps the detections that fall in an occupied cell.
+     * Typically called with the same detections right after update().
+     */
+    std::vector<Voxel> filter(const std::vector<Voxel>& detections) const {
+        std::vector<Voxel> kept;
+        for (const auto& voxel : detections) {
+            auto it = cells_.find(grid_.pointToKey(voxel.center));
+            if (it != cells_.end() && it->second.occupied) {
+                kept.push_back(voxel);
+            }
+        }
+        return kept;
+    }
+
+    // Occupancy probability of the cell containing point, 0.5 for unknown cells
+    float probability(const Eigen::Vector3f& point) const {
+        auto it = cells_.find(grid_.pointToKey(point));
+        float log_odds = it == cells_.end() ? 0.0f : decayed(it->second);
+        return 1.0f - 1.0f / (1.0f + std::exp(log_odds));
+    }
+
+    size_t size() const {
+        return cells_.size();
+    }
+
+    // Morton keys of the occupied cells, on grid()
+    const std::vector<uint64_t>& occupiedKeys() const {
+        return occupied_;
+    }
+
+    // Root and cell count of the grid (no keys)
+    const LinearOctree& grid() const {
+        return grid_;
+    }
+
+    void clear() {
+        cells_.clear();
+        occupied_.clear();
+        for (auto& bucket : buckets_) {
+            bucket.clear();
+        }
+    }
+
+private:
+    struct Cell {
+        float log_odds = 0.0f;
+        size_t frame = 0;       // frame of the last hit, log_odds is as of that frame
+        bool occupied = false;  // listed in occupied_
+    };
+
+    Config config_;
+    LinearOctree grid_;         // only the root and cells are used, keys stay empty
+    float occupiedLogOdds_;
+
+    std::unordered_map<uint64_t, Cell> cells_;
+    std::vector<uint64_t> occupied_;
+    std::vector<std::vector<uint64_t>> buckets_;  // keys hit at frame f are in buckets_[f % size]
+    size_t frame_ = 0;
+
+    float decayed(const Cell& cell) const {
+        return cell.log_odds * std::pow(config_.decay, static_cast<float>(frame_ - cell.frame));
+    }
+};
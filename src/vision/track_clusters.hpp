@@ -4,6 +4,8 @@
 #include <vector>
 #include <optional>
 #include <limits>
+#include <atomic>
+#include <tuple>
 
 
 struct TimestampedPosition {
@@ -42,43 +44,55 @@ public:
     /**
      * Process new frame of clusters.
      * Call once per frame with the clustered detections.
+     *
+     * threads > 1 measures the cluster to track distances on this many workers of the calling
+     * thread's core::WorkerPool, the pairs within max_distance being gathered in a core::AppendBuffer.
      */
-    void update(const std::vector<Cluster>& clusters, size_t frame) {
+    void update(const std::vector<Cluster>& clusters, size_t frame, int threads = 1) {
         // Mark all tracks as unmatched for this frame
         std::vector<bool> track_matched(tracks_.size(), false);
         std::vector<bool> cluster_matched(clusters.size(), false);
 
-        // Greedy matching: for each cluster, find closest track within threshold
-        // (For single-object tracking this is fine; Hungarian would be overkill)
-        for (size_t ci = 0; ci < clusters.size(); ++ci) {
-            float best_dist = config_.max_distance;
-            size_t best_track = SIZE_MAX;
-
-            for (size_t ti = 0; ti < tracks_.size(); ++ti) {
-                if (track_matched[ti]) continue;
-
-                const auto& last_pos = tracks_[ti].positions.back().position;
-                float dist = (clusters[ci].centroid - last_pos).norm();
-
-                if (dist < best_dist) {
-                    best_dist = dist;
-                    best_track = ti;
+        // Candidate matches, sorted by cluster then distance then track
+        struct Candidate {
+            uint32_t cluster;
+            uint32_t track;
+            float distance;
+        };
+        core::AppendBuffer<Candidate> candidates(16, 256);
+        std::atomic<size_t> next_cluster{0};
+        size_t workers = threads > 1 ? std::min<size_t>(threads, clusters.size()) : 1;
+        core::localWorkerPool().run(workers, [&](size_t) {
+            auto writer = candidates.writer();
+            for (size_t ci = next_cluster++; ci < clusters.size(); ci = next_cluster++) {
+                for (size_t ti = 0; ti < tracks_.size(); ++ti) {
+                    const auto& last_pos = tracks_[ti].positions.back().position;
+                    float dist = (clusters[ci].centroid - last_pos).norm();
+                    if (dist < config_.max_distance) {
+                        writer.push_back({static_cast<uint32_t>(ci), static_cast<uint32_t>(ti), dist});
+                    }
                 }
             }
+        });
 
-            if (best_track != SIZE_MAX) {
-                // Match found
-                track_matched[best_track] = true;
-                cluster_matched[ci] = true;
-
-                Track& track = tracks_[best_track];
-                track.positions.push_back({frame, clusters[ci].centroid});
-                track.age++;
-                track.frames_missing = 0;
-
-                if (!track.confirmed && track.age >= config_.min_age) {
-                    track.confirmed = true;
-                }
+        // Greedy matching: for each cluster, find closest track within threshold
+        // (For single-object tracking this is fine; Hungarian would be overkill)
+        for (const Candidate& candidate : candidates.finalize([](const Candidate& c) {
+                 return std::make_tuple(c.cluster, c.distance, c.track);
+             })) {
+            if (cluster_matched[candidate.cluster] || track_matched[candidate.track]) continue;
+
+            // Match found
+            track_matched[candidate.track] = true;
+            cluster_matched[candidate.cluster] = true;
+
+            Track& track = tracks_[candidate.track];
+            track.positions.push_back({frame, clusters[candidate.cluster].centroid});
+            track.age++;
+            track.frames_missing = 0;
+
+            if (!track.confirmed && track.age >= config_.min_age) {
+                track.confirmed = true;
             }
         }
 